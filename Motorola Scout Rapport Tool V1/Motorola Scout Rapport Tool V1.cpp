@@ -3,6 +3,8 @@
 // Functionality: Walk the EXE's folder recursively, list folders + PNG counts,
 // ask whether to apply ImageMagick modulate (default 75,125,100), optionally add a hue
 // indicator PNG to an edge, saving results next to sources.
+// The processing itself lives in the ScoutCore library (scout_pipeline.h);
+// this file is the interactive front end.
 
 
 
@@ -18,53 +20,26 @@
 #endif
 #include <list>
 #include <iomanip>  // for std::setprecision in the progress bar
+#include <chrono>
 
 namespace fs = std::filesystem;
 
 #include <sstream>
 #include <cstdlib>
+#include <cstring>
 
-#include "docx_report.h"
-
-
-// Run magick.exe with given arguments
-static bool run_magick(const std::string& args)
-{
-#ifdef _WIN32
-    // Build full command line (convert to wide string)
-    std::wstring fullCmd = L"magick.exe " + std::wstring(args.begin(), args.end());
-
-    STARTUPINFOW si{};
-    PROCESS_INFORMATION pi{};
-    si.cb = sizeof(si);
-
-    if (!CreateProcessW(
-        nullptr,                         // Application name
-        fullCmd.data(),                  // Command line
-        nullptr, nullptr, FALSE, 0,
-        nullptr, nullptr, &si, &pi))
-    {
-        std::wcerr << L"[ERR] Failed to start: " << fullCmd << std::endl;
-        return false;
-    }
-
-    // Wait for process to finish
-    WaitForSingleObject(pi.hProcess, INFINITE);
-    DWORD exitCode = 1;
-    GetExitCodeProcess(pi.hProcess, &exitCode);
-    CloseHandle(pi.hProcess);
-    CloseHandle(pi.hThread);
-    return (exitCode == 0);
-#else
-    // fallback for non-Windows
-    std::string cmd = "\"magick.exe\" " + args;
-    int ret = std::system(cmd.c_str());
-    return (ret == 0);
-#endif
-}
-
-
+#include "scout_pipeline.h"
+#include "scout_service.h"
+#include "cpu_dispatch.h"
+#include "frame_ring.h"
+#include "png_chunks.h"
+#include "pixel_format.h"
+#include "recompress.h"
+#include <deque>
+#include <fstream>
 
+using scout::ModulateParams;
+using scout::Edge;
 
 // Shorten long paths for cleaner console output (e.g., .../file.png)
 static std::string short_path(const fs::path& full)
@@ -140,13 +115,6 @@ static bool iequals(const std::string& a, const std::string& b)
     return true;
 }
 
-static bool has_png_ext(const fs::path& p)
-{
-    auto ext = p.extension().string();
-    std::transform(ext.begin(), ext.end(), ext.begin(), [](unsigned char c) { return (char)std::tolower(c); });
-    return (ext == ".png");
-}
-
 // New: accept any common raster image extension
 static bool has_image_ext(const fs::path& p)
 {
@@ -155,8 +123,6 @@ static bool has_image_ext(const fs::path& p)
     return (ext == ".png" || ext == ".bmp" || ext == ".jpg" || ext == ".jpeg" || ext == ".tif" || ext == ".tiff" || ext == ".webp");
 }
 
-struct ModulateParams { double brightness = 75, saturation = 125, hue = 100; };
-
 static bool parse_modulate_triplet(const std::string& s, ModulateParams& out)
 {
     std::string t = s;
@@ -189,156 +155,430 @@ static bool yesno(const std::string& prompt, bool def = false)
 
 static void list_folders_and_pngs(const fs::path& root, std::vector<fs::path>& pngs)
 {
-    std::map<fs::path, int> counts;
-    for (auto it = fs::recursive_directory_iterator(root); it != fs::recursive_directory_iterator(); ++it) {
-        if (!it->is_regular_file()) continue;
-        const fs::path& p = it->path();
-
-        // only .png files
-        if (!has_png_ext(p)) continue;
-
-        // skip previously processed images (_GreyFilter or _WithScale)
-        std::string stem = p.stem().string();
-        if (stem.find("_GreyFilter") != std::string::npos ||
-            stem.find("_WithScale") != std::string::npos)
-            continue;
+    std::vector<fs::path> generated;
+    scout::discover_pngs(root, pngs, generated);
 
+    std::map<fs::path, int> counts;
+    for (const auto& p : pngs)
         counts[p.parent_path()] += 1;
-        pngs.push_back(p);
-    }
 
     std::cout << "\nFolders discovered and PNG counts:" << std::endl;
     for (const auto& kv : counts) {
         std::string shortPath = kv.first.filename().string().empty() ? "..." : (".../" + kv.first.filename().string());
         std::cout << "  - " << shortPath << "  (" << kv.second << " PNG)" << std::endl;
     }
-    std::cout << "\nTotal PNG files: " << pngs.size() << "\n\n";
+    std::cout << "\nTotal PNG files: " << pngs.size() << "\n";
+    if (!generated.empty())
+        std::cout << "Outputs from earlier runs: " << generated.size()
+            << " (run with --clean to remove them)\n";
+    std::cout << "\n";
 }
 
 
-
-static fs::path output_grey_name(const fs::path& in)
+static Edge parse_edge(const std::string& s)
 {
-    fs::path out = in;
-    out.replace_filename(in.stem().string() + "_GreyFilter" + in.extension().string());
-    return out;
+    if (s.size() == 0) return Edge::Right;
+    char c = (char)std::tolower((unsigned char)s[0]);
+    switch (c) {
+    case 't': return Edge::Top;
+    case 'r': return Edge::Right;
+    case 'b': return Edge::Bottom;
+    case 'l': return Edge::Left;
+    default:  return Edge::Right;
+    }
 }
 
-static fs::path output_scaled_name(const fs::path& grey)
+static scout::LegendSource parse_legend_source(const std::string& s)
 {
-    fs::path out = grey;
-    out.replace_filename(grey.stem().string() + "_WithScale" + grey.extension().string());
-    return out;
+    if (s.size() == 0) return scout::LegendSource::File;
+    switch ((char)std::tolower((unsigned char)s[0])) {
+    case 's': return scout::LegendSource::HueScale;
+    case 'a': return scout::LegendSource::FileOrHueScale;
+    default:  return scout::LegendSource::File;
+    }
 }
 
 
-// Apply the modulate filter to a single image and print clean progress
-static bool apply_modulate_to_image(const fs::path& inPath, const fs::path& outPath,
-    const ModulateParams& mp, size_t index, size_t total)
+static int run_clean(const fs::path& root)
 {
-    // Build command for ImageMagick
-    std::ostringstream ss;
-    ss << "\"" << inPath.string() << "\" -modulate "
-        << mp.brightness << "," << mp.saturation << "," << mp.hue
-        << " \"" << outPath.string() << "\"";
+    size_t fromManifest = 0;
+    std::vector<fs::path> generated = scout::find_generated_outputs(root, &fromManifest);
 
-    bool ok = run_magick(ss.str());
+    std::cout << "\nGenerated outputs found: " << generated.size();
+    if (fromManifest)
+        std::cout << " (" << fromManifest << " from " << scout::kOutputManifestName << ")";
+    std::cout << "\n";
 
-    double pct = ((index + 1) * 100.0) / total;
-    std::ostringstream line;
-    line << "[" << (ok ? "OK " : "ERR") << "] ("
-        << std::setw(3) << std::fixed << std::setprecision(0) << pct
-        << "%) " << short_path(inPath)
-        << " → " << outPath.filename().string();
-    std::cout << line.str() << std::endl;
+    if (!generated.empty()) {
+        if (!yesno("Delete these files?", false)) {
+            std::cout << "Cancelled by user. Press Enter to exit..." << std::endl;
+            std::string dummy; std::getline(std::cin, dummy);
+            return 0;
+        }
+
+        const auto start = std::chrono::steady_clock::now();
+        size_t failed = 0;
+        size_t removed = scout::remove_files_parallel(std::move(generated), failed,
+            [](size_t done, size_t total) { draw_progress("Removing", done, total); });
+        std::cout << std::endl;
+        const double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        std::cout << "Removed " << removed << " files in " << std::setprecision(2) << secs << " s";
+        if (failed)
+            std::cout << ", " << failed << " could not be removed";
+        std::cout << "\n";
+    }
 
-    return ok;
+    // Files that could not be removed stay listed for the next run
+    scout::prune_output_manifest(root);
 
+    std::cout << "\nDone. Press Enter to exit..." << std::endl;
+    std::string dummy; std::getline(std::cin, dummy);
+    return 0;
 }
 
+// --serve: keep a processing service running on localhost
+static int run_service(unsigned short port, const fs::path& cacheDir, bool recompress)
+{
+    scout::ServiceOptions options;
+    options.port = port;
+    options.recompress = recompress;
+    options.defaults.cacheDir = cacheDir;
+
+    scout::Service service(options);
+    if (!service.start()) {
+        std::cerr << "[ERR] " << service.error() << std::endl;
+        return 1;
+    }
 
-enum class Edge { Top, Right, Bottom, Left };
+    std::cout << "Serving on http://127.0.0.1:" << port << " (Ctrl+C to stop)\n";
+    service.run();
+    return 0;
+}
 
-static Edge parse_edge(const std::string& s)
+// --client: stand-in for a capture workstation client. Sends one image (and
+// its legend) to a running service and writes the result next to it.
+static int run_client(unsigned short port, const fs::path& image, const fs::path& legend)
 {
-    if (s.size() == 0) return Edge::Right;
-    char c = (char)std::tolower((unsigned char)s[0]);
-    switch (c) {
-    case 't': return Edge::Top;
-    case 'r': return Edge::Right;
-    case 'b': return Edge::Bottom;
-    case 'l': return Edge::Left;
-    default:  return Edge::Right;
+    auto slurp = [](const fs::path& p, std::vector<unsigned char>& data) {
+        std::ifstream in(p, std::ios::binary);
+        data.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+        return static_cast<bool>(in) || in.eof();
+    };
+
+    std::vector<unsigned char> body, legendData;
+    if (!slurp(image, body) || body.empty() || (!legend.empty() && !slurp(legend, legendData))) {
+        std::cerr << "[ERR] Cannot read input files" << std::endl;
+        return 1;
+    }
+
+    std::vector<std::string> headers;
+    if (!legendData.empty()) {
+        headers.push_back("X-Legend-Length: " + std::to_string(legendData.size()));
+        body.insert(body.end(), legendData.begin(), legendData.end());
     }
+
+    const auto start = std::chrono::steady_clock::now();
+    int status = 0;
+    std::vector<unsigned char> reply;
+    if (!scout::service_request(port, "POST", "/process", body, headers, status, reply)) {
+        std::cerr << "[ERR] No service on port " << port << std::endl;
+        return 1;
+    }
+    const double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    if (status != 200) {
+        std::cerr << "[ERR] " << status << ": " << std::string(reply.begin(), reply.end());
+        return 1;
+    }
+
+    fs::path out = scout::output_grey_name(image);
+    if (!legendData.empty()) out = scout::output_scaled_name(out);
+    std::ofstream(out, std::ios::binary).write(reinterpret_cast<const char*>(reply.data()), reply.size());
+
+    std::cout << "[OK ] " << short_path(out) << " (" << std::fixed << std::setprecision(0) << ms << " ms)\n";
+    return 0;
 }
 
-static bool composite_scale_on_edge(
-    const fs::path& baseGrey,
-    const fs::path& legendPath,
-    const fs::path& outPath,
-    const ModulateParams& mp,
-    Edge edge,
-    int scalePercent,
-    bool cropLegendFirst)
+// --info: print the text an output carries, with the options it was made
+// with, read without decoding the image
+static int run_info(const fs::path& file)
 {
-    // Temporary resized legend path (stored beside output)
-    fs::path tmpLegend = outPath.parent_path() / "_tmp_legend_overlay.png";
-
-    // Step 1: Prepare (trim + modulate + resize) legend into temporary file
-    {
-        std::ostringstream prep;
-        prep << "\"" << legendPath.string() << "\"";
-        if (cropLegendFirst)
-            prep << " -trim";
-        prep << " -modulate " << mp.brightness << "," << mp.saturation << "," << mp.hue
-            << " -resize " << scalePercent << "% \"" << tmpLegend.string() << "\"";
-
-        if (!run_magick(prep.str())) {
-            std::cerr << "[ERR] Legend prep failed: " << short_path(legendPath) << std::endl;
-            return false;
-        }
+    std::map<std::string, std::string> text;
+    if (!scout::read_png_text(file, text)) {
+        std::cerr << "[ERR] Not a readable PNG: " << short_path(file) << std::endl;
+        return 1;
+    }
+
+    scout::Options options;
+    if (scout::read_output_options(file, options)) {
+        std::cout << "Made with: modulate " << (options.modulate ? "on" : "off")
+                  << " (" << options.mp.brightness << "," << options.mp.saturation << "," << options.mp.hue << ")"
+                  << ", legend " << (options.legend ? "on" : "off") << "\n";
+    }
+    else {
+        std::cout << "No Scout parameters recorded\n";
     }
+    for (const auto& kv : text)
+        std::cout << "  " << kv.first << ": " << kv.second << "\n";
+    return 0;
+}
 
-    // Step 2: Composite overlay onto base image
-    {
-        std::ostringstream comp;
-        comp << "\"" << baseGrey.string() << "\" \"" << tmpLegend.string()
-            << "\" -gravity ";
+// --ring: process raw frames that producers write into shared memory
+static int run_ring(const std::string& name, const scout::FrameRingConfig& config)
+{
+    std::string error;
+    auto ring = scout::FrameRing::create(name, config, error);
+    if (!ring) {
+        std::cerr << "[ERR] " << error << std::endl;
+        return 1;
+    }
 
-        switch (edge) {
-        case Edge::Top:    comp << "north"; break;
-        case Edge::Bottom: comp << "south"; break;
-        case Edge::Left:   comp << "west"; break;
-        case Edge::Right:  comp << "east"; break;
-        }
+    std::cout << "Frame ring '" << name << "': " << config.slots << " slots of up to "
+        << config.maxWidth << "x" << config.maxHeight << " (stop with --ring-stop " << name << ")\n";
+    const size_t frames = scout::serve_frame_ring(*ring, 0, [](uint32_t slot, scout::FrameStatus status) {
+        if (status != scout::FrameStatus::Ok)
+            std::cerr << "[ERR] Slot " << slot << ": frame size out of range\n";
+    });
+    std::cout << "Frame ring closed after " << frames << " frames.\n";
+    return 0;
+}
 
-        comp << " -composite \"" << outPath.string() << "\"";
+static int run_ring_stop(const std::string& name)
+{
+    std::string error;
+    auto ring = scout::FrameRing::open(name, error);
+    if (!ring) {
+        std::cerr << "[ERR] " << error << std::endl;
+        return 1;
+    }
+    ring->shutdown();
+    return 0;
+}
 
-        bool ok = run_magick(comp.str());
+// --ring-bench: local producer for testing --ring. Streams synthetic frames
+// through the ring with every slot in flight, checks the first result
+// against the same pipeline run locally and reports the throughput.
+static int run_ring_bench(const std::string& name, size_t frames, scout::LegendPlacement placement)
+{
+    std::string error;
+    auto ring = scout::FrameRing::open(name, error);
+    if (!ring) {
+        std::cerr << "[ERR] " << error << std::endl;
+        return 1;
+    }
 
-        // Clean up temp file
-        std::error_code ec;
-        fs::remove(tmpLegend, ec);
+    const scout::FrameRingConfig& c = ring->config();
+    // An extended canvas has to fit the output area, so leave room for the legend
+    const int width = static_cast<int>(std::min<uint32_t>(c.maxWidth, 1280))
+        - (placement == scout::LegendPlacement::Extend ? 64 : 0);
+    const int height = static_cast<int>(std::min<uint32_t>(c.maxHeight, 720));
+    const int legendW = std::min(16, width), legendH = static_cast<int>(std::min<uint32_t>(c.maxLegendPixels / legendW, 64));
+
+    scout::Options options;
+    options.legendPercent = 200;
+    options.placement = placement;
+
+    auto fill = [&](uint32_t slot, size_t n) {
+        scout::FrameSlot& s = ring->slot(slot);
+        s.width = width;
+        s.height = height;
+        s.legendWidth = legendW;
+        s.legendHeight = legendH;
+        scout::FrameRing::set_options(s, options);
+
+        const scout::ImageView in = ring->input(slot);
+        for (int y = 0; y < height; ++y) {
+            uint8_t* p = in.row(y);
+            for (int x = 0; x < width; ++x, p += 4) {
+                p[0] = static_cast<uint8_t>(x + n);
+                p[1] = static_cast<uint8_t>(y);
+                p[2] = static_cast<uint8_t>(x ^ y);
+                p[3] = 255;
+            }
+        }
+        const scout::ImageView lg = ring->legend(slot);
+        for (int y = 0; y < legendH; ++y) {
+            uint8_t* p = lg.row(y);
+            for (int x = 0; x < legendW; ++x, p += 4) {
+                p[0] = static_cast<uint8_t>(255 * y / legendH);
+                p[1] = 0;
+                p[2] = static_cast<uint8_t>(255 - 255 * y / legendH);
+                p[3] = 255;
+            }
+        }
+    };
+
+    // Expected output of frame 0, computed here from a copy of its input
+    scout::Image expected;
+    bool verified = false, mismatch = false;
+
+    std::deque<uint32_t> inFlight;
+    size_t done = 0, failed = 0;
+    auto finish_oldest = [&] {
+        const uint32_t slot = inFlight.front();
+        inFlight.pop_front();
+        if (!ring->wait_done(slot, -1))
+            return false;
+        if (ring->slot(slot).status != scout::FrameStatus::Ok)
+            ++failed;
+        else if (!verified) {
+            const scout::ImageView out = ring->output(slot);
+            mismatch = out.width != expected.width || out.height != expected.height ||
+                std::memcmp(out.data, expected.pixels.data(), expected.pixels.size()) != 0;
+            verified = true;
+        }
+        ring->release(slot);
+        ++done;
+        return true;
+    };
 
-        return ok;
+    const auto start = std::chrono::steady_clock::now();
+    for (size_t n = 0; n < frames; ++n) {
+        if (inFlight.size() == c.slots && !finish_oldest())
+            break;
+        const int slot = ring->acquire(-1);
+        if (slot < 0)
+            break;
+        fill(static_cast<uint32_t>(slot), n);
+
+        if (n == 0) {
+            scout::Image in(width, height), lg(legendW, legendH);
+            std::memcpy(in.pixels.data(), ring->input(slot).data, in.pixels.size());
+            std::memcpy(lg.pixels.data(), ring->legend(slot).data, lg.pixels.size());
+            const scout::ImageView lgView = lg.view();
+            scout::process_pixels(in.view(), &lgView, options, [&](int w, int h) {
+                expected = scout::Image(w, h);
+                return expected.view();
+            });
+        }
+
+        ring->submit(static_cast<uint32_t>(slot));
+        inFlight.push_back(static_cast<uint32_t>(slot));
     }
+    while (!inFlight.empty() && finish_oldest()) {}
+    const double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    const double mb = static_cast<double>(done) * width * height * 4 / (1024.0 * 1024.0);
+    std::cout << done << " frames of " << width << "x" << height << " in " << std::fixed << std::setprecision(2)
+        << secs << " s: " << std::setprecision(1) << done / secs << " frames/s, " << mb / secs << " MB/s"
+        << " (local CPU path " << scout::isa_name(scout::active_isa()) << ")\n";
+    if (failed)
+        std::cout << "[ERR] " << failed << " frames were rejected\n";
+    if (mismatch)
+        std::cout << "[ERR] Ring output differs from the local pipeline\n";
+    else if (verified)
+        std::cout << "[OK ] Ring output matches the local pipeline\n";
+    return (done == frames && !failed && !mismatch) ? 0 : 1;
 }
 
+// --modulate-check: run every 24-bit colour through the modulate with each
+// instruction set this CPU has. The fixed-point versions have to give the
+// same bytes; the double version (the 16-bit path) is timed beside them
+// with how far it is from them.
+static int run_modulate_check(const ModulateParams& mp)
+{
+    const size_t count = size_t(1) << 24;
+    scout::Image colours(4096, 4096);
+    for (uint32_t i = 0; i < count; ++i) {
+        uint8_t* p = colours.pixels.data() + static_cast<size_t>(i) * 4;
+        p[0] = static_cast<uint8_t>(i >> 16);
+        p[1] = static_cast<uint8_t>(i >> 8);
+        p[2] = static_cast<uint8_t>(i);
+        p[3] = static_cast<uint8_t>(i * 7);     // must come through untouched
+    }
+
+    auto ms_since = [](std::chrono::steady_clock::time_point start) {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    };
+
+    std::cout << "Modulate " << mp.brightness << "," << mp.saturation << "," << mp.hue
+        << " over all " << count << " colours:\n" << std::fixed << std::setprecision(0);
+    const scout::Isa active = scout::active_isa();
+    std::vector<uint8_t> reference;
+    bool same = true;
+    for (int k = 0; k <= static_cast<int>(scout::Isa::Neon); ++k) {
+        const scout::Isa isa = static_cast<scout::Isa>(k);
+        if (!scout::force_isa(isa))
+            continue;
+        scout::Image image = colours;
+        const auto start = std::chrono::steady_clock::now();
+        scout::modulate(image.view(), mp);
+        const double ms = ms_since(start);
+
+        bool ok = true;
+        if (reference.empty()) {
+            for (size_t i = 0; i < count && ok; ++i)
+                ok = image.pixels[i * 4 + 3] == colours.pixels[i * 4 + 3];
+            reference = std::move(image.pixels);
+        }
+        else {
+            ok = image.pixels == reference;
+        }
+        same = same && ok;
+        std::cout << (ok ? "[OK ] " : "[ERR] ") << std::setw(7) << scout::isa_name(isa) << ": " << ms << " ms\n";
+    }
+    scout::force_isa(active);
+
+    std::vector<uint16_t> wide(count * 3);
+    for (size_t i = 0; i < count; ++i)
+        for (int c = 0; c < 3; ++c)
+            wide[i * 3 + c] = static_cast<uint16_t>(colours.pixels[i * 4 + c] * 257);
+    const scout::PixelView view{ reinterpret_cast<uint8_t*>(wide.data()), 4096, 4096, 4096 * 6, scout::PixelFormat::Rgb16 };
+    const auto start = std::chrono::steady_clock::now();
+    scout::format_kernels(scout::PixelFormat::Rgb16).modulate(view, mp);
+    const double ms = ms_since(start);
+
+    size_t differ = 0;
+    int maxDiff = 0;
+    for (size_t i = 0; i < count; ++i)
+        for (int c = 0; c < 3; ++c) {
+            const int d = std::abs(reference[i * 4 + c] - (wide[i * 3 + c] + 128) / 257);
+            differ += d != 0;
+            maxDiff = std::max(maxDiff, d);
+        }
+    std::cout << "       double: " << ms << " ms, " << differ << " samples differ from fixed point by up to " << maxDiff << "\n";
 
+    if (!same)
+        std::cout << "[ERR] Instruction sets give different results\n";
+    return same && maxDiff <= 1 ? 0 : 1;
+}
 
+// Print one line per processed item
+static bool print_item(const scout::ItemResult& r)
+{
+    using scout::Outcome;
 
+    if (r.stage == scout::Stage::Legend && r.index == 0)
+        std::cout << "Applying legends to processed images...\n";
 
+    if (r.outcome == Outcome::Skipped) {
+        std::cout << "[SKP] .../" << r.input.filename().string() << " (already processed)" << std::endl;
+    }
+    else if (r.outcome == Outcome::NoLegend) {
+        std::cout << "[MISS] " << short_path(r.input) << " (no legend found)\n";
+    }
+    else {
+        const char* tag = "OK ";
+        switch (r.outcome) {
+        case Outcome::Failed:    tag = "ERR"; break;
+        case Outcome::CacheHit:  tag = "HIT"; break;
+        case Outcome::Duplicate: tag = "DUP"; break;
+        default: break;
+        }
 
+        double pct = ((r.index + 1) * 100.0) / r.total;
+        std::cout << "[" << tag << "] ("
+            << std::setw(3) << std::fixed << std::setprecision(0) << pct << "%) ";
+        if (r.stage == scout::Stage::Modulate)
+            std::cout << short_path(r.input) << " → " << r.output.filename().string() << std::endl;
+        else
+            std::cout << short_path(r.output) << std::endl;
+    }
 
-static fs::path legend_for_base(const fs::path& basePng)
-{
-    const auto dir = basePng.parent_path();
-    const auto stem = basePng.stem().string();
-    fs::path bmp = dir / (stem + "_Legend.bmp");
-    fs::path png = dir / (stem + "_Legend.png");
-    if (fs::exists(bmp)) return bmp;
-    if (fs::exists(png)) return png;
-    return {};
+    if (r.stage == scout::Stage::Legend && r.index + 1 == r.total)
+        std::cout << "Legend overlay complete (" << r.total << " files).\n";
+    return true;
 }
 
 
@@ -350,6 +590,76 @@ int main(int argc, char** argv)
     fs::path root = exe_dir();
     std::cout << "Working root: " << root.string() << "\n";
 
+    // --isa <scalar|sse4.2|avx2|avx512|neon> (or SCOUT_ISA) runs the pixel
+    // kernels with a lower instruction set than the CPU has, for testing
+    for (int i = 1; i + 1 < argc; ++i) {
+        scout::Isa isa;
+        if (iequals(argv[i], "--isa") && (!scout::parse_isa(argv[i + 1], isa) || !scout::force_isa(isa)))
+            std::cerr << "[ERR] Instruction set not available here: " << argv[i + 1] << std::endl;
+    }
+    std::cout << "CPU path: " << scout::isa_name(scout::active_isa()) << "\n";
+
+    // --clean removes every output of earlier runs instead of processing.
+    // --cache <dir> (or SCOUT_CACHE_DIR) reuses finished outputs from a
+    // shared content-addressed cache.
+    fs::path cacheDir;
+    if (const char* env = std::getenv("SCOUT_CACHE_DIR"))
+        cacheDir = env;
+
+    // --serve [port] runs the local processing service (--recompress: and
+    // recompresses its outputs while idle); --client <port> <image> [legend]
+    // sends one image to it.
+    // --ring <name> [slots] [width] [height] serves a shared-memory frame
+    // ring; --ring-bench <name> [frames] [extend] feeds it test frames and
+    // --ring-stop <name> shuts it down.
+    // --info <png> prints the metadata and processing parameters of an output.
+    // --modulate-check [b,s,h] checks the fixed-point modulate on every colour.
+    int servePort = 0;
+    bool serveRecompress = false;
+    for (int i = 1; i < argc; ++i) {
+        if (iequals(argv[i], "--clean"))
+            return run_clean(root);
+        if (iequals(argv[i], "--cache") && i + 1 < argc)
+            cacheDir = argv[++i];
+        else if (iequals(argv[i], "--serve"))
+            servePort = (i + 1 < argc && std::isdigit((unsigned char)argv[i + 1][0])) ? std::atoi(argv[++i]) : 8765;
+        else if (iequals(argv[i], "--recompress"))
+            serveRecompress = true;
+        else if (iequals(argv[i], "--client") && i + 2 < argc)
+            return run_client(static_cast<unsigned short>(std::atoi(argv[i + 1])), argv[i + 2],
+                i + 3 < argc ? fs::path(argv[i + 3]) : fs::path());
+        else if (iequals(argv[i], "--ring") && i + 1 < argc) {
+            scout::FrameRingConfig config;
+            if (i + 2 < argc) config.slots = static_cast<uint32_t>(std::atoi(argv[i + 2]));
+            if (i + 3 < argc) config.maxWidth = static_cast<uint32_t>(std::atoi(argv[i + 3]));
+            if (i + 4 < argc) config.maxHeight = static_cast<uint32_t>(std::atoi(argv[i + 4]));
+            return run_ring(argv[i + 1], config);
+        }
+        else if (iequals(argv[i], "--ring-bench") && i + 1 < argc)
+            return run_ring_bench(argv[i + 1], i + 2 < argc ? static_cast<size_t>(std::atoll(argv[i + 2])) : 500,
+                i + 3 < argc && iequals(argv[i + 3], "extend") ? scout::LegendPlacement::Extend : scout::LegendPlacement::Overlay);
+        else if (iequals(argv[i], "--ring-stop") && i + 1 < argc)
+            return run_ring_stop(argv[i + 1]);
+        else if (iequals(argv[i], "--info") && i + 1 < argc)
+            return run_info(argv[i + 1]);
+        else if (iequals(argv[i], "--modulate-check")) {
+            ModulateParams mp;
+            if (i + 1 < argc && argv[i + 1][0] != '-' && !parse_modulate_triplet(argv[i + 1], mp)) {
+                std::cerr << "[ERR] Expected brightness,saturation,hue: " << argv[i + 1] << std::endl;
+                return 1;
+            }
+            return run_modulate_check(mp);
+        }
+        else if (iequals(argv[i], "--isa") && i + 1 < argc)
+            ++i;
+    }
+
+    if (servePort > 0)
+        return run_service(static_cast<unsigned short>(servePort), cacheDir, serveRecompress);
+
+    if (!cacheDir.empty())
+        std::cout << "Output cache: " << cacheDir.string() << "\n";
+
     std::vector<fs::path> pngs;
     list_folders_and_pngs(root, pngs);
 
@@ -384,12 +694,23 @@ int main(int argc, char** argv)
         std::cout << "Using modulate: " << mp.brightness << "," << mp.saturation << "," << mp.hue << "\n";
     }
 
+    // Written in the same ImageMagick call as the modulate filter
+    bool doStamp = yesno("Stamp file name, folder and capture time onto the images?", false);
+
     bool doLegend = yesno("Overlay matching *_Legend.(bmp|png) onto images?", true);
     bool cropFirst = false;
     int  legendPct = 500;
     Edge edge = Edge::Right;
+    scout::LegendSource legendSource = scout::LegendSource::File;
+    scout::LegendPlacement placement = scout::LegendPlacement::Overlay;
 
     if (doLegend) {
+        // The drawn hue scale needs no legend file and no trim/resize step
+        legendSource = parse_legend_source(
+            ask("Legend from files, a drawn hue scale, or the scale where files are missing? (file/scale/auto) [file]: "));
+    }
+
+    if (doLegend && legendSource != scout::LegendSource::HueScale) {
         cropFirst = yesno("Crop legend (trim) before applying modulate?", true);
 
         bool custom = yesno("Use custom legend scale percentage? (default 500%)", false);
@@ -401,16 +722,38 @@ int main(int argc, char** argv)
                 std::cout << "Please enter a number between 1 and 2000.\n";
             }
         }
+    }
+
+    if (doLegend) {
         std::string sideStr = ask("Which side to place the legend? (top/right/left/bottom) [right]: ");
         edge = parse_edge(sideStr);
+
+        // Extend grows the canvas so the legend covers none of the image
+        std::string placeStr = ask("Place the legend over the image or extend the canvas beside it? (overlay/extend) [overlay]: ");
+        if (!placeStr.empty() && std::tolower((unsigned char)placeStr[0]) == 'e')
+            placement = scout::LegendPlacement::Extend;
     }
+    // Indexed PNGs are far smaller for flat screenshots; exact keeps every
+    // colour and falls back to truecolour, reduce cuts down to 256
+    std::string paletteStr = ask("Write outputs as palette PNGs? (off/exact/reduce) [off]: ");
+    scout::PaletteMode palette = scout::PaletteMode::Off;
+    if (!paletteStr.empty()) {
+        switch ((char)std::tolower((unsigned char)paletteStr[0])) {
+        case 'e': palette = scout::PaletteMode::Exact; break;
+        case 'r': palette = scout::PaletteMode::Reduce; break;
+        default:  break;
+        }
+    }
+
+    // High-effort recompression runs after the batch at background priority
+    bool doRecompress = yesno("Recompress the outputs for archiving in the background afterwards?", false);
     // ----------------------------------------------------------------
 
 
     // Check if any output files already exist
     bool anyExist = false;
     for (const auto& p : pngs) {
-        fs::path out = output_grey_name(p);
+        fs::path out = scout::output_grey_name(p);
         if (fs::exists(out)) {
             anyExist = true;
             break;
@@ -427,78 +770,50 @@ int main(int argc, char** argv)
         }
     }
 
-    // -------------------------- Modulate pass ------------------------
-    for (size_t i = 0; i < pngs.size(); ++i) {
-        const auto& p = pngs[i];
-        fs::path out = output_grey_name(p);
-
-        if (fs::exists(out) && !allowOverwrite) {
-            std::cout << "[SKP] .../" << p.filename().string() << " (already processed)" << std::endl;
-            continue;
-        }
-
-        bool ok = apply_modulate_to_image(p, out, mp, i, pngs.size());
-
-    }
-
+    scout::Options options;
+    // "No" above only skips the value prompts: the pass always runs, with the
+    // standard values unless others were entered
+    options.modulate = true;
+    options.mp = mp;
+    options.legend = doLegend;
+    options.cropLegendFirst = cropFirst;
+    options.legendPercent = legendPct;
+    options.edge = edge;
+    options.legendSource = legendSource;
+    options.placement = placement;
+    options.palette = palette;
+    options.stamp.enabled = doStamp;
+    options.overwrite = allowOverwrite;
+    options.cacheDir = cacheDir;
+
+    // Outputs written by this run, recorded in the manifest for --clean
+    std::vector<fs::path> written = scout::process_batch(pngs, options, print_item);
+
+    if (doLegend && std::none_of(pngs.begin(), pngs.end(),
+        [](const fs::path& p) { return fs::exists(scout::output_grey_name(p)); }))
+        std::cout << "No _GreyFilter.png outputs found to annotate.\n";
 
     // ----------------------------------------------------------------
 
-   // -------------------------- Legend pass --------------------------
-   // -------------------------- Legend pass --------------------------
-    if (doLegend) {
-        std::cout << "Applying legends to processed images...\n";
+    scout::record_outputs(root, written);
 
-        // Work on all *_GreyFilter.png we produced (or that already exist)
-        std::vector<fs::path> greys;
-        for (const auto& p : pngs) {
-            fs::path g = output_grey_name(p);
-            if (fs::exists(g)) greys.push_back(g);
-        }
-
-        if (greys.empty()) {
-            std::cout << "No _GreyFilter.png outputs found to annotate.\n";
-        }
-        else {
-            const size_t total = greys.size();
-            for (size_t i = 0; i < total; ++i) {
-                const auto& g = greys[i];
-
-                // Recover base name (strip _GreyFilter)
-                const std::string greyStem = g.stem().string();
-                const std::string suffix = "_GreyFilter";
-                std::string baseStem = greyStem;
-                if (greyStem.size() > suffix.size() &&
-                    greyStem.rfind(suffix) == greyStem.size() - suffix.size())
-                    baseStem = greyStem.substr(0, greyStem.size() - suffix.size());
-
-                fs::path legend = g.parent_path() / (baseStem + "_Legend.bmp");
-                if (!fs::exists(legend)) {
-                    fs::path alt = g.parent_path() / (baseStem + "_Legend.png");
-                    if (fs::exists(alt)) legend = alt; else legend.clear();
-                }
-
-                if (legend.empty()) {
-                    std::cout << "[MISS] " << short_path(g) << " (no legend found)\n";
-                    continue;
-                }
-
-                fs::path out = output_scaled_name(g);
-                bool ok = composite_scale_on_edge(g, legend, out, mp, edge, legendPct, cropFirst);
-
-                double pct = ((i + 1) * 100.0) / total;
-                std::cout << "[" << (ok ? "OK " : "ERR") << "] ("
-                    << std::setw(3) << std::fixed << std::setprecision(0) << pct
-                    << "%) " << short_path(out) << std::endl;
-            }
-            std::cout << "Legend overlay complete (" << total << " files).\n";
-        }
+    if (!doRecompress || written.empty()) {
+        std::cout << "\nDone. Press Enter to exit..." << std::endl;
+        std::string dummy; std::getline(std::cin, dummy);
+        return 0;
     }
 
-
-    // ----------------------------------------------------------------
-
-    std::cout << "\nDone. Press Enter to exit..." << std::endl;
+    // Every swap is a rename, so leaving early only leaves files as they are
+    scout::RecompressQueue recompress;
+    recompress.add(written);
+    std::cout << "\nDone. Recompressing " << written.size()
+        << " outputs in the background; press Enter to exit at any time..." << std::endl;
     std::string dummy; std::getline(std::cin, dummy);
+
+    const scout::RecompressStats st = recompress.stats();
+    std::cout << "Recompressed " << st.done << " of " << written.size() << " outputs, "
+        << st.smaller << " smaller, saving " << (st.bytesBefore - st.bytesAfter) / 1024 << " KB";
+    if (st.failed) std::cout << " (" << st.failed << " failed)";
+    std::cout << std::endl;
     return 0;
 }
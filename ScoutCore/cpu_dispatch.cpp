@@ -0,0 +1,564 @@
+#include "cpu_dispatch.h"
+#include "modulate_fixed.h"
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define SCOUT_X86 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#elif defined(_M_ARM64) || defined(__aarch64__)
+#define SCOUT_NEON 1
+#include <arm_neon.h>
+#endif
+
+// MSVC allows every intrinsic anywhere; GCC and Clang need the instruction
+// set enabled on the function that uses it
+#if defined(_MSC_VER) && !defined(__clang__)
+#define SCOUT_TARGET(isa)
+#else
+#define SCOUT_TARGET(isa) __attribute__((target(isa)))
+#endif
+
+namespace scout
+{
+    namespace
+    {
+        // --- Scalar ----------------------------------------------------------
+
+        size_t match_run_scalar(const uint8_t* rgba, size_t count, uint32_t colour)
+        {
+            size_t i = 0;
+            for (uint32_t px; i < count; ++i) {
+                std::memcpy(&px, rgba + i * 4, 4);
+                if (px != colour) break;
+            }
+            return i;
+        }
+
+        size_t match_run_back_scalar(const uint8_t* rgba, size_t count, uint32_t colour)
+        {
+            size_t i = count;
+            for (uint32_t px; i > 0; --i) {
+                std::memcpy(&px, rgba + (i - 1) * 4, 4);
+                if (px != colour) break;
+            }
+            return count - i;
+        }
+
+        void subtract_bytes_scalar(const uint8_t* a, const uint8_t* b, size_t size, uint8_t* out)
+        {
+            for (size_t i = 0; i < size; ++i)
+                out[i] = static_cast<uint8_t>(a[i] - b[i]);
+        }
+
+        uint64_t filter_cost_scalar(const uint8_t* data, size_t size)
+        {
+            uint64_t cost = 0;
+            for (size_t i = 0; i < size; ++i)
+                cost += data[i] < 128 ? data[i] : 256 - data[i];
+            return cost;
+        }
+
+        void modulate_scalar(uint8_t* pixels, size_t count, int channels, const ModulateTables& tables)
+        {
+            modulate_fixed_pixels(pixels, count, channels, tables);
+        }
+
+        // Set bits of a compare mask before its first clear one, from bit 0
+        inline size_t leading_ones(unsigned mask)
+        {
+            size_t n = 0;
+            while (mask & 1) { mask >>= 1; ++n; }
+            return n;
+        }
+
+        // Set bits after the last clear one, counting down from bit width-1
+        inline size_t trailing_ones(unsigned mask, int width)
+        {
+            size_t n = 0;
+            while (n < static_cast<size_t>(width) && (mask >> (width - 1 - n)) & 1) ++n;
+            return n;
+        }
+
+        const PixelKernels kScalarKernels = {
+            Isa::Scalar, match_run_scalar, match_run_back_scalar, subtract_bytes_scalar, filter_cost_scalar,
+            modulate_scalar
+        };
+
+#ifdef SCOUT_X86
+        // --- SSE4.2 ----------------------------------------------------------
+
+        SCOUT_TARGET("sse4.2")
+        size_t match_run_sse42(const uint8_t* rgba, size_t count, uint32_t colour)
+        {
+            const __m128i key = _mm_set1_epi32(static_cast<int>(colour));
+            size_t i = 0;
+            for (; i + 4 <= count; i += 4) {
+                const __m128i px = _mm_loadu_si128(reinterpret_cast<const __m128i*>(rgba + i * 4));
+                const unsigned mask = static_cast<unsigned>(_mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(px, key))));
+                if (mask != 0xF) return i + leading_ones(mask);
+            }
+            return i + match_run_scalar(rgba + i * 4, count - i, colour);
+        }
+
+        SCOUT_TARGET("sse4.2")
+        size_t match_run_back_sse42(const uint8_t* rgba, size_t count, uint32_t colour)
+        {
+            const __m128i key = _mm_set1_epi32(static_cast<int>(colour));
+            size_t i = 0;
+            for (; i + 4 <= count; i += 4) {
+                const __m128i px = _mm_loadu_si128(reinterpret_cast<const __m128i*>(rgba + (count - i - 4) * 4));
+                const unsigned mask = static_cast<unsigned>(_mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(px, key))));
+                if (mask != 0xF) return i + trailing_ones(mask, 4);
+            }
+            return i + match_run_back_scalar(rgba, count - i, colour);
+        }
+
+        SCOUT_TARGET("sse4.2")
+        void subtract_bytes_sse42(const uint8_t* a, const uint8_t* b, size_t size, uint8_t* out)
+        {
+            size_t i = 0;
+            for (; i + 16 <= size; i += 16) {
+                const __m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i));
+                const __m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm_sub_epi8(va, vb));
+            }
+            subtract_bytes_scalar(a + i, b + i, size - i, out + i);
+        }
+
+        // |v| of a signed byte is 128 for -128, read as unsigned, which is
+        // what the scalar version counts
+        SCOUT_TARGET("sse4.2")
+        uint64_t filter_cost_sse42(const uint8_t* data, size_t size)
+        {
+            __m128i sum = _mm_setzero_si128();
+            size_t i = 0;
+            for (; i + 16 <= size; i += 16) {
+                const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+                sum = _mm_add_epi64(sum, _mm_sad_epu8(_mm_abs_epi8(v), _mm_setzero_si128()));
+            }
+            uint64_t lanes[2];
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(lanes), sum);
+            return lanes[0] + lanes[1] + filter_cost_scalar(data + i, size - i);
+        }
+
+        const PixelKernels kSse42Kernels = {
+            Isa::Sse42, match_run_sse42, match_run_back_sse42, subtract_bytes_sse42, filter_cost_sse42,
+            modulate_scalar
+        };
+
+        // --- AVX2 ------------------------------------------------------------
+
+        SCOUT_TARGET("avx2")
+        size_t match_run_avx2(const uint8_t* rgba, size_t count, uint32_t colour)
+        {
+            const __m256i key = _mm256_set1_epi32(static_cast<int>(colour));
+            size_t i = 0;
+            for (; i + 8 <= count; i += 8) {
+                const __m256i px = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(rgba + i * 4));
+                const unsigned mask = static_cast<unsigned>(
+                    _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(px, key))));
+                if (mask != 0xFF) return i + leading_ones(mask);
+            }
+            return i + match_run_scalar(rgba + i * 4, count - i, colour);
+        }
+
+        SCOUT_TARGET("avx2")
+        size_t match_run_back_avx2(const uint8_t* rgba, size_t count, uint32_t colour)
+        {
+            const __m256i key = _mm256_set1_epi32(static_cast<int>(colour));
+            size_t i = 0;
+            for (; i + 8 <= count; i += 8) {
+                const __m256i px = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(rgba + (count - i - 8) * 4));
+                const unsigned mask = static_cast<unsigned>(
+                    _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(px, key))));
+                if (mask != 0xFF) return i + trailing_ones(mask, 8);
+            }
+            return i + match_run_back_scalar(rgba, count - i, colour);
+        }
+
+        SCOUT_TARGET("avx2")
+        void subtract_bytes_avx2(const uint8_t* a, const uint8_t* b, size_t size, uint8_t* out)
+        {
+            size_t i = 0;
+            for (; i + 32 <= size; i += 32) {
+                const __m256i va = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i));
+                const __m256i vb = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + i));
+                _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), _mm256_sub_epi8(va, vb));
+            }
+            subtract_bytes_scalar(a + i, b + i, size - i, out + i);
+        }
+
+        SCOUT_TARGET("avx2")
+        uint64_t filter_cost_avx2(const uint8_t* data, size_t size)
+        {
+            __m256i sum = _mm256_setzero_si256();
+            size_t i = 0;
+            for (; i + 32 <= size; i += 32) {
+                const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+                sum = _mm256_add_epi64(sum, _mm256_sad_epu8(_mm256_abs_epi8(v), _mm256_setzero_si256()));
+            }
+            uint64_t lanes[4];
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(lanes), sum);
+            return lanes[0] + lanes[1] + lanes[2] + lanes[3] + filter_cost_scalar(data + i, size - i);
+        }
+
+        // (a * b) >> shift per 32-bit lane, taking the product at 64 bits;
+        // the result has to fit in 32 again
+        SCOUT_TARGET("avx2")
+        inline __m256i mul_shift_avx2(__m256i a, __m256i b, __m256i round, int shift)
+        {
+            const __m256i even = _mm256_add_epi64(_mm256_mul_epi32(a, b), round);
+            const __m256i odd = _mm256_add_epi64(_mm256_mul_epi32(_mm256_srli_epi64(a, 32), _mm256_srli_epi64(b, 32)), round);
+            const __m128i count = _mm_cvtsi32_si128(shift);
+            return _mm256_blend_epi32(_mm256_srl_epi64(even, count),
+                _mm256_slli_epi64(_mm256_srl_epi64(odd, count), 32), 0xAA);
+        }
+
+        // hi, mid or lo as in modulate_fixed(), by sextant: bit is 1 << sextant,
+        // the masks have a bit set for each sextant that takes hi or mid
+        SCOUT_TARGET("avx2")
+        inline __m256i pick_channel_avx2(__m256i bit, int hiMask, int midMask, __m256i lo, __m256i mid, __m256i hi)
+        {
+            const __m256i useHi = _mm256_cmpeq_epi32(_mm256_and_si256(bit, _mm256_set1_epi32(hiMask)), bit);
+            const __m256i useMid = _mm256_cmpeq_epi32(_mm256_and_si256(bit, _mm256_set1_epi32(midMask)), bit);
+            const __m256i v = _mm256_blendv_epi8(_mm256_blendv_epi8(lo, mid, useMid), hi, useHi);
+            const __m256i sample = _mm256_srai_epi32(_mm256_add_epi32(v, _mm256_set1_epi32(ModulateTables::kOne / 2)), 12);
+            return _mm256_min_epi32(_mm256_max_epi32(sample, _mm256_setzero_si256()), _mm256_set1_epi32(0xFF));
+        }
+
+        // modulate_fixed() for 8 RGBA pixels at a time, step for step in
+        // 32-bit lanes, with the table lookups as gathers
+        SCOUT_TARGET("avx2")
+        void modulate_avx2(uint8_t* pixels, size_t count, int channels, const ModulateTables& tables)
+        {
+            if (channels != 4 || !tables.fits32) {
+                modulate_fixed_pixels(pixels, count, channels, tables);
+                return;
+            }
+
+            constexpr int32_t S = ModulateTables::kSextant;
+            const __m256i byte = _mm256_set1_epi32(0xFF);
+            const __m256i zero = _mm256_setzero_si256();
+            const __m256i turn = _mm256_set1_epi32(ModulateTables::kTurn);
+            const __m256i shift = _mm256_set1_epi32(tables.hueShift);
+            const __m256i sextant = _mm256_set1_epi32(S);
+            const __m256i fracMask = _mm256_set1_epi32(S - 1);
+            const __m256i eight = _mm256_set1_epi32(8);
+            const __m256i round8 = _mm256_set1_epi64x(128);
+            const __m256i one = _mm256_set1_epi32(1);
+            const int* light = tables.light;
+            const int* chroma32 = tables.chroma32;
+            const int* recip = reinterpret_cast<const int*>(tables.recip);
+
+            size_t i = 0;
+            for (; i + 8 <= count; i += 8) {
+                uint8_t* p = pixels + i * 4;
+                const __m256i px = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+                const __m256i r = _mm256_and_si256(px, byte);
+                const __m256i g = _mm256_and_si256(_mm256_srli_epi32(px, 8), byte);
+                const __m256i b = _mm256_and_si256(_mm256_srli_epi32(px, 16), byte);
+
+                const __m256i mx = _mm256_max_epi32(r, _mm256_max_epi32(g, b));
+                const __m256i mn = _mm256_min_epi32(r, _mm256_min_epi32(g, b));
+                const __m256i c = _mm256_sub_epi32(mx, mn);
+                const __m256i l2 = _mm256_add_epi32(mx, mn);
+
+                const __m256i isR = _mm256_cmpeq_epi32(mx, r);
+                const __m256i isG = _mm256_andnot_si256(isR, _mm256_cmpeq_epi32(mx, g));
+                __m256i base = _mm256_set1_epi32(4 * S);
+                base = _mm256_blendv_epi8(base, _mm256_set1_epi32(2 * S), isG);
+                base = _mm256_blendv_epi8(base, zero, isR);
+                __m256i diff = _mm256_sub_epi32(r, g);
+                diff = _mm256_blendv_epi8(diff, _mm256_sub_epi32(b, r), isG);
+                diff = _mm256_blendv_epi8(diff, _mm256_sub_epi32(g, b), isR);
+
+                // |diff| <= c, so diff * 2^24 / c stays well inside an int32
+                const __m256i rc = _mm256_i32gather_epi32(recip, c, 4);
+                __m256i hue = _mm256_add_epi32(base,
+                    _mm256_srai_epi32(_mm256_add_epi32(_mm256_mullo_epi32(diff, rc), eight), 4));
+                hue = _mm256_add_epi32(hue, _mm256_and_si256(_mm256_cmpgt_epi32(zero, hue), turn));
+                hue = _mm256_add_epi32(hue, shift);
+                hue = _mm256_sub_epi32(hue, _mm256_andnot_si256(_mm256_cmpgt_epi32(turn, hue), turn));
+
+                const __m256i sx = _mm256_srli_epi32(hue, 20);
+                const __m256i f = _mm256_and_si256(hue, fracMask);
+                const __m256i odd = _mm256_cmpeq_epi32(_mm256_and_si256(sx, one), one);
+                const __m256i frac = _mm256_blendv_epi8(f, _mm256_sub_epi32(sextant, f), odd);
+
+                const __m256i chroma = mul_shift_avx2(c, _mm256_i32gather_epi32(chroma32, l2, 4), round8, 8);
+                const __m256i lo = _mm256_sub_epi32(_mm256_i32gather_epi32(light, l2, 4), _mm256_srai_epi32(chroma, 1));
+                const __m256i hi = _mm256_add_epi32(lo, chroma);
+                const __m256i mid = _mm256_add_epi32(lo, mul_shift_avx2(chroma, frac, zero, 20));
+
+                const __m256i bit = _mm256_sllv_epi32(one, sx);
+                const __m256i outR = pick_channel_avx2(bit, 0x21, 0x12, lo, mid, hi);
+                const __m256i outG = pick_channel_avx2(bit, 0x06, 0x09, lo, mid, hi);
+                const __m256i outB = pick_channel_avx2(bit, 0x18, 0x24, lo, mid, hi);
+
+                const __m256i out = _mm256_or_si256(_mm256_or_si256(outR, _mm256_slli_epi32(outG, 8)),
+                    _mm256_or_si256(_mm256_slli_epi32(outB, 16), _mm256_andnot_si256(_mm256_set1_epi32(0xFFFFFF), px)));
+                _mm256_storeu_si256(reinterpret_cast<__m256i*>(p), out);
+            }
+            modulate_fixed_pixels(pixels + i * 4, count - i, 4, tables);
+        }
+
+        const PixelKernels kAvx2Kernels = {
+            Isa::Avx2, match_run_avx2, match_run_back_avx2, subtract_bytes_avx2, filter_cost_avx2,
+            modulate_avx2
+        };
+
+        // --- AVX-512 (F and BW) ----------------------------------------------
+
+        SCOUT_TARGET("avx512f,avx512bw")
+        size_t match_run_avx512(const uint8_t* rgba, size_t count, uint32_t colour)
+        {
+            const __m512i key = _mm512_set1_epi32(static_cast<int>(colour));
+            size_t i = 0;
+            for (; i + 16 <= count; i += 16) {
+                const __m512i px = _mm512_loadu_si512(rgba + i * 4);
+                const unsigned mask = _mm512_cmpeq_epi32_mask(px, key);
+                if (mask != 0xFFFF) return i + leading_ones(mask);
+            }
+            return i + match_run_scalar(rgba + i * 4, count - i, colour);
+        }
+
+        SCOUT_TARGET("avx512f,avx512bw")
+        size_t match_run_back_avx512(const uint8_t* rgba, size_t count, uint32_t colour)
+        {
+            const __m512i key = _mm512_set1_epi32(static_cast<int>(colour));
+            size_t i = 0;
+            for (; i + 16 <= count; i += 16) {
+                const __m512i px = _mm512_loadu_si512(rgba + (count - i - 16) * 4);
+                const unsigned mask = _mm512_cmpeq_epi32_mask(px, key);
+                if (mask != 0xFFFF) return i + trailing_ones(mask, 16);
+            }
+            return i + match_run_back_scalar(rgba, count - i, colour);
+        }
+
+        SCOUT_TARGET("avx512f,avx512bw")
+        void subtract_bytes_avx512(const uint8_t* a, const uint8_t* b, size_t size, uint8_t* out)
+        {
+            size_t i = 0;
+            for (; i + 64 <= size; i += 64)
+                _mm512_storeu_si512(out + i, _mm512_sub_epi8(_mm512_loadu_si512(a + i), _mm512_loadu_si512(b + i)));
+            subtract_bytes_scalar(a + i, b + i, size - i, out + i);
+        }
+
+        SCOUT_TARGET("avx512f,avx512bw")
+        uint64_t filter_cost_avx512(const uint8_t* data, size_t size)
+        {
+            __m512i sum = _mm512_setzero_si512();
+            size_t i = 0;
+            for (; i + 64 <= size; i += 64)
+                sum = _mm512_add_epi64(sum, _mm512_sad_epu8(_mm512_abs_epi8(_mm512_loadu_si512(data + i)),
+                    _mm512_setzero_si512()));
+            uint64_t lanes[8];
+            _mm512_storeu_si512(lanes, sum);
+            uint64_t cost = filter_cost_scalar(data + i, size - i);
+            for (uint64_t lane : lanes) cost += lane;
+            return cost;
+        }
+
+        const PixelKernels kAvx512Kernels = {
+            Isa::Avx512, match_run_avx512, match_run_back_avx512, subtract_bytes_avx512, filter_cost_avx512,
+            modulate_avx2
+        };
+
+        // --- Detection -------------------------------------------------------
+
+        void cpuid(int leaf, int sub, unsigned regs[4])
+        {
+#ifdef _MSC_VER
+            int r[4];
+            __cpuidex(r, leaf, sub);
+            for (int i = 0; i < 4; ++i) regs[i] = static_cast<unsigned>(r[i]);
+#else
+            __cpuid_count(leaf, sub, regs[0], regs[1], regs[2], regs[3]);
+#endif
+        }
+
+        // Register state the OS saves on a context switch (XCR0)
+        uint64_t os_saved_state()
+        {
+#ifdef _MSC_VER
+            return _xgetbv(0);
+#else
+            uint32_t lo, hi;
+            __asm__ volatile("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+            return (static_cast<uint64_t>(hi) << 32) | lo;
+#endif
+        }
+
+        Isa detect()
+        {
+            unsigned r[4];
+            cpuid(0, 0, r);
+            const unsigned maxLeaf = r[0];
+            if (maxLeaf < 1) return Isa::Scalar;
+
+            cpuid(1, 0, r);
+            const bool sse42 = (r[2] >> 20) & 1;
+            const bool osxsave = (r[2] >> 27) & 1;
+            const bool avx = (r[2] >> 28) & 1;
+            if (!sse42) return Isa::Scalar;
+
+            // AVX needs the OS to save the YMM registers, AVX-512 the opmask
+            // and ZMM ones as well
+            const uint64_t xcr0 = osxsave ? os_saved_state() : 0;
+            const bool ymm = (xcr0 & 0x06) == 0x06;
+            const bool zmm = (xcr0 & 0xE6) == 0xE6;
+            if (!avx || !ymm || maxLeaf < 7) return Isa::Sse42;
+
+            cpuid(7, 0, r);
+            const bool avx2 = (r[1] >> 5) & 1;
+            const bool avx512 = ((r[1] >> 16) & 1) && ((r[1] >> 30) & 1);   // F and BW
+            if (avx2 && avx512 && zmm) return Isa::Avx512;
+            return avx2 ? Isa::Avx2 : Isa::Sse42;
+        }
+
+        bool supported(Isa isa)
+        {
+            return isa != Isa::Neon && static_cast<int>(isa) <= static_cast<int>(detected_isa());
+        }
+#elif defined(SCOUT_NEON)
+        // --- NEON ------------------------------------------------------------
+
+        size_t match_run_neon(const uint8_t* rgba, size_t count, uint32_t colour)
+        {
+            const uint32x4_t key = vdupq_n_u32(colour);
+            size_t i = 0;
+            for (; i + 4 <= count; i += 4) {
+                const uint32x4_t eq = vceqq_u32(vreinterpretq_u32_u8(vld1q_u8(rgba + i * 4)), key);
+                if (vminvq_u32(eq) != 0xFFFFFFFFu) break;
+            }
+            return i + match_run_scalar(rgba + i * 4, count - i, colour);
+        }
+
+        size_t match_run_back_neon(const uint8_t* rgba, size_t count, uint32_t colour)
+        {
+            const uint32x4_t key = vdupq_n_u32(colour);
+            size_t i = 0;
+            for (; i + 4 <= count; i += 4) {
+                const uint32x4_t eq = vceqq_u32(vreinterpretq_u32_u8(vld1q_u8(rgba + (count - i - 4) * 4)), key);
+                if (vminvq_u32(eq) != 0xFFFFFFFFu) break;
+            }
+            return i + match_run_back_scalar(rgba, count - i, colour);
+        }
+
+        void subtract_bytes_neon(const uint8_t* a, const uint8_t* b, size_t size, uint8_t* out)
+        {
+            size_t i = 0;
+            for (; i + 16 <= size; i += 16)
+                vst1q_u8(out + i, vsubq_u8(vld1q_u8(a + i), vld1q_u8(b + i)));
+            subtract_bytes_scalar(a + i, b + i, size - i, out + i);
+        }
+
+        uint64_t filter_cost_neon(const uint8_t* data, size_t size)
+        {
+            uint64_t cost = 0;
+            size_t i = 0;
+            for (; i + 16 <= size; i += 16) {
+                const uint8x16_t v = vreinterpretq_u8_s8(vabsq_s8(vreinterpretq_s8_u8(vld1q_u8(data + i))));
+                cost += vaddlvq_u8(v);
+            }
+            return cost + filter_cost_scalar(data + i, size - i);
+        }
+
+        void modulate_neon(uint8_t* pixels, size_t count, int channels, const ModulateTables& tables)
+        {
+            modulate_fixed_pixels(pixels, count, channels, tables);
+        }
+
+        const PixelKernels kNeonKernels = {
+            Isa::Neon, match_run_neon, match_run_back_neon, subtract_bytes_neon, filter_cost_neon,
+            modulate_neon
+        };
+
+        // Every AArch64 CPU has NEON
+        Isa detect() { return Isa::Neon; }
+
+        bool supported(Isa isa) { return isa == Isa::Scalar || isa == Isa::Neon; }
+#else
+        Isa detect() { return Isa::Scalar; }
+
+        bool supported(Isa isa) { return isa == Isa::Scalar; }
+#endif
+
+        Isa initial_isa()
+        {
+            Isa isa = detected_isa();
+            Isa forced;
+            if (const char* env = std::getenv("SCOUT_ISA"))
+                if (parse_isa(env, forced) && supported(forced))
+                    isa = forced;
+            return isa;
+        }
+
+        std::atomic<int>& active_slot()
+        {
+            static std::atomic<int> slot{ static_cast<int>(initial_isa()) };
+            return slot;
+        }
+    }
+
+    Isa detected_isa()
+    {
+        static const Isa isa = detect();
+        return isa;
+    }
+
+    Isa active_isa()
+    {
+        return static_cast<Isa>(active_slot().load(std::memory_order_relaxed));
+    }
+
+    bool force_isa(Isa isa)
+    {
+        if (!supported(isa)) return false;
+        active_slot().store(static_cast<int>(isa), std::memory_order_relaxed);
+        return true;
+    }
+
+    static const char* const kIsaNames[] = { "scalar", "sse4.2", "avx2", "avx512", "neon" };
+
+    const char* isa_name(Isa isa)
+    {
+        return kIsaNames[static_cast<int>(isa)];
+    }
+
+    bool parse_isa(const std::string& name, Isa& out)
+    {
+        std::string lower = name;
+        std::transform(lower.begin(), lower.end(), lower.begin(),
+            [](unsigned char ch) { return static_cast<char>(std::tolower(ch)); });
+        for (int i = 0; i < 5; ++i)
+            if (lower == kIsaNames[i]) {
+                out = static_cast<Isa>(i);
+                return true;
+            }
+        return false;
+    }
+
+    const PixelKernels& pixel_kernels()
+    {
+        switch (active_isa()) {
+#ifdef SCOUT_X86
+        case Isa::Sse42:  return kSse42Kernels;
+        case Isa::Avx2:   return kAvx2Kernels;
+        case Isa::Avx512: return kAvx512Kernels;
+#elif defined(SCOUT_NEON)
+        case Isa::Neon:   return kNeonKernels;
+#endif
+        default:          return kScalarKernels;
+        }
+    }
+}
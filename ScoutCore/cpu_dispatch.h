@@ -0,0 +1,58 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Instruction set the pixel kernels run with. One binary carries a variant
+// of every kernel for each instruction set its architecture has; the best
+// one the CPU and OS support is picked on first use, so the same exe is
+// fast on a new server and still runs on an old field laptop.
+namespace scout
+{
+    struct ModulateTables;
+
+    enum class Isa { Scalar, Sse42, Avx2, Avx512, Neon };
+
+    // Best instruction set this machine supports
+    Isa detected_isa();
+
+    // The one in use: detected_isa(), or a lower one asked for with the
+    // SCOUT_ISA environment variable or force_isa()
+    Isa active_isa();
+
+    // Run the kernels with isa from now on; false (and no change) when the
+    // machine doesn't support it. Scalar always works.
+    bool force_isa(Isa isa);
+
+    // "scalar", "sse4.2", "avx2", "avx512", "neon"
+    const char* isa_name(Isa isa);
+    bool parse_isa(const std::string& name, Isa& out);
+
+    // Row kernels. Every variant gives exactly the same results, so outputs
+    // stay byte-identical whichever one a machine runs.
+    struct PixelKernels
+    {
+        Isa isa;
+
+        // Number of leading RGBA pixels of rgba equal to colour (in memory
+        // order), out of count
+        size_t (*match_run)(const uint8_t* rgba, size_t count, uint32_t colour);
+
+        // Same for the trailing pixels
+        size_t (*match_run_back)(const uint8_t* rgba, size_t count, uint32_t colour);
+
+        // out[i] = a[i] - b[i], wrapping; out may not overlap a or b
+        void (*subtract_bytes)(const uint8_t* a, const uint8_t* b, size_t size, uint8_t* out);
+
+        // Sum of |v| over the bytes taken as signed, the usual estimate of
+        // how well a filtered PNG row compresses
+        uint64_t (*filter_cost)(const uint8_t* data, size_t size);
+
+        // Fixed-point -modulate (modulate_fixed.h) of count pixels of
+        // channels (3 or 4) bytes each
+        void (*modulate)(uint8_t* pixels, size_t count, int channels, const ModulateTables& tables);
+    };
+
+    // Kernels for active_isa()
+    const PixelKernels& pixel_kernels();
+}
@@ -0,0 +1,145 @@
+#include "decoded_cache.h"
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+#include <zlib.h>
+
+namespace scout
+{
+    DecodedCache::DecodedCache(size_t budgetBytes)
+        : m_budget(budgetBytes)
+    {}
+
+    bool DecodedCache::stamp_of(const fs::path& file, Stamp& stamp)
+    {
+        std::error_code ec;
+        stamp.written = fs::last_write_time(file, ec);
+        if (ec) return false;
+        stamp.size = fs::file_size(file, ec);
+        return !ec;
+    }
+
+    uint32_t DecodedCache::crc_of(const std::vector<uint8_t>& data)
+    {
+        uLong crc = crc32(0, Z_NULL, 0);
+        for (size_t done = 0; done < data.size();) {
+            const size_t part = std::min<size_t>(data.size() - done, 1u << 30);
+            crc = crc32(crc, data.data() + done, static_cast<uInt>(part));
+            done += part;
+        }
+        return static_cast<uint32_t>(crc);
+    }
+
+    bool DecodedCache::read(const fs::path& file, std::vector<uint8_t>& data, Stamp& stamp, bool& steady)
+    {
+        if (!stamp_of(file, stamp)) return false;
+        {
+            std::ifstream in(file, std::ios::binary);
+            if (!in) return false;
+            data.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+        }
+
+        // Only a file that stayed the same while it was read can be matched
+        // (or cached) by its stamp
+        Stamp after;
+        steady = stamp_of(file, after) && after.written == stamp.written && after.size == stamp.size &&
+            data.size() == stamp.size;
+        stamp.crc = crc_of(data);
+        return true;
+    }
+
+    std::shared_ptr<const Image> DecodedCache::get(const fs::path& file, std::vector<uint8_t>& data)
+    {
+        Stamp stamp;
+        bool steady = false;
+        if (!read(file, data, stamp, steady)) return nullptr;
+
+        auto hit = steady ? lookup(file, stamp) : nullptr;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            ++(hit ? m_hits : m_misses);
+        }
+        if (hit) return hit;
+
+        auto image = std::make_shared<Image>();
+        if (!decode_png(data, *image)) return nullptr;
+        if (steady) store(file, stamp, image);
+        return image;
+    }
+
+    std::shared_ptr<const Image> DecodedCache::find(const fs::path& file)
+    {
+        std::vector<uint8_t> data;
+        Stamp stamp;
+        bool steady = false;
+        return read(file, data, stamp, steady) && steady ? lookup(file, stamp) : nullptr;
+    }
+
+    void DecodedCache::put(const fs::path& file, std::shared_ptr<const Image> image)
+    {
+        std::vector<uint8_t> data;
+        Stamp stamp;
+        bool steady = false;
+        if (image && read(file, data, stamp, steady) && steady)
+            store(file, stamp, std::move(image));
+    }
+
+    void DecodedCache::forget(const fs::path& file)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        drop(file);
+    }
+
+    DecodedCache::Stats DecodedCache::stats() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return { m_hits, m_misses, m_lru.size(), m_bytes, m_budget };
+    }
+
+    std::shared_ptr<const Image> DecodedCache::lookup(const fs::path& file, const Stamp& stamp)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto it = m_index.find(file);
+        if (it == m_index.end() || !(it->second->stamp == stamp))
+            return nullptr;
+        m_lru.splice(m_lru.begin(), m_lru, it->second);
+        return it->second->image;
+    }
+
+    void DecodedCache::store(const fs::path& file, const Stamp& stamp, std::shared_ptr<const Image> image)
+    {
+        const size_t bytes = image->pixels.size() + sizeof(Image);
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        // A path has one entry: whatever was cached for it before is stale
+        drop(file);
+        if (bytes > m_budget) return;
+        while (m_bytes + bytes > m_budget)
+            drop(m_lru.back().file);
+        m_lru.push_front({ file, stamp, std::move(image), bytes });
+        m_index[file] = m_lru.begin();
+        m_bytes += bytes;
+    }
+
+    void DecodedCache::drop(const fs::path& file)
+    {
+        auto it = m_index.find(file);
+        if (it == m_index.end()) return;
+        const auto entry = it->second;      // file may be this entry's own path
+        m_index.erase(it);
+        m_bytes -= entry->bytes;
+        m_lru.erase(entry);
+    }
+
+    DecodedCache& decoded_images()
+    {
+        static DecodedCache cache([] {
+            size_t mb = 256;
+            if (const char* env = std::getenv("SCOUT_DECODED_CACHE_MB"))
+                mb = static_cast<size_t>(std::strtoull(env, nullptr, 10));
+            return mb * 1024 * 1024;
+        }());
+        return cache;
+    }
+}
@@ -0,0 +1,83 @@
+#pragma once
+#include "png_codec.h"
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// Decoded pixels of the PNGs the tool reads back itself (the palette rewrite
+// after each pass, background recompression), kept in memory so the same
+// file isn't inflated twice. Entries are checked against the file's
+// modification time, size and a CRC-32 of its bytes (times alone can be too
+// coarse on network shares to tell two writes apart) and dropped least
+// recently used first once they pass a memory budget. A step that rewrites a
+// file without changing its pixels (metadata, re-encoding) hands them on
+// under the new file.
+namespace scout
+{
+    class DecodedCache
+    {
+    public:
+        explicit DecodedCache(size_t budgetBytes);
+
+        // Pixels of file, with its bytes in data; decoded on a miss. Null
+        // when the file can't be read or isn't a PNG decode_png handles.
+        std::shared_ptr<const Image> get(const fs::path& file, std::vector<uint8_t>& data);
+
+        // Cached pixels of file as it is now, never decoding; null on a miss.
+        // Reads the file to check it.
+        std::shared_ptr<const Image> find(const fs::path& file);
+
+        // Record image as the pixels of file as it is now (read for its CRC)
+        void put(const fs::path& file, std::shared_ptr<const Image> image);
+
+        // Drop file, for one about to be deleted
+        void forget(const fs::path& file);
+
+        struct Stats
+        {
+            size_t hits = 0, misses = 0, entries = 0;
+            size_t bytes = 0, budget = 0;
+        };
+        Stats stats() const;
+
+    private:
+        struct Stamp
+        {
+            fs::file_time_type written;
+            uintmax_t size = 0;
+            uint32_t crc = 0;   // of the bytes; set once they are read
+            bool operator==(const Stamp& o) const { return written == o.written && size == o.size && crc == o.crc; }
+        };
+        struct Entry
+        {
+            fs::path file;
+            Stamp stamp;
+            std::shared_ptr<const Image> image;
+            size_t bytes = 0;
+        };
+
+        static bool stamp_of(const fs::path& file, Stamp& stamp);
+        static uint32_t crc_of(const std::vector<uint8_t>& data);
+
+        // Read file and its stamp; steady when it didn't change meanwhile
+        static bool read(const fs::path& file, std::vector<uint8_t>& data, Stamp& stamp, bool& steady);
+        std::shared_ptr<const Image> lookup(const fs::path& file, const Stamp& stamp);
+        void store(const fs::path& file, const Stamp& stamp, std::shared_ptr<const Image> image);
+        void drop(const fs::path& file);    // with m_mutex held
+
+        const size_t m_budget;
+        mutable std::mutex m_mutex;
+        std::list<Entry> m_lru;     // most recently used first
+        std::map<fs::path, std::list<Entry>::iterator> m_index;
+        size_t m_bytes = 0;
+        size_t m_hits = 0, m_misses = 0;
+    };
+
+    // The cache the whole process shares. Its budget is SCOUT_DECODED_CACHE_MB
+    // megabytes (default 256; 0 turns it off).
+    DecodedCache& decoded_images();
+}
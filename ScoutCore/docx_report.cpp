@@ -0,0 +1,191 @@
+#include "docx_report.h"
+#include "tinyxml2.h"
+#include <zipper/zipper.h>
+#include <zipper/unzipper.h>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <filesystem>
+#include <map>
+
+using namespace tinyxml2;
+namespace fs = std::filesystem;
+
+static const char* const DOCUMENT_XML = "word/document.xml";
+static const char* const DOCUMENT_RELS = "word/_rels/document.xml.rels";
+
+static bool isRewrittenPart(const std::string& name)
+{
+    return name == DOCUMENT_XML || name == DOCUMENT_RELS;
+}
+
+static bool loadPart(XMLDocument& xml,
+    const std::map<std::string, std::vector<unsigned char>>& parts,
+    const char* name)
+{
+    auto it = parts.find(name);
+    if (it == parts.end())
+        return false;
+    return xml.Parse(reinterpret_cast<const char*>(it->second.data()), it->second.size()) == XML_SUCCESS;
+}
+
+static bool addPart(zipper::Zipper& zip, const XMLDocument& xml, const char* name)
+{
+    XMLPrinter printer;
+    xml.Print(&printer);
+    std::stringstream part(std::string(printer.CStr(), static_cast<size_t>(printer.CStrSize() - 1)));
+    return zip.add(part, name, zipper::Zipper::Better, static_cast<unsigned long long>(printer.CStrSize() - 1));
+}
+
+// Replace {{HEADER}} / {{DESCRIPTION}} tokens
+static void replaceTokens(XMLNode* node,
+    const std::string& key,
+    const std::string& val)
+{
+    for (auto* e = node->FirstChildElement(); e; e = e->NextSiblingElement())
+    {
+        if (std::string(e->Name()) == "w:t")
+        {
+            const char* t = e->GetText();
+            if (t && key == t)
+                e->SetText(val.c_str());
+        }
+        replaceTokens(e, key, val);
+    }
+}
+
+namespace reportgen
+{
+    Template::Template(const fs::path& templateDocx)
+        : m_path(templateDocx)
+    {
+        try {
+            zipper::Unzipper unzip(templateDocx.string());
+            for (const auto& part : unzip.entries())
+            {
+                if (!part.name.empty() && part.name.back() != '/')
+                    m_order.push_back(part.name);
+            }
+            m_valid = unzip.extractMatchingToMemory(
+                [](const zipper::ZipEntry& entry) { return !entry.name.empty() && entry.name.back() != '/'; }, m_parts);
+            unzip.close();
+        }
+        catch (...) {
+            std::cerr << "Failed to read template " << templateDocx.string() << "\n";
+            m_valid = false;
+        }
+    }
+
+    bool generateDocx(const fs::path& templateDocx,
+        const fs::path& outputDocx,
+        const std::vector<Entry>& entries)
+    {
+        return generateDocx(Template(templateDocx), outputDocx, entries);
+    }
+
+    bool generateDocx(const Template& templateDocx,
+        const fs::path& outputDocx,
+        const std::vector<Entry>& entries)
+    {
+        if (!templateDocx.valid())
+            return false;
+
+        try {
+            const auto& parts = templateDocx.m_parts;
+
+            // Parse main document
+            XMLDocument doc;
+            if (!loadPart(doc, parts, DOCUMENT_XML))
+            {
+                std::cerr << "Failed to open document.xml\n";
+                return false;
+            }
+
+            XMLDocument rels;
+            if (!loadPart(rels, parts, DOCUMENT_RELS))
+            {
+                std::cerr << "Failed to open document.xml.rels\n";
+                return false;
+            }
+
+            // Grab <w:body>
+            auto* body = doc.FirstChildElement("w:document")->FirstChildElement("w:body");
+            if (!body) { std::cerr << "No <w:body>\n"; return false; }
+
+            // Save first paragraph as template block (page pattern)
+            XMLNode* templateBlock = body->FirstChild()->DeepClone(&doc);
+
+            // remove everything else
+            while (body->FirstChild())
+                body->DeleteChild(body->FirstChild());
+
+            zipper::Zipper zip(outputDocx.string());
+
+            // Copy the untouched template parts
+            for (const auto& name : templateDocx.m_order)
+            {
+                auto part = parts.find(name);
+                if (isRewrittenPart(name) || part == parts.end())
+                    continue;
+                std::stringstream content(std::string(part->second.begin(), part->second.end()));
+                zip.add(content, name, zipper::Zipper::Better, part->second.size());
+            }
+
+            auto* root = rels.FirstChildElement("Relationships");
+            int relId = 10; // start arbitrary id numbering
+            for (auto& e : entries)
+            {
+                XMLNode* page = templateBlock->DeepClone(&doc);
+
+                replaceTokens(page, "{{HEADER}}", e.header);
+                replaceTokens(page, "{{DESCRIPTION}}", e.description);
+
+                // Store image into media/ (already compressed: no deflate)
+                std::string imgName = "image" + std::to_string(relId) + e.imagePath.extension().string();
+                std::ifstream img(e.imagePath, std::ios::binary);
+                std::error_code ec;
+                auto imgSize = fs::file_size(e.imagePath, ec);
+                zip.add(img, "word/media/" + imgName, zipper::Zipper::Store,
+                    ec ? zipper::Zipper::UnknownSize : static_cast<unsigned long long>(imgSize));
+
+                // Update the rels
+                auto* newRel = rels.NewElement("Relationship");
+                std::string rId = "rId" + std::to_string(relId);
+                newRel->SetAttribute("Id", rId.c_str());
+                newRel->SetAttribute("Type",
+                    "http://schemas.openxmlformats.org/officeDocument/2006/relationships/image");
+                newRel->SetAttribute("Target", ("media/" + imgName).c_str());
+                root->InsertEndChild(newRel);
+
+                // Replace the old rId in drawing tag (assumes one image per page pattern)
+                for (auto* e2 = page->FirstChildElement(); e2; e2 = e2->NextSiblingElement())
+                {
+                    if (std::string(e2->Name()).find("a:blip") != std::string::npos)
+                        e2->SetAttribute("r:embed", rId.c_str());
+                }
+
+                body->InsertEndChild(page);
+
+                // Add a page break
+                XMLElement* br = doc.NewElement("w:p");
+                XMLElement* run = doc.NewElement("w:r");
+                XMLElement* breakTag = doc.NewElement("w:br");
+                breakTag->SetAttribute("w:type", "page");
+                run->InsertEndChild(breakTag);
+                br->InsertEndChild(run);
+                body->InsertEndChild(br);
+
+                ++relId;
+            }
+
+            addPart(zip, doc, DOCUMENT_XML);
+            addPart(zip, rels, DOCUMENT_RELS);
+            zip.close();
+            return true;
+        }
+        catch (...) {
+            std::cerr << "Failed to build " << outputDocx.string() << "\n";
+            return false;
+        }
+    }
+}
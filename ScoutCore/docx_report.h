@@ -0,0 +1,44 @@
+#pragma once
+#include <filesystem>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace reportgen
+{
+    struct Entry
+    {
+        std::string header;
+        std::string description;
+        std::filesystem::path imagePath;
+    };
+
+    // A .docx template read once and kept in memory, so repeated reports
+    // (e.g. from the service mode) skip unzipping the template every time
+    class Template
+    {
+    public:
+        explicit Template(const std::filesystem::path& templateDocx);
+
+        bool valid() const { return m_valid; }
+        const std::filesystem::path& path() const { return m_path; }
+
+    private:
+        friend bool generateDocx(const Template&, const std::filesystem::path&,
+            const std::vector<Entry>&);
+
+        std::filesystem::path m_path;
+        bool m_valid = false;
+        std::vector<std::string> m_order;   // part names in template order
+        std::map<std::string, std::vector<unsigned char>> m_parts;
+    };
+
+    bool generateDocx(const Template& templateDocx,
+        const std::filesystem::path& outputDocx,
+        const std::vector<Entry>& entries);
+
+    // rootFolder = exe_dir();  templateDocx = rootFolder/"template.docx"
+    bool generateDocx(const std::filesystem::path& templateDocx,
+        const std::filesystem::path& outputDocx,
+        const std::vector<Entry>& entries);
+}
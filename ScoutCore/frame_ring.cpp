@@ -0,0 +1,475 @@
+#include "frame_ring.h"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <new>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace scout
+{
+    static_assert(std::atomic<uint32_t>::is_always_lock_free, "slot state must be lock-free to live in shared memory");
+    static_assert(std::atomic<uint64_t>::is_always_lock_free, "sequence must be lock-free to live in shared memory");
+
+    struct alignas(64) FrameRing::Header
+    {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t slots;
+        uint32_t maxWidth;
+        uint32_t maxHeight;
+        uint32_t maxLegendPixels;
+        uint64_t slotBytes;
+        std::atomic<uint32_t> shutdown;
+        std::atomic<uint64_t> nextSequence;
+    };
+
+    static size_t round_up(size_t n, size_t to) { return (n + to - 1) / to * to; }
+
+    static size_t frame_bytes(const FrameRingConfig& c) { return static_cast<size_t>(c.maxWidth) * c.maxHeight * 4; }
+
+    static size_t slot_bytes(const FrameRingConfig& c)
+    {
+        return round_up(sizeof(FrameSlot) + 2 * frame_bytes(c) + static_cast<size_t>(c.maxLegendPixels) * 4, 64);
+    }
+
+    // Poll pred with a short spin and then growing sleeps; both sides are in
+    // different processes, so there is no cheap shared wait primitive
+    template <class Pred>
+    static bool wait_until(Pred pred, int timeoutMs, const std::atomic<uint32_t>& shutdown)
+    {
+        const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMs);
+        auto pause = std::chrono::microseconds(20);
+        for (int spins = 0;; ++spins) {
+            if (pred())
+                return true;
+            if (shutdown.load(std::memory_order_acquire))
+                return false;
+            if (timeoutMs >= 0 && std::chrono::steady_clock::now() >= deadline)
+                return false;
+
+            if (spins < 64) {
+                std::this_thread::yield();
+            }
+            else {
+                std::this_thread::sleep_for(pause);
+                pause = std::min(pause * 2, std::chrono::microseconds(1000));
+            }
+        }
+    }
+
+    bool FrameRing::map(const std::string& name, size_t bytes, bool create, std::string& error)
+    {
+#ifdef _WIN32
+        const std::wstring wname = L"Local\\scout-ring-" + fs::path(name).wstring();
+        if (create) {
+            m_mapping = CreateFileMappingW(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE,
+                static_cast<DWORD>(static_cast<unsigned long long>(bytes) >> 32),
+                static_cast<DWORD>(bytes & 0xFFFFFFFFu), wname.c_str());
+            if (m_mapping && GetLastError() == ERROR_ALREADY_EXISTS) {
+                CloseHandle(m_mapping);
+                m_mapping = nullptr;
+                error = "a ring called '" + name + "' already exists";
+                return false;
+            }
+        }
+        else {
+            m_mapping = OpenFileMappingW(FILE_MAP_ALL_ACCESS, FALSE, wname.c_str());
+        }
+        if (!m_mapping) {
+            error = "cannot " + std::string(create ? "create" : "open") + " shared memory '" + name + "'";
+            return false;
+        }
+
+        void* view = MapViewOfFile(m_mapping, FILE_MAP_ALL_ACCESS, 0, 0, bytes);
+        if (!view) {
+            error = "cannot map shared memory '" + name + "'";
+            return false;
+        }
+        if (!create) {
+            MEMORY_BASIC_INFORMATION info{};
+            VirtualQuery(view, &info, sizeof(info));
+            bytes = info.RegionSize;
+        }
+#else
+        const std::string shmName = "/scout-ring-" + name;
+        m_fd = create ? shm_open(shmName.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600)
+            : shm_open(shmName.c_str(), O_RDWR, 0);
+        if (m_fd < 0) {
+            error = create && errno == EEXIST ? "a ring called '" + name + "' already exists"
+                : "cannot " + std::string(create ? "create" : "open") + " shared memory '" + name + "'";
+            return false;
+        }
+        if (create) {
+            // Unlink from now on, even if the rest fails
+            m_owner = true;
+            m_name = shmName;
+            if (ftruncate(m_fd, static_cast<off_t>(bytes)) != 0) {
+                error = "cannot size shared memory '" + name + "'";
+                return false;
+            }
+        }
+        else {
+            struct stat st{};
+            if (fstat(m_fd, &st) != 0) {
+                error = "cannot size shared memory '" + name + "'";
+                return false;
+            }
+            bytes = static_cast<size_t>(st.st_size);
+        }
+
+        void* view = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, 0);
+        if (view == MAP_FAILED) {
+            error = "cannot map shared memory '" + name + "'";
+            return false;
+        }
+#endif
+        m_base = static_cast<uint8_t*>(view);
+        m_bytes = bytes;
+        m_header = reinterpret_cast<Header*>(m_base);
+        return true;
+    }
+
+    std::unique_ptr<FrameRing> FrameRing::create(const std::string& name,
+        const FrameRingConfig& config, std::string& error)
+    {
+        if (name.empty() || config.slots == 0 || config.maxWidth == 0 || config.maxHeight == 0) {
+            error = "invalid ring name or size";
+            return nullptr;
+        }
+
+        std::unique_ptr<FrameRing> ring(new FrameRing());
+        ring->m_config = config;
+        ring->m_slotBytes = slot_bytes(config);
+        if (!ring->map(name, sizeof(Header) + config.slots * ring->m_slotBytes, true, error))
+            return nullptr;
+        ring->m_owner = true;
+
+        Header* h = new (ring->m_base) Header();
+        h->version = kFrameRingVersion;
+        h->slots = config.slots;
+        h->maxWidth = config.maxWidth;
+        h->maxHeight = config.maxHeight;
+        h->maxLegendPixels = config.maxLegendPixels;
+        h->slotBytes = ring->m_slotBytes;
+        h->shutdown.store(0, std::memory_order_relaxed);
+        h->nextSequence.store(0, std::memory_order_relaxed);
+        for (uint32_t i = 0; i < config.slots; ++i) {
+            FrameSlot* s = new (ring->m_base + sizeof(Header) + i * ring->m_slotBytes) FrameSlot();
+            s->state.store(static_cast<uint32_t>(SlotState::Free), std::memory_order_relaxed);
+        }
+
+        // Producers check the magic last, so publish it after everything else
+        std::atomic_thread_fence(std::memory_order_release);
+        h->magic = kFrameRingMagic;
+        return ring;
+    }
+
+    std::unique_ptr<FrameRing> FrameRing::open(const std::string& name, std::string& error)
+    {
+        std::unique_ptr<FrameRing> ring(new FrameRing());
+        if (!ring->map(name, 0, false, error))
+            return nullptr;
+
+        const Header* h = ring->m_header;
+        if (ring->m_bytes < sizeof(Header) || h->magic != kFrameRingMagic) {
+            error = "'" + name + "' is not a frame ring";
+            return nullptr;
+        }
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (h->version != kFrameRingVersion) {
+            error = "frame ring '" + name + "' has version " + std::to_string(h->version)
+                + ", expected " + std::to_string(kFrameRingVersion);
+            return nullptr;
+        }
+
+        ring->m_config.slots = h->slots;
+        ring->m_config.maxWidth = h->maxWidth;
+        ring->m_config.maxHeight = h->maxHeight;
+        ring->m_config.maxLegendPixels = h->maxLegendPixels;
+        ring->m_slotBytes = static_cast<size_t>(h->slotBytes);
+        if (ring->m_slotBytes != slot_bytes(ring->m_config)
+            || ring->m_bytes < sizeof(Header) + h->slots * ring->m_slotBytes) {
+            error = "frame ring '" + name + "' is truncated";
+            return nullptr;
+        }
+        return ring;
+    }
+
+    FrameRing::~FrameRing()
+    {
+#ifdef _WIN32
+        if (m_base)
+            UnmapViewOfFile(m_base);
+        if (m_mapping)
+            CloseHandle(m_mapping);
+#else
+        if (m_base)
+            munmap(m_base, m_bytes);
+        if (m_fd >= 0)
+            close(m_fd);
+        if (m_owner && !m_name.empty())
+            shm_unlink(m_name.c_str());
+#endif
+    }
+
+    FrameSlot& FrameRing::slot(uint32_t index) const
+    {
+        return *reinterpret_cast<FrameSlot*>(m_base + sizeof(Header) + index * m_slotBytes);
+    }
+
+    // Slot layout: FrameSlot | input frame | output frame | legend
+    ImageView FrameRing::input(uint32_t index) const
+    {
+        return input(index, slot(index));
+    }
+
+    ImageView FrameRing::output(uint32_t index) const
+    {
+        return output(index, slot(index));
+    }
+
+    ImageView FrameRing::legend(uint32_t index) const
+    {
+        return legend(index, slot(index));
+    }
+
+    ImageView FrameRing::input(uint32_t index, const FrameSlot& s) const
+    {
+        uint8_t* p = m_base + sizeof(Header) + index * m_slotBytes + sizeof(FrameSlot);
+        return { p, s.width, s.height, static_cast<size_t>(s.width) * 4 };
+    }
+
+    ImageView FrameRing::output(uint32_t index, const FrameSlot& s) const
+    {
+        uint8_t* p = m_base + sizeof(Header) + index * m_slotBytes + sizeof(FrameSlot) + frame_bytes(m_config);
+        return { p, s.outWidth, s.outHeight, static_cast<size_t>(s.outWidth) * 4 };
+    }
+
+    size_t FrameRing::output_capacity() const
+    {
+        return frame_bytes(m_config);
+    }
+
+    ImageView FrameRing::legend(uint32_t index, const FrameSlot& s) const
+    {
+        uint8_t* p = m_base + sizeof(Header) + index * m_slotBytes + sizeof(FrameSlot) + 2 * frame_bytes(m_config);
+        return { p, s.legendWidth, s.legendHeight, static_cast<size_t>(s.legendWidth) * 4 };
+    }
+
+    int FrameRing::acquire(int timeoutMs)
+    {
+        int found = -1;
+        wait_until([&] {
+            for (uint32_t i = 0; i < m_config.slots; ++i) {
+                uint32_t expected = static_cast<uint32_t>(SlotState::Free);
+                if (slot(i).state.compare_exchange_strong(expected, static_cast<uint32_t>(SlotState::Filling),
+                    std::memory_order_acquire)) {
+                    found = static_cast<int>(i);
+                    return true;
+                }
+            }
+            return false;
+        }, timeoutMs, m_header->shutdown);
+
+        if (found >= 0) {
+            FrameSlot& s = slot(found);
+            s.status = FrameStatus::Pending;
+            s.legendWidth = s.legendHeight = 0;
+            s.outWidth = s.outHeight = 0;
+        }
+        return found;
+    }
+
+    void FrameRing::set_options(FrameSlot& slot, const Options& options)
+    {
+        slot.flags = (options.modulate ? kFrameModulate : 0u)
+            | (options.legend ? kFrameLegend : 0u)
+            | (options.cropLegendFirst ? kFrameCropLegend : 0u)
+            | (options.legendSource == LegendSource::HueScale ? kFrameHueScale : 0u)
+            | (options.legendSource == LegendSource::FileOrHueScale ? kFrameHueScaleFallback : 0u)
+            | (options.placement == LegendPlacement::Extend ? kFrameExtendCanvas : 0u);
+        slot.brightness = options.mp.brightness;
+        slot.saturation = options.mp.saturation;
+        slot.hue = options.mp.hue;
+        slot.legendPercent = options.legendPercent;
+        slot.edge = static_cast<uint32_t>(options.edge);
+    }
+
+    Options frame_options(const FrameSlot& slot)
+    {
+        Options o;
+        o.modulate = (slot.flags & kFrameModulate) != 0;
+        o.legend = (slot.flags & kFrameLegend) != 0;
+        o.cropLegendFirst = (slot.flags & kFrameCropLegend) != 0;
+        o.legendSource = (slot.flags & kFrameHueScale) ? LegendSource::HueScale
+            : (slot.flags & kFrameHueScaleFallback) ? LegendSource::FileOrHueScale : LegendSource::File;
+        o.placement = (slot.flags & kFrameExtendCanvas) ? LegendPlacement::Extend : LegendPlacement::Overlay;
+        o.mp = { slot.brightness, slot.saturation, slot.hue };
+        o.legendPercent = slot.legendPercent;
+        o.edge = static_cast<Edge>(slot.edge & 3);
+        return o;
+    }
+
+    void FrameRing::submit(uint32_t index)
+    {
+        FrameSlot& s = slot(index);
+        s.sequence = m_header->nextSequence.fetch_add(1, std::memory_order_relaxed);
+        s.state.store(static_cast<uint32_t>(SlotState::Ready), std::memory_order_release);
+    }
+
+    bool FrameRing::wait_done(uint32_t index, int timeoutMs) const
+    {
+        const FrameSlot& s = slot(index);
+        return wait_until([&] {
+            return s.state.load(std::memory_order_acquire) == static_cast<uint32_t>(SlotState::Done);
+        }, timeoutMs, m_header->shutdown);
+    }
+
+    void FrameRing::release(uint32_t index)
+    {
+        slot(index).state.store(static_cast<uint32_t>(SlotState::Free), std::memory_order_release);
+    }
+
+    int FrameRing::take(int timeoutMs)
+    {
+        int found = -1;
+        wait_until([&] {
+            // Oldest ready slot first, so frames finish roughly in order
+            for (;;) {
+                int oldest = -1;
+                for (uint32_t i = 0; i < m_config.slots; ++i) {
+                    const FrameSlot& s = slot(i);
+                    if (s.state.load(std::memory_order_acquire) == static_cast<uint32_t>(SlotState::Ready)
+                        && (oldest < 0 || s.sequence < slot(oldest).sequence))
+                        oldest = static_cast<int>(i);
+                }
+                if (oldest < 0)
+                    return false;
+
+                uint32_t expected = static_cast<uint32_t>(SlotState::Ready);
+                if (slot(oldest).state.compare_exchange_strong(expected, static_cast<uint32_t>(SlotState::Busy),
+                    std::memory_order_acquire)) {
+                    found = oldest;
+                    return true;
+                }
+                // Another worker got it; look again
+            }
+        }, timeoutMs, m_header->shutdown);
+        return found;
+    }
+
+    void FrameRing::complete(uint32_t index, FrameStatus status)
+    {
+        FrameSlot& s = slot(index);
+        s.status = status;
+        s.state.store(static_cast<uint32_t>(SlotState::Done), std::memory_order_release);
+    }
+
+    void FrameRing::shutdown()
+    {
+        m_header->shutdown.store(1, std::memory_order_release);
+    }
+
+    bool FrameRing::stopping() const
+    {
+        return m_header->shutdown.load(std::memory_order_acquire) != 0;
+    }
+
+    size_t serve_frame_ring(FrameRing& ring, size_t threads,
+        const std::function<void(uint32_t, FrameStatus)>& onFrame)
+    {
+        if (threads == 0)
+            threads = std::max(1u, std::thread::hardware_concurrency());
+        threads = std::min<size_t>(threads, ring.config().slots);
+
+        std::atomic<size_t> processed{ 0 };
+        auto worker = [&] {
+            const FrameRingConfig& c = ring.config();
+            while (!ring.stopping()) {
+                const int index = ring.take(100);
+                if (index < 0)
+                    continue;
+
+                // Everything below works from one copy of the header: the
+                // producer can still write to the slot, and sizes read again
+                // after the checks could reach past the mapping
+                FrameSlot& shared = ring.slot(index);
+                FrameSlot s{};
+                s.status = shared.status;
+                s.sequence = shared.sequence;
+                s.width = shared.width;
+                s.height = shared.height;
+                s.legendWidth = shared.legendWidth;
+                s.legendHeight = shared.legendHeight;
+                s.flags = shared.flags;
+                s.legendPercent = shared.legendPercent;
+                s.edge = shared.edge;
+                s.brightness = shared.brightness;
+                s.saturation = shared.saturation;
+                s.hue = shared.hue;
+                FrameStatus status = FrameStatus::Ok;
+
+                // The producer's values get the same bounds as options a user
+                // entered: a huge legend scale would otherwise size the
+                // scaled legend without limit
+                const Options options = frame_options(s);
+                if (s.width <= 0 || s.height <= 0
+                    || static_cast<uint32_t>(s.width) > c.maxWidth || static_cast<uint32_t>(s.height) > c.maxHeight
+                    || s.legendWidth < 0 || s.legendHeight < 0
+                    || static_cast<uint64_t>(s.legendWidth) * s.legendHeight > c.maxLegendPixels
+                    || !options_in_range(options)) {
+                    status = FrameStatus::BadSize;
+                }
+                else {
+                    // The output size is only known once the legend is
+                    // prepared; it goes in the slot for the producer
+                    const ImageView legend = ring.legend(index, s);
+                    auto allocate = [&](int w, int h) {
+                        if (w <= 0 || h <= 0 || static_cast<size_t>(w) * h * 4 > ring.output_capacity())
+                            return ImageView{};
+                        s.outWidth = shared.outWidth = w;
+                        s.outHeight = shared.outHeight = h;
+                        return ring.output(index, s);
+                    };
+                    try {
+                        if (process_pixels(ring.input(index, s), legend.width > 0 ? &legend : nullptr,
+                            options, allocate))
+                            processed.fetch_add(1, std::memory_order_relaxed);
+                        else
+                            status = FrameStatus::BadSize;
+                    }
+                    catch (...) {
+                        // A worker thread must not end the process
+                        status = FrameStatus::BadSize;
+                    }
+                }
+
+                ring.complete(index, status);
+                if (onFrame)
+                    onFrame(static_cast<uint32_t>(index), status);
+            }
+        };
+
+        std::vector<std::thread> pool;
+        for (size_t i = 1; i < threads; ++i)
+            pool.emplace_back(worker);
+        worker();
+        for (auto& t : pool)
+            t.join();
+        return processed.load();
+    }
+}
@@ -0,0 +1,140 @@
+#pragma once
+#include "pixel_ops.h"
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+
+// Ring of frame slots in named shared memory (POSIX shm / Windows file
+// mapping). A producer in another process writes raw RGBA frames straight
+// into a slot, the tool processes them where they lie and writes the result
+// into the same slot's output area, so no frame is copied or encoded.
+//
+// Slot life cycle:   Free -> Filling -> Ready -> Busy -> Done -> Free
+//                    (producer)         (tool)           (producer)
+//
+// The tool creates the ring (--ring) and owns its lifetime; producers open
+// it by name.
+namespace scout
+{
+    constexpr uint32_t kFrameRingMagic = 0x47525353;  // "SSRG"
+    constexpr uint32_t kFrameRingVersion = 2;
+
+    enum class SlotState : uint32_t { Free, Filling, Ready, Busy, Done };
+
+    // Per-frame options, the shared-memory form of Options
+    enum FrameFlags : uint32_t
+    {
+        kFrameModulate = 1,
+        kFrameLegend = 2,
+        kFrameCropLegend = 4,
+        kFrameHueScale = 8,          // draw the hue scale instead of the legend
+        kFrameHueScaleFallback = 16, // draw it only when no legend is given
+        kFrameExtendCanvas = 32,     // LegendPlacement::Extend
+    };
+
+    // BadSize: the frame or legend is larger than the ring allows, the
+    // extended output doesn't fit the slot's output area, or the options are
+    // out of range (see options_in_range)
+    enum class FrameStatus : uint32_t { Pending, Ok, BadSize };
+
+    struct FrameRingConfig
+    {
+        uint32_t slots = 4;
+        uint32_t maxWidth = 2048;
+        uint32_t maxHeight = 2048;
+        uint32_t maxLegendPixels = 256 * 256;
+    };
+
+    // Lives at the start of each slot; everything but state is written by
+    // one side before it hands the slot over
+    struct alignas(64) FrameSlot
+    {
+        std::atomic<uint32_t> state;
+        FrameStatus status;
+        uint64_t sequence;
+        int32_t width, height;
+        int32_t legendWidth, legendHeight;   // 0 when there is no legend
+        uint32_t flags;
+        int32_t legendPercent;
+        uint32_t edge;                       // Edge
+        double brightness, saturation, hue;
+        int32_t outWidth, outHeight;         // set by the tool; larger than the
+                                             // frame with kFrameExtendCanvas
+    };
+
+    class FrameRing
+    {
+    public:
+        // Create (and own) a ring, or open one created by another process.
+        // Both return nullptr with a message in error on failure.
+        static std::unique_ptr<FrameRing> create(const std::string& name,
+            const FrameRingConfig& config, std::string& error);
+        static std::unique_ptr<FrameRing> open(const std::string& name, std::string& error);
+        ~FrameRing();
+
+        FrameRing(const FrameRing&) = delete;
+        FrameRing& operator=(const FrameRing&) = delete;
+
+        const FrameRingConfig& config() const { return m_config; }
+        FrameSlot& slot(uint32_t index) const;
+
+        // Pixel areas of a slot, sized from the slot's width/height,
+        // legendWidth/legendHeight and outWidth/outHeight fields, or from
+        // those of header: a copy taken (and checked) once, which the other
+        // process can no longer change
+        ImageView input(uint32_t index) const;
+        ImageView legend(uint32_t index) const;
+        ImageView output(uint32_t index) const;
+        ImageView input(uint32_t index, const FrameSlot& header) const;
+        ImageView legend(uint32_t index, const FrameSlot& header) const;
+        ImageView output(uint32_t index, const FrameSlot& header) const;
+        size_t output_capacity() const;   // bytes
+
+        // --- Producer side ---------------------------------------------------
+        // Claim a free slot (-1 on timeout or shutdown); fill its size,
+        // options and pixels, then submit it
+        int acquire(int timeoutMs);
+        static void set_options(FrameSlot& slot, const Options& options);
+        void submit(uint32_t index);
+        // Wait for the tool to finish the slot; read output(), then release
+        bool wait_done(uint32_t index, int timeoutMs) const;
+        void release(uint32_t index);
+
+        // --- Tool side -------------------------------------------------------
+        // Take the oldest ready slot (-1 on timeout or shutdown)
+        int take(int timeoutMs);
+        void complete(uint32_t index, FrameStatus status);
+
+        void shutdown();
+        bool stopping() const;
+
+    private:
+        struct Header;
+        FrameRing() = default;
+        bool map(const std::string& name, size_t bytes, bool create, std::string& error);
+
+        FrameRingConfig m_config;
+        Header* m_header = nullptr;
+        uint8_t* m_base = nullptr;
+        size_t m_bytes = 0;
+        size_t m_slotBytes = 0;
+        bool m_owner = false;
+        std::string m_name;
+#ifdef _WIN32
+        void* m_mapping = nullptr;
+#else
+        int m_fd = -1;
+#endif
+    };
+
+    // The options a producer set on a slot
+    Options frame_options(const FrameSlot& slot);
+
+    // Serve the ring until shutdown() with the given number of workers.
+    // onFrame is called from the workers after every frame. Returns the
+    // number of frames processed.
+    size_t serve_frame_ring(FrameRing& ring, size_t threads,
+        const std::function<void(uint32_t, FrameStatus)>& onFrame = {});
+}
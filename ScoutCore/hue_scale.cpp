@@ -0,0 +1,190 @@
+#include "hue_scale.h"
+#include "text_stamp.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+namespace scout
+{
+    constexpr int kFontHeight = 7;   // labels are drawn at a multiple of it
+
+    // Panel behind the bar and labels
+    constexpr uint8_t kPanelAlpha = 150;
+
+    struct Layout
+    {
+        bool vertical;
+        int length, thickness, scale, tick, margin, inset;
+        int labelWidth, labelHeight;
+        int width, height;
+        std::vector<std::string> labels;
+    };
+
+    static Layout layout_for(int width, int height, Edge edge, const HueScaleStyle& style)
+    {
+        Layout l;
+        l.vertical = edge == Edge::Left || edge == Edge::Right;
+        const int side = l.vertical ? height : width;
+        l.length = std::clamp(side * style.lengthPercent / 100, 1, side);
+        l.scale = std::max(1, l.length / 160);
+        l.thickness = std::max(4, l.length / 16);
+        l.tick = 3 * l.scale;
+        l.margin = 2 * l.scale;
+
+        const GlyphAtlas& font = GlyphAtlas::get(kFontHeight * l.scale);
+        const int ticks = std::max(2, style.ticks);
+        l.labelWidth = 1;
+        for (int i = 0; i < ticks; ++i) {
+            const double v = style.minValue + (style.maxValue - style.minValue) * i / (ticks - 1);
+            char buf[32];
+            std::snprintf(buf, sizeof(buf), "%.6g", v);
+            l.labels.emplace_back(buf);
+            l.labelWidth = std::max(l.labelWidth, font.text_width(l.labels.back()));
+        }
+        l.labelHeight = font.height();
+
+        // Keep the end labels on the panel
+        l.inset = (l.vertical ? l.labelHeight : l.labelWidth) / 2 + l.margin;
+
+        const int across = 3 * l.margin + l.thickness + l.tick + (l.vertical ? l.labelWidth : l.labelHeight);
+        l.width = std::min(l.vertical ? across : l.length, width);
+        l.height = std::min(l.vertical ? l.length : across, height);
+        return l;
+    }
+
+    void hue_scale_size(int width, int height, Edge edge, const HueScaleStyle& style,
+        int& scaleWidth, int& scaleHeight)
+    {
+        const Layout l = layout_for(width, height, edge, style);
+        scaleWidth = l.width;
+        scaleHeight = l.height;
+    }
+
+    static void put(const ImageView& v, int x, int y, const uint8_t* rgba)
+    {
+        if (x >= 0 && y >= 0 && x < v.width && y < v.height)
+            std::memcpy(v.row(y) + static_cast<size_t>(x) * 4, rgba, 4);
+    }
+
+    // Everything is drawn with the bar on the image edge and the labels
+    // facing inwards
+    static void draw(const ImageView& v, const Layout& l, Edge edge, const HueScaleStyle& style,
+        const ModulateParams& mp)
+    {
+        // Panel: black over whatever is below
+        for (int y = 0; y < v.height; ++y) {
+            uint8_t* p = v.row(y);
+            for (int x = 0; x < v.width; ++x, p += 4) {
+                const unsigned da = p[3] * (255u - kPanelAlpha) / 255u;
+                const unsigned oa = kPanelAlpha + da;
+                for (int k = 0; k < 3; ++k)
+                    p[k] = static_cast<uint8_t>(p[k] * da / oa);
+                p[3] = static_cast<uint8_t>(oa);
+            }
+        }
+
+        // Gradient colours along the bar, put through the same modulate as
+        // the image so the scale matches it
+        const int barLength = std::max(1, l.length - 2 * l.inset);
+        Image ramp(barLength, 1);
+        for (int i = 0; i < barLength; ++i) {
+            const double t = barLength > 1 ? static_cast<double>(i) / (barLength - 1) : 0.0;
+            double h = (style.hueFrom + (style.hueTo - style.hueFrom) * t) / 60.0;
+            h -= 6.0 * std::floor(h / 6.0);
+            const double x = 1.0 - std::fabs(std::fmod(h, 2.0) - 1.0);
+            double rgb[3] = { 0, 0, 0 };
+            switch (static_cast<int>(h)) {
+            case 0:  rgb[0] = 1; rgb[1] = x; break;
+            case 1:  rgb[0] = x; rgb[1] = 1; break;
+            case 2:  rgb[1] = 1; rgb[2] = x; break;
+            case 3:  rgb[1] = x; rgb[2] = 1; break;
+            case 4:  rgb[0] = x; rgb[2] = 1; break;
+            default: rgb[0] = 1; rgb[2] = x; break;
+            }
+            uint8_t* p = ramp.pixels.data() + static_cast<size_t>(i) * 4;
+            for (int k = 0; k < 3; ++k)
+                p[k] = static_cast<uint8_t>(std::lround(rgb[k] * 255.0));
+            p[3] = 255;
+        }
+        modulate(ramp.view(), mp);
+
+        // Across the bar: bar, ticks, labels from the image edge inwards
+        const bool flip = edge == Edge::Right || edge == Edge::Bottom;
+        const int across = l.vertical ? v.width : v.height;
+        auto place = [&](int offset, int size) { return flip ? across - offset - size : offset; };
+        const int barAt = place(l.margin, l.thickness);
+        const int tickAt = place(l.margin + l.thickness, l.tick);
+        const int labelAt = place(2 * l.margin + l.thickness + l.tick, l.vertical ? l.labelWidth : l.labelHeight);
+
+        const uint8_t* colours = ramp.pixels.data();
+        if (l.vertical) {
+            // One colour per row
+            for (int i = 0; i < barLength && l.inset + i < v.height; ++i) {
+                uint8_t* p = v.row(l.inset + i) + static_cast<size_t>(std::max(0, barAt)) * 4;
+                const int n = std::min(l.thickness, v.width - std::max(0, barAt));
+                for (int x = 0; x < n; ++x)
+                    std::memcpy(p + static_cast<size_t>(x) * 4, colours + static_cast<size_t>(i) * 4, 4);
+            }
+        }
+        else {
+            // The ramp is a whole row
+            const int n = std::max(0, std::min(barLength, v.width - l.inset));
+            for (int y = std::max(0, barAt); y < std::min(v.height, barAt + l.thickness); ++y)
+                std::memcpy(v.row(y) + static_cast<size_t>(l.inset) * 4, colours, static_cast<size_t>(n) * 4);
+        }
+
+        const uint8_t white[4] = { 255, 255, 255, 255 };
+        const GlyphAtlas& font = GlyphAtlas::get(l.labelHeight);
+        const int count = static_cast<int>(l.labels.size());
+        for (int i = 0; i < count; ++i) {
+            const int along = l.inset + (barLength - 1) * i / (count - 1);
+
+            for (int a = 0; a < l.tick; ++a)
+                for (int b = 0; b < l.scale; ++b) {
+                    const int off = along - l.scale / 2 + b;
+                    if (l.vertical) put(v, tickAt + a, off, white);
+                    else put(v, off, tickAt + a, white);
+                }
+
+            // Label centred on its tick; right-aligned next to a right-hand bar
+            const std::string& text = l.labels[i];
+            const int textW = font.text_width(text);
+            if (l.vertical)
+                font.draw(v, labelAt + (edge == Edge::Right ? l.labelWidth - textW : 0),
+                    along - l.labelHeight / 2, text, white);
+            else
+                font.draw(v, along - textW / 2, labelAt, text, white);
+        }
+    }
+
+    Image render_hue_scale(int width, int height, Edge edge, const HueScaleStyle& style,
+        const ModulateParams& mp, const uint8_t* background)
+    {
+        const Layout l = layout_for(width, height, edge, style);
+        Image out(l.width, l.height);
+        if (background)
+            for (size_t i = 0; i < out.pixels.size(); i += 4)
+                std::memcpy(out.pixels.data() + i, background, 4);
+        draw(out.view(), l, edge, style, mp);
+        return out;
+    }
+
+    void draw_hue_scale(const ImageView& target, int width, int height, Edge edge,
+        const HueScaleStyle& style, const ModulateParams& mp)
+    {
+        draw(target, layout_for(width, height, edge, style), edge, style, mp);
+    }
+
+    void stamp_hue_scale(const ImageView& image, Edge edge, const HueScaleStyle& style,
+        const ModulateParams& mp)
+    {
+        const Layout l = layout_for(image.width, image.height, edge, style);
+        int x, y;
+        edge_origin(image.width, image.height, l.width, l.height, edge, x, y);
+
+        const ImageView target{ image.row(y) + static_cast<size_t>(x) * 4, l.width, l.height, image.stride };
+        draw(target, l, edge, style, mp);
+    }
+}
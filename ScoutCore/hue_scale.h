@@ -0,0 +1,27 @@
+#pragma once
+#include "pixel_ops.h"
+
+// The hue indicator drawn by the tool instead of read from a *_Legend file:
+// a gradient bar along one edge with tick marks and value labels, sized for
+// the image it goes on. Drawing it costs far less than trimming, modulating
+// and resizing a legend image, and needs no file next to every source.
+namespace scout
+{
+    // Size of the scale drawn for a width x height image
+    void hue_scale_size(int width, int height, Edge edge, const HueScaleStyle& style,
+        int& scaleWidth, int& scaleHeight);
+
+    // The scale for a width x height image on its own canvas, transparent
+    // unless a background colour is given
+    Image render_hue_scale(int width, int height, Edge edge, const HueScaleStyle& style,
+        const ModulateParams& mp, const uint8_t* background = nullptr);
+
+    // Draw the scale for a width x height image into target, which has the
+    // size hue_scale_size gives
+    void draw_hue_scale(const ImageView& target, int width, int height, Edge edge,
+        const HueScaleStyle& style, const ModulateParams& mp);
+
+    // Draw the scale straight onto image at edge
+    void stamp_hue_scale(const ImageView& image, Edge edge, const HueScaleStyle& style,
+        const ModulateParams& mp);
+}
@@ -0,0 +1,57 @@
+#include "modulate_fixed.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+
+namespace scout
+{
+    static int64_t div_round(int64_t n, int64_t d)
+    {
+        return n >= 0 ? (n + d / 2) / d : -((-n + d / 2) / d);
+    }
+
+    // Each table entry is worked out from the integer scales alone, so the
+    // tables (and with them every output byte) are the same everywhere
+    ModulateTables modulate_tables(const ModulateParams& mp)
+    {
+        constexpr int64_t kFull = 255 * ModulateTables::kOne;
+        const int64_t light = std::llround(std::clamp(mp.brightness, 0.0, 1e5) / 100.0 * 1048576.0);
+        const int64_t sat = std::llround(std::clamp(mp.saturation, 0.0, 1e5) / 100.0 * 1048576.0);
+
+        ModulateTables t;
+        int64_t maxLight = 0, maxChroma = 0;
+        for (int l2 = 0; l2 <= 510; ++l2) {
+            // l2 / 510 scaled by light, in 1/4096 of a sample
+            const int64_t l = (l2 * light + 256) >> 9;
+            t.light[l2] = static_cast<int32_t>(l);
+
+            // Chroma is s * (1 - |2l - 1|) with s = c / (1 - |2l - 1|) of
+            // the input, so c cancels out to one factor per lightness
+            const int64_t room = 2 * l <= kFull ? 2 * l : 2 * kFull - 2 * l;
+            const int64_t was = l2 <= 255 ? l2 : 510 - l2;
+            t.chroma[l2] = was ? div_round(room * sat, was * ModulateTables::kOne) : 0;
+
+            // max - min is at most was, which bounds the chroma of a pixel
+            maxLight = std::max(maxLight, l);
+            maxChroma = std::max(maxChroma, (std::abs(t.chroma[l2]) * was >> 8) + 1);
+        }
+
+        // With both under 2^29, lightness +- chroma can't leave an int32
+        t.fits32 = maxLight < (int64_t(1) << 29) && maxChroma < (int64_t(1) << 29);
+        for (int l2 = 0; l2 <= 510; ++l2) {
+            t.fits32 = t.fits32 && std::abs(t.chroma[l2]) <= INT32_MAX;
+            t.chroma32[l2] = static_cast<int32_t>(t.chroma[l2]);     // only read when fits32
+        }
+
+        t.recip[0] = 0;
+        for (uint32_t c = 1; c < 256; ++c)
+            t.recip[c] = ((1u << 24) + c / 2) / c;
+
+        int64_t shift = std::llround(std::fmod(mp.hue - 100.0, 200.0) * (ModulateTables::kTurn / 200.0));
+        if (shift < 0) shift += ModulateTables::kTurn;
+        if (shift >= ModulateTables::kTurn) shift -= ModulateTables::kTurn;
+        t.hueShift = static_cast<int32_t>(shift);
+        return t;
+    }
+}
@@ -0,0 +1,188 @@
+#include "output_cache.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <random>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+// Minimal SHA-256 (FIPS 180-4), enough for hashing sources and cache keys
+class Sha256
+{
+public:
+    void update(const unsigned char* data, size_t size)
+    {
+        m_length += size;
+        while (size > 0)
+        {
+            size_t n = std::min(size, sizeof(m_block) - m_used);
+            std::memcpy(m_block + m_used, data, n);
+            m_used += n;
+            data += n;
+            size -= n;
+            if (m_used == sizeof(m_block))
+            {
+                transform(m_block);
+                m_used = 0;
+            }
+        }
+    }
+
+    std::string hex()
+    {
+        const uint64_t bits = m_length * 8;
+        const unsigned char pad = 0x80;
+        const unsigned char zero = 0x00;
+        update(&pad, 1);
+        while (m_used != 56)
+            update(&zero, 1);
+
+        unsigned char length[8];
+        for (int i = 0; i < 8; ++i)
+            length[i] = static_cast<unsigned char>(bits >> (56 - 8 * i));
+        update(length, 8);
+
+        static const char* const digits = "0123456789abcdef";
+        std::string out;
+        for (uint32_t h : m_state)
+            for (int shift = 28; shift >= 0; shift -= 4)
+                out += digits[(h >> shift) & 0xf];
+        return out;
+    }
+
+private:
+    static uint32_t rotr(uint32_t x, int n) { return (x >> n) | (x << (32 - n)); }
+
+    void transform(const unsigned char* block)
+    {
+        static const uint32_t k[64] = {
+            0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+            0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+            0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+            0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+            0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+            0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+            0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+            0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2 };
+
+        uint32_t w[64];
+        for (int i = 0; i < 16; ++i)
+            w[i] = (uint32_t(block[4 * i]) << 24) | (uint32_t(block[4 * i + 1]) << 16) |
+                (uint32_t(block[4 * i + 2]) << 8) | uint32_t(block[4 * i + 3]);
+        for (int i = 16; i < 64; ++i)
+        {
+            uint32_t s0 = rotr(w[i - 15], 7) ^ rotr(w[i - 15], 18) ^ (w[i - 15] >> 3);
+            uint32_t s1 = rotr(w[i - 2], 17) ^ rotr(w[i - 2], 19) ^ (w[i - 2] >> 10);
+            w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+        }
+
+        uint32_t a = m_state[0], b = m_state[1], c = m_state[2], d = m_state[3];
+        uint32_t e = m_state[4], f = m_state[5], g = m_state[6], h = m_state[7];
+        for (int i = 0; i < 64; ++i)
+        {
+            uint32_t t1 = h + (rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25)) + ((e & f) ^ (~e & g)) + k[i] + w[i];
+            uint32_t t2 = (rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+            h = g; g = f; f = e; e = d + t1;
+            d = c; c = b; b = a; a = t1 + t2;
+        }
+
+        m_state[0] += a; m_state[1] += b; m_state[2] += c; m_state[3] += d;
+        m_state[4] += e; m_state[5] += f; m_state[6] += g; m_state[7] += h;
+    }
+
+    uint32_t m_state[8] = { 0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+                            0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19 };
+    unsigned char m_block[64] = {};
+    size_t m_used = 0;
+    uint64_t m_length = 0;
+};
+
+namespace outputcache
+{
+    std::string hashFile(const fs::path& file)
+    {
+        std::ifstream in(file, std::ios::binary);
+        if (!in)
+            return {};
+
+        Sha256 sha;
+        std::vector<char> buffer(1 << 20);
+        while (in)
+        {
+            in.read(buffer.data(), buffer.size());
+            sha.update(reinterpret_cast<const unsigned char*>(buffer.data()), static_cast<size_t>(in.gcount()));
+        }
+        if (in.bad())
+            return {};
+        return sha.hex();
+    }
+
+    std::string hashString(const std::string& text)
+    {
+        Sha256 sha;
+        sha.update(reinterpret_cast<const unsigned char*>(text.data()), text.size());
+        return sha.hex();
+    }
+
+    Cache::Cache(const fs::path& dir)
+        : m_dir(dir)
+    {
+        std::error_code ec;
+        fs::create_directories(m_dir, ec);
+    }
+
+    fs::path Cache::entryPath(const std::string& key) const
+    {
+        return m_dir / key.substr(0, 2) / (key + ".png");
+    }
+
+    bool Cache::fetch(const std::string& key, const fs::path& dest) const
+    {
+        if (!enabled() || key.empty())
+            return false;
+
+        const fs::path entry = entryPath(key);
+        std::error_code ec;
+        if (!fs::is_regular_file(entry, ec))
+            return false;
+
+        fs::remove(dest, ec);
+
+        // Hardlinks only work on the same volume; a NAS cache falls back to a copy
+        fs::create_hard_link(entry, dest, ec);
+        if (!ec)
+            return true;
+
+        ec.clear();
+        return fs::copy_file(entry, dest, fs::copy_options::overwrite_existing, ec) && !ec;
+    }
+
+    void Cache::store(const std::string& key, const fs::path& src) const
+    {
+        if (!enabled() || key.empty())
+            return;
+
+        const fs::path entry = entryPath(key);
+        std::error_code ec;
+        if (fs::exists(entry, ec))
+            return;
+
+        fs::create_directories(entry.parent_path(), ec);
+
+        // Copy under a unique temporary name and rename into place, so other
+        // machines never see a partially written entry
+        std::random_device rd;
+        const fs::path tmp = entry.parent_path() / (key + "." + std::to_string(rd()) + ".tmp");
+        if (!fs::copy_file(src, tmp, ec) || ec)
+        {
+            fs::remove(tmp, ec);
+            return;
+        }
+
+        fs::rename(tmp, entry, ec);
+        if (ec)
+            fs::remove(tmp, ec);
+    }
+}
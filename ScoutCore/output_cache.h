@@ -0,0 +1,37 @@
+#pragma once
+#include <filesystem>
+#include <string>
+
+namespace outputcache
+{
+    // Hex SHA-256 of a file's contents, or an empty string if it can't be read
+    std::string hashFile(const std::filesystem::path& file);
+
+    // Hex SHA-256 of a string (used to turn a key description into a file name)
+    std::string hashString(const std::string& text);
+
+    // Content-addressed store of finished outputs, shared between runs and
+    // machines. Entries are <dir>/<first 2 hex>/<key>.png and are only ever
+    // added, never modified, so a directory on a NAS can be used concurrently.
+    class Cache
+    {
+    public:
+        Cache() = default;
+        explicit Cache(const std::filesystem::path& dir);
+
+        bool enabled() const { return !m_dir.empty(); }
+        const std::filesystem::path& dir() const { return m_dir; }
+
+        // Put the cached output for key at dest (hardlink when possible,
+        // copy otherwise). Returns false on a miss.
+        bool fetch(const std::string& key, const std::filesystem::path& dest) const;
+
+        // Add a finished output under key; an existing entry is kept.
+        void store(const std::string& key, const std::filesystem::path& src) const;
+
+    private:
+        std::filesystem::path entryPath(const std::string& key) const;
+
+        std::filesystem::path m_dir;
+    };
+}
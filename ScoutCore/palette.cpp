@@ -0,0 +1,283 @@
+#include "palette.h"
+#include "cpu_dispatch.h"
+#include "decoded_cache.h"
+#include "png_chunks.h"
+#include <algorithm>
+#include <cstring>
+#include <numeric>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define SCOUT_PALETTE_SSE2 1
+#endif
+
+namespace scout
+{
+    namespace
+    {
+        // Set of up to 256 RGBA colours, open addressed over 128 buckets of
+        // four keys. A lookup compares a whole bucket at once, and at most
+        // half the slots are ever used, so it rarely looks past one bucket.
+        class ColourSet
+        {
+        public:
+            explicit ColourSet(size_t limit) : m_limit(limit) {}
+
+            // Index of colour, adding it if it is new; -1 once more than
+            // limit colours have been seen
+            int find_or_add(uint32_t colour)
+            {
+                uint32_t b = (colour * 0x9E3779B1u) >> 25;
+                for (;;) {
+                    const uint32_t* keys = &m_keys[b * 4];
+                    const int n = m_count[b];
+#ifdef SCOUT_PALETTE_SSE2
+                    const __m128i eq = _mm_cmpeq_epi32(_mm_load_si128(reinterpret_cast<const __m128i*>(keys)),
+                        _mm_set1_epi32(static_cast<int>(colour)));
+                    const int hit = _mm_movemask_ps(_mm_castsi128_ps(eq)) & ((1 << n) - 1);
+                    if (hit) return m_index[b * 4 + ((hit & 1) ? 0 : (hit & 2) ? 1 : (hit & 4) ? 2 : 3)];
+#else
+                    for (int i = 0; i < n; ++i)
+                        if (keys[i] == colour) return m_index[b * 4 + i];
+#endif
+                    if (n < 4) {
+                        if (colours.size() >= m_limit) return -1;
+                        m_keys[b * 4 + n] = colour;
+                        m_index[b * 4 + n] = static_cast<uint8_t>(colours.size());
+                        m_count[b] = static_cast<uint8_t>(n + 1);
+                        colours.push_back(colour);
+                        return static_cast<int>(colours.size() - 1);
+                    }
+                    b = (b + 1) & (kBuckets - 1);
+                }
+            }
+
+            std::vector<uint32_t> colours;   // in index order
+
+        private:
+            static constexpr uint32_t kBuckets = 128;
+            alignas(16) uint32_t m_keys[kBuckets * 4] = {};
+            uint8_t m_index[kBuckets * 4] = {};
+            uint8_t m_count[kBuckets] = {};
+            size_t m_limit;
+        };
+
+        // tRNS only has to cover the palette up to the last entry that isn't
+        // opaque, so those go first
+        void transparent_first(IndexedImage& image)
+        {
+            const size_t n = image.palette.size() / 4;
+            std::vector<uint8_t> order(n);
+            std::iota(order.begin(), order.end(), 0);
+            std::stable_partition(order.begin(), order.end(),
+                [&](uint8_t i) { return image.palette[i * 4 + 3] != 255; });
+            if (std::is_sorted(order.begin(), order.end()))
+                return;
+
+            uint8_t remap[256];
+            std::vector<uint8_t> palette(image.palette.size());
+            for (size_t i = 0; i < n; ++i) {
+                remap[order[i]] = static_cast<uint8_t>(i);
+                std::memcpy(&palette[i * 4], &image.palette[order[i] * 4], 4);
+            }
+            image.palette.swap(palette);
+            for (auto& index : image.indices)
+                index = remap[index];
+        }
+
+        // 5 bits of red, green and blue, 3 of alpha
+        constexpr int kBinBits = 18;
+
+        inline uint32_t bin_of(const uint8_t* p)
+        {
+            return (uint32_t(p[0] >> 3) << 13) | (uint32_t(p[1] >> 3) << 8) | (uint32_t(p[2] >> 3) << 3) | (p[3] >> 5);
+        }
+
+        // Channel of a bin on a common 0..31 scale
+        inline int bin_channel(uint32_t bin, int channel)
+        {
+            switch (channel) {
+            case 0: return (bin >> 13) & 31;
+            case 1: return (bin >> 8) & 31;
+            case 2: return (bin >> 3) & 31;
+            default: return (bin & 7) << 2;
+            }
+        }
+    }
+
+    bool index_exact(const ImageView& image, IndexedImage& out, int maxColours)
+    {
+        ColourSet set(static_cast<size_t>(std::clamp(maxColours, 1, 256)));
+        out.width = image.width;
+        out.height = image.height;
+        out.indices.resize(static_cast<size_t>(image.width) * image.height);
+
+        const PixelKernels& kernels = pixel_kernels();
+        uint32_t last = 0;
+        int lastIndex = -1;
+        for (int y = 0; y < image.height; ++y) {
+            const uint8_t* row = image.row(y);
+            uint8_t* idx = out.indices.data() + static_cast<size_t>(y) * image.width;
+            int x = 0;
+            while (x < image.width) {
+                // Runs of one colour, the bulk of a screenshot, are matched a
+                // vector at a time
+                if (lastIndex >= 0) {
+                    const size_t run = kernels.match_run(row + x * 4, static_cast<size_t>(image.width - x), last);
+                    std::memset(idx + x, lastIndex, run);
+                    x += static_cast<int>(run);
+                    if (x == image.width) break;
+                }
+                uint32_t c;
+                std::memcpy(&c, row + x * 4, 4);
+                lastIndex = set.find_or_add(c);
+                if (lastIndex < 0) return false;
+                last = c;
+                idx[x++] = static_cast<uint8_t>(lastIndex);
+            }
+        }
+
+        out.palette.resize(set.colours.size() * 4);
+        std::memcpy(out.palette.data(), set.colours.data(), out.palette.size());
+        transparent_first(out);
+        return true;
+    }
+
+    IndexedImage index_median_cut(const ImageView& image, int maxColours)
+    {
+        maxColours = std::clamp(maxColours, 1, 256);
+
+        std::vector<uint32_t> hist(size_t(1) << kBinBits, 0);
+        for (int y = 0; y < image.height; ++y) {
+            const uint8_t* row = image.row(y);
+            for (int x = 0; x < image.width; ++x)
+                ++hist[bin_of(row + x * 4)];
+        }
+
+        struct Entry { uint32_t bin, count; };
+        std::vector<Entry> entries;
+        for (uint32_t bin = 0; bin < hist.size(); ++bin)
+            if (hist[bin]) entries.push_back({ bin, hist[bin] });
+
+        struct Box
+        {
+            size_t begin, end;
+            uint64_t count;
+            int lo[4], hi[4];
+        };
+        auto make_box = [&](size_t begin, size_t end) {
+            Box box{ begin, end, 0, { 31, 31, 31, 31 }, { 0, 0, 0, 0 } };
+            for (size_t i = begin; i < end; ++i) {
+                box.count += entries[i].count;
+                for (int c = 0; c < 4; ++c) {
+                    const int v = bin_channel(entries[i].bin, c);
+                    box.lo[c] = std::min(box.lo[c], v);
+                    box.hi[c] = std::max(box.hi[c], v);
+                }
+            }
+            return box;
+        };
+        auto longest = [](const Box& box) {
+            int best = 0;
+            for (int c = 1; c < 4; ++c)
+                if (box.hi[c] - box.lo[c] > box.hi[best] - box.lo[best]) best = c;
+            return best;
+        };
+
+        // Split the box with the most pixels times spread until there are
+        // enough boxes or none can be split
+        std::vector<Box> boxes;
+        if (!entries.empty()) boxes.push_back(make_box(0, entries.size()));
+        while (boxes.size() < static_cast<size_t>(maxColours)) {
+            size_t pick = boxes.size();
+            uint64_t bestScore = 0;
+            for (size_t i = 0; i < boxes.size(); ++i) {
+                const Box& b = boxes[i];
+                if (b.end - b.begin < 2) continue;
+                const int c = longest(b);
+                const uint64_t score = b.count * static_cast<uint64_t>(b.hi[c] - b.lo[c]);
+                if (score > bestScore) { bestScore = score; pick = i; }
+            }
+            if (pick == boxes.size()) break;
+
+            const Box box = boxes[pick];
+            const int c = longest(box);
+            std::sort(entries.begin() + box.begin, entries.begin() + box.end,
+                [c](const Entry& a, const Entry& b) { return bin_channel(a.bin, c) < bin_channel(b.bin, c); });
+
+            // Weighted median along that channel
+            size_t split = box.begin;
+            uint64_t seen = 0;
+            while (split < box.end - 1 && seen + entries[split].count <= box.count / 2)
+                seen += entries[split++].count;
+            split = std::clamp(split, box.begin + 1, box.end - 1);
+
+            boxes[pick] = make_box(box.begin, split);
+            boxes.push_back(make_box(split, box.end));
+        }
+
+        std::vector<uint8_t> boxOf(hist.size(), 0);
+        for (size_t i = 0; i < boxes.size(); ++i)
+            for (size_t e = boxes[i].begin; e < boxes[i].end; ++e)
+                boxOf[entries[e].bin] = static_cast<uint8_t>(i);
+
+        // Each palette entry is the mean of the pixels that map to it
+        IndexedImage out;
+        out.width = image.width;
+        out.height = image.height;
+        out.indices.resize(static_cast<size_t>(image.width) * image.height);
+        std::vector<uint64_t> sums(boxes.size() * 4, 0);
+        for (int y = 0; y < image.height; ++y) {
+            const uint8_t* row = image.row(y);
+            uint8_t* idx = out.indices.data() + static_cast<size_t>(y) * image.width;
+            for (int x = 0; x < image.width; ++x) {
+                const uint8_t* p = row + x * 4;
+                const uint8_t b = boxOf[bin_of(p)];
+                idx[x] = b;
+                for (int c = 0; c < 4; ++c) sums[b * 4 + c] += p[c];
+            }
+        }
+        out.palette.resize(boxes.size() * 4);
+        for (size_t i = 0; i < boxes.size(); ++i)
+            for (int c = 0; c < 4; ++c)
+                out.palette[i * 4 + c] = static_cast<uint8_t>((sums[i * 4 + c] + boxes[i].count / 2) / boxes[i].count);
+
+        transparent_first(out);
+        return out;
+    }
+
+    bool index_image(const ImageView& image, PaletteMode mode, IndexedImage& out)
+    {
+        if (mode == PaletteMode::Off) return false;
+        if (index_exact(image, out)) return true;
+        if (mode == PaletteMode::Exact) return false;
+        out = index_median_cut(image);
+        return true;
+    }
+
+    bool write_indexed_png(const fs::path& file, PaletteMode mode)
+    {
+        if (mode == PaletteMode::Off) return true;
+
+        std::vector<uint8_t> data;
+        const auto image = decoded_images().get(file, data);
+        IndexedImage indexed;
+        if (!image || !index_image(image->view(), mode, indexed))
+            return true;
+
+        std::vector<uint8_t> png = encode_png(indexed);
+        keep_png_metadata(data, png);
+        if (png.empty() || png.size() >= data.size())
+            return true;
+        if (!replace_file(file, png))
+            return false;
+
+        // What the new file decodes to, for whoever reads it next; median
+        // cut changed some colours
+        auto written = std::make_shared<Image>(indexed.width, indexed.height);
+        for (size_t i = 0; i < indexed.indices.size(); ++i)
+            std::memcpy(&written->pixels[i * 4], &indexed.palette[indexed.indices[i] * 4], 4);
+        decoded_images().put(file, std::move(written));
+        return true;
+    }
+}
@@ -0,0 +1,25 @@
+#pragma once
+#include "png_codec.h"
+
+// Palette (indexed) output. Modulated screenshots are mostly flat UI colour
+// and rarely use more than a few hundred distinct colours, so an indexed PNG
+// is a fraction of the truecolour file ImageMagick writes.
+namespace scout
+{
+    // Index image with its exact colours; false when it has more than
+    // maxColours (at most 256) of them
+    bool index_exact(const ImageView& image, IndexedImage& out, int maxColours = 256);
+
+    // Reduce image to at most maxColours by median cut over a 5-5-5-3 bit
+    // RGBA histogram; every pixel takes the colour of its box
+    IndexedImage index_median_cut(const ImageView& image, int maxColours = 256);
+
+    // Index image as mode asks; false when mode is Exact and it has too many
+    // colours
+    bool index_image(const ImageView& image, PaletteMode mode, IndexedImage& out);
+
+    // Rewrite the PNG at file as an indexed PNG, keeping its metadata. A
+    // file that can't be read, has too many colours for Exact, or wouldn't
+    // get smaller is left as it is; false only when writing fails.
+    bool write_indexed_png(const fs::path& file, PaletteMode mode);
+}
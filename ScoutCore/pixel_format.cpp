@@ -0,0 +1,283 @@
+#include "pixel_format.h"
+#include "cpu_dispatch.h"
+#include "modulate_fixed.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+namespace scout
+{
+    namespace
+    {
+        // Same conversions as ImageMagick's ConvertRGBToHSL / ConvertHSLToRGB
+        void rgb_to_hsl(double r, double g, double b, double& h, double& s, double& l)
+        {
+            const double max = std::max(r, std::max(g, b));
+            const double min = std::min(r, std::min(g, b));
+            const double c = max - min;
+
+            l = (max + min) / 2.0;
+            if (c <= 0.0) {
+                h = 0.0;
+                s = 0.0;
+                return;
+            }
+
+            if (max == r) {
+                h = (g - b) / c;
+                if (g < b) h += 6.0;
+            }
+            else if (max == g) h = 2.0 + (b - r) / c;
+            else h = 4.0 + (r - g) / c;
+            h /= 6.0;
+
+            s = (l <= 0.5) ? c / (2.0 * l) : c / (2.0 - 2.0 * l);
+        }
+
+        void hsl_to_rgb(double h, double s, double l, double& r, double& g, double& b)
+        {
+            const double c = (l <= 0.5) ? 2.0 * l * s : (2.0 - 2.0 * l) * s;
+            const double m = l - 0.5 * c;
+            const double hh = h * 6.0;
+            const double x = c * (1.0 - std::fabs(hh - 2.0 * std::floor(hh / 2.0) - 1.0));
+
+            switch (static_cast<int>(std::floor(hh))) {
+            case 0:  r = m + c; g = m + x; b = m; break;
+            case 1:  r = m + x; g = m + c; b = m; break;
+            case 2:  r = m; g = m + c; b = m + x; break;
+            case 3:  r = m; g = m + x; b = m + c; break;
+            case 4:  r = m + x; g = m; b = m + c; break;
+            case 5:  r = m + c; g = m; b = m + x; break;
+            default: r = m; g = m; b = m; break;
+            }
+        }
+
+        template <PixelFormat F>
+        using SampleOf = typename FormatTraits<F>::Sample;
+
+        template <PixelFormat F>
+        SampleOf<F>* samples(const PixelView& image, int y)
+        {
+            return reinterpret_cast<SampleOf<F>*>(image.row(y));
+        }
+
+        // 0..1 to the format's range, rounded
+        template <PixelFormat F>
+        SampleOf<F> to_sample(double v)
+        {
+            return static_cast<SampleOf<F>>(std::lround(std::clamp(v, 0.0, 1.0) * FormatTraits<F>::kMax));
+        }
+
+        // 8-bit formats go through the fixed-point version, which gives the
+        // same bytes everywhere; 16-bit ones still use doubles
+        template <PixelFormat F>
+        void modulate_pixels(const PixelView& image, const ModulateParams& mp)
+        {
+            using T = FormatTraits<F>;
+            const double hueShift = std::fmod(mp.hue - 100.0, 200.0) / 200.0;
+            const double satScale = 0.01 * mp.saturation;
+            const double lightScale = 0.01 * mp.brightness;
+            const double max = T::kMax;
+
+            if constexpr (T::kGrey) {
+                // Grey has no hue or saturation to change: HSL lightness is
+                // the value itself, and only brightness moves it
+                if constexpr (!T::kWide) {
+                    // Taken from the colour tables, so a grey image and a
+                    // colour one with grey pixels come out the same
+                    const ModulateTables tables = modulate_tables(mp);
+                    uint8_t lut[256];
+                    for (int v = 0; v < 256; ++v)
+                        lut[v] = fixed_to_sample(tables.light[2 * v]);
+                    for (int y = 0; y < image.height; ++y) {
+                        uint8_t* p = samples<F>(image, y);
+                        for (int x = 0; x < image.width; ++x, p += T::kChannels)
+                            p[0] = lut[p[0]];
+                    }
+                }
+                else {
+                    for (int y = 0; y < image.height; ++y) {
+                        uint16_t* p = samples<F>(image, y);
+                        for (int x = 0; x < image.width; ++x, p += T::kChannels)
+                            p[0] = to_sample<F>(p[0] / max * lightScale);
+                    }
+                }
+            }
+            else if constexpr (!T::kWide) {
+                const ModulateTables tables = modulate_tables(mp);
+                const PixelKernels& kernels = pixel_kernels();
+                for (int y = 0; y < image.height; ++y)
+                    kernels.modulate(image.row(y), static_cast<size_t>(image.width), T::kChannels, tables);
+            }
+            else {
+                for (int y = 0; y < image.height; ++y) {
+                    SampleOf<F>* p = samples<F>(image, y);
+                    for (int x = 0; x < image.width; ++x, p += T::kChannels) {
+                        double h, s, l;
+                        rgb_to_hsl(p[0] / max, p[1] / max, p[2] / max, h, s, l);
+
+                        h += hueShift;
+                        h -= std::floor(h);
+                        s *= satScale;
+                        l *= lightScale;
+
+                        double r, g, b;
+                        hsl_to_rgb(h, s, l, r, g, b);
+                        p[0] = to_sample<F>(r);
+                        p[1] = to_sample<F>(g);
+                        p[2] = to_sample<F>(b);
+                    }
+                }
+            }
+        }
+
+        template <PixelFormat F>
+        void composite_pixels(const PixelView& base, const PixelView& overlay, int ox, int oy)
+        {
+            using T = FormatTraits<F>;
+            const int x0 = std::max(0, ox), x1 = std::min(base.width, ox + overlay.width);
+            const int y0 = std::max(0, oy), y1 = std::min(base.height, oy + overlay.height);
+            if (x0 >= x1) return;
+
+            for (int y = y0; y < y1; ++y) {
+                SampleOf<F>* d = samples<F>(base, y) + static_cast<size_t>(x0) * T::kChannels;
+                const SampleOf<F>* s = samples<F>(overlay, y - oy) + static_cast<size_t>(x0 - ox) * T::kChannels;
+
+                if constexpr (!T::kAlpha) {
+                    // An opaque overlay simply replaces what is under it
+                    std::memcpy(d, s, static_cast<size_t>(x1 - x0) * T::kPixelBytes);
+                }
+                else {
+                    constexpr int a = T::kColours;
+                    const double max = T::kMax;
+                    for (int x = x0; x < x1; ++x, d += T::kChannels, s += T::kChannels) {
+                        if constexpr (!T::kWide) {
+                            // Onto an opaque pixel the blend stays opaque and
+                            // is exact in integers; x / 255 is never exactly
+                            // a half, so + 127 rounds it like lround
+                            if (d[a] == 255) {
+                                const int sa = s[a];
+                                for (int k = 0; k < a; ++k)
+                                    d[k] = static_cast<uint8_t>((s[k] * sa + d[k] * (255 - sa) + 127) / 255);
+                                continue;
+                            }
+                        }
+                        const double sa = s[a] / max;
+                        const double da = d[a] / max;
+                        const double oa = sa + da * (1.0 - sa);
+                        if (oa <= 0.0) {
+                            std::fill(d, d + T::kChannels, SampleOf<F>(0));
+                            continue;
+                        }
+                        for (int k = 0; k < a; ++k)
+                            d[k] = static_cast<SampleOf<F>>(std::lround((s[k] * sa + d[k] * da * (1.0 - sa)) / oa));
+                        d[a] = to_sample<F>(oa);
+                    }
+                }
+            }
+        }
+
+        // Where the centre of output sample i lands between input samples,
+        // in 1/65536 of a sample, clamped to the input
+        inline int64_t resize_source(int i, int inSize, int outSize)
+        {
+            const int64_t pos = ((2 * static_cast<int64_t>(i) + 1) * inSize - outSize) * 65536 / (2 * static_cast<int64_t>(outSize));
+            return std::clamp<int64_t>(pos, 0, static_cast<int64_t>(inSize - 1) << 16);
+        }
+
+        // 8-bit formats blend with integer weights in 1/2048, so the result
+        // is the same on every compiler and CPU; 16-bit ones still use doubles
+        template <PixelFormat F>
+        void resize_pixels(const PixelView& in, const PixelView& out)
+        {
+            using T = FormatTraits<F>;
+            if constexpr (!T::kWide) {
+                constexpr uint32_t kOne = 2048;
+                struct Column { int x0, x1; uint32_t w; };
+                std::vector<Column> columns(static_cast<size_t>(out.width));
+                for (int x = 0; x < out.width; ++x) {
+                    const int64_t fx = resize_source(x, in.width, out.width);
+                    Column& c = columns[static_cast<size_t>(x)];
+                    c.x0 = static_cast<int>(fx >> 16);
+                    c.x1 = std::min(c.x0 + 1, in.width - 1);
+                    c.w = static_cast<uint32_t>(((fx & 0xFFFF) + 16) >> 5);
+                }
+
+                for (int y = 0; y < out.height; ++y) {
+                    const int64_t fy = resize_source(y, in.height, out.height);
+                    const int y0 = static_cast<int>(fy >> 16);
+                    const int y1 = std::min(y0 + 1, in.height - 1);
+                    const uint32_t wy = static_cast<uint32_t>(((fy & 0xFFFF) + 16) >> 5);
+
+                    const uint8_t* top = samples<F>(in, y0);
+                    const uint8_t* bottom = samples<F>(in, y1);
+                    uint8_t* o = samples<F>(out, y);
+                    for (const Column& c : columns) {
+                        const uint8_t* a = top + c.x0 * T::kChannels;
+                        const uint8_t* b = top + c.x1 * T::kChannels;
+                        const uint8_t* d = bottom + c.x0 * T::kChannels;
+                        const uint8_t* e = bottom + c.x1 * T::kChannels;
+                        for (int k = 0; k < T::kChannels; ++k, ++o) {
+                            const uint32_t upper = a[k] * (kOne - c.w) + b[k] * c.w;
+                            const uint32_t lower = d[k] * (kOne - c.w) + e[k] * c.w;
+                            *o = static_cast<uint8_t>((upper * (kOne - wy) + lower * wy + (1u << 21)) >> 22);
+                        }
+                    }
+                }
+                return;
+            }
+
+            const double sx = static_cast<double>(in.width) / out.width;
+            const double sy = static_cast<double>(in.height) / out.height;
+
+            for (int y = 0; y < out.height; ++y) {
+                const double fy = std::clamp((y + 0.5) * sy - 0.5, 0.0, in.height - 1.0);
+                const int y0 = static_cast<int>(fy);
+                const int y1 = std::min(y0 + 1, in.height - 1);
+                const double wy = fy - y0;
+
+                SampleOf<F>* o = samples<F>(out, y);
+                for (int x = 0; x < out.width; ++x, o += T::kChannels) {
+                    const double fx = std::clamp((x + 0.5) * sx - 0.5, 0.0, in.width - 1.0);
+                    const int x0 = static_cast<int>(fx);
+                    const int x1 = std::min(x0 + 1, in.width - 1);
+                    const double wx = fx - x0;
+
+                    const SampleOf<F>* a = samples<F>(in, y0) + x0 * T::kChannels;
+                    const SampleOf<F>* b = samples<F>(in, y0) + x1 * T::kChannels;
+                    const SampleOf<F>* c = samples<F>(in, y1) + x0 * T::kChannels;
+                    const SampleOf<F>* d = samples<F>(in, y1) + x1 * T::kChannels;
+                    for (int k = 0; k < T::kChannels; ++k) {
+                        const double top = a[k] + (b[k] - a[k]) * wx;
+                        const double bottom = c[k] + (d[k] - c[k]) * wx;
+                        o[k] = static_cast<SampleOf<F>>(std::lround(top + (bottom - top) * wy));
+                    }
+                }
+            }
+        }
+
+        template <PixelFormat F>
+        constexpr FormatKernels kernels_for()
+        {
+            return { F, FormatTraits<F>::kPixelBytes, modulate_pixels<F>, composite_pixels<F>, resize_pixels<F> };
+        }
+
+        // In PixelFormat order
+        const FormatKernels kFormatKernels[] = {
+            kernels_for<PixelFormat::Gray8>(),
+            kernels_for<PixelFormat::GrayA8>(),
+            kernels_for<PixelFormat::Rgb8>(),
+            kernels_for<PixelFormat::Rgba8>(),
+            kernels_for<PixelFormat::Gray16>(),
+            kernels_for<PixelFormat::GrayA16>(),
+            kernels_for<PixelFormat::Rgb16>(),
+            kernels_for<PixelFormat::Rgba16>(),
+        };
+    }
+
+    const FormatKernels& format_kernels(PixelFormat format)
+    {
+        return kFormatKernels[static_cast<int>(format)];
+    }
+}
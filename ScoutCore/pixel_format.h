@@ -0,0 +1,62 @@
+#pragma once
+#include "scout_pipeline.h"
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+// Pixel layouts the native kernels handle. Each kernel is a template over
+// the layout's traits, so every format gets its own inner loop (no alpha
+// work for opaque formats, lookup tables and integer blends for 8-bit)
+// without a branch per pixel; format_kernels() picks the instantiation.
+namespace scout
+{
+    enum class PixelFormat { Gray8, GrayA8, Rgb8, Rgba8, Gray16, GrayA16, Rgb16, Rgba16 };
+
+    template <PixelFormat F>
+    struct FormatTraits
+    {
+        static constexpr bool kGrey = F == PixelFormat::Gray8 || F == PixelFormat::GrayA8 ||
+            F == PixelFormat::Gray16 || F == PixelFormat::GrayA16;
+        static constexpr bool kAlpha = F == PixelFormat::GrayA8 || F == PixelFormat::Rgba8 ||
+            F == PixelFormat::GrayA16 || F == PixelFormat::Rgba16;
+        static constexpr bool kWide = F >= PixelFormat::Gray16;
+
+        using Sample = std::conditional_t<kWide, uint16_t, uint8_t>;
+        static constexpr int kColours = kGrey ? 1 : 3;
+        static constexpr int kChannels = kColours + (kAlpha ? 1 : 0);
+        static constexpr int kMax = kWide ? 65535 : 255;
+        static constexpr size_t kPixelBytes = sizeof(Sample) * kChannels;
+    };
+
+    // A view on pixels of any format; 16-bit samples are in native byte
+    // order, alpha (when there is one) comes last
+    struct PixelView
+    {
+        uint8_t* data = nullptr;
+        int width = 0;
+        int height = 0;
+        size_t stride = 0;          // bytes per row
+        PixelFormat format = PixelFormat::Rgba8;
+
+        uint8_t* row(int y) const { return data + static_cast<size_t>(y) * stride; }
+    };
+
+    struct FormatKernels
+    {
+        PixelFormat format;
+        size_t pixelBytes;
+
+        // -modulate in HSL space, like ImageMagick
+        void (*modulate)(const PixelView& image, const ModulateParams& mp);
+
+        // Alpha-blend overlay (same format) onto base with its top-left
+        // corner at x, y, clipped to base
+        void (*composite)(const PixelView& base, const PixelView& overlay, int x, int y);
+
+        // Bilinear resize of in to the size of out (same format)
+        void (*resize)(const PixelView& in, const PixelView& out);
+    };
+
+    // The kernels for one format, from a table built at compile time
+    const FormatKernels& format_kernels(PixelFormat format);
+}
@@ -0,0 +1,225 @@
+#include "pixel_ops.h"
+#include "cpu_dispatch.h"
+#include "pixel_format.h"
+#include "hue_scale.h"
+#include "text_stamp.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace scout
+{
+    static PixelView rgba_pixels(const ImageView& image)
+    {
+        return { image.data, image.width, image.height, image.stride, PixelFormat::Rgba8 };
+    }
+
+    void modulate(const ImageView& image, const ModulateParams& mp)
+    {
+        format_kernels(PixelFormat::Rgba8).modulate(rgba_pixels(image), mp);
+    }
+
+    Image trim(const ImageView& image)
+    {
+        uint32_t corner;
+        std::memcpy(&corner, image.data, 4);
+
+        // Each row only needs its first and last pixel that differs
+        const PixelKernels& kernels = pixel_kernels();
+        const size_t width = static_cast<size_t>(image.width);
+        int left = image.width, right = -1, top = image.height, bottom = -1;
+        for (int y = 0; y < image.height; ++y) {
+            const uint8_t* p = image.row(y);
+            const size_t lead = kernels.match_run(p, width, corner);
+            if (lead == width) continue;
+            const size_t trail = kernels.match_run_back(p, width, corner);
+            left = std::min(left, static_cast<int>(lead));
+            right = std::max(right, static_cast<int>(width - 1 - trail));
+            top = std::min(top, y);
+            bottom = y;
+        }
+
+        // A uniform image trims to nothing; ImageMagick keeps one pixel
+        if (right < 0) {
+            left = right = 0;
+            top = bottom = 0;
+        }
+
+        Image out(right - left + 1, bottom - top + 1);
+        for (int y = 0; y < out.height; ++y)
+            std::memcpy(out.pixels.data() + static_cast<size_t>(y) * out.width * 4,
+                image.row(top + y) + static_cast<size_t>(left) * 4, static_cast<size_t>(out.width) * 4);
+        return out;
+    }
+
+    Image resize(const ImageView& image, int percent)
+    {
+        const int w = std::max(1, static_cast<int>(std::floor(image.width * percent / 100.0 + 0.5)));
+        const int h = std::max(1, static_cast<int>(std::floor(image.height * percent / 100.0 + 0.5)));
+        Image out(w, h);
+        format_kernels(PixelFormat::Rgba8).resize(rgba_pixels(image), rgba_pixels(out.view()));
+        return out;
+    }
+
+    void edge_origin(int baseWidth, int baseHeight, int w, int h, Edge edge, int& x, int& y)
+    {
+        x = (baseWidth - w) / 2;
+        y = (baseHeight - h) / 2;
+        switch (edge) {
+        case Edge::Top:    y = 0; break;
+        case Edge::Bottom: y = baseHeight - h; break;
+        case Edge::Left:   x = 0; break;
+        case Edge::Right:  x = baseWidth - w; break;
+        }
+    }
+
+    void composite_on_edge(const ImageView& base, const ImageView& overlay, Edge edge)
+    {
+        int ox, oy;
+        edge_origin(base.width, base.height, overlay.width, overlay.height, edge, ox, oy);
+
+        format_kernels(PixelFormat::Rgba8).composite(rgba_pixels(base), rgba_pixels(overlay), ox, oy);
+    }
+
+    const uint8_t kExtendBackground[4] = { 0, 0, 0, 255 };
+
+    ExtendLayout extend_layout(int baseWidth, int baseHeight, int legendWidth, int legendHeight, Edge edge)
+    {
+        ExtendLayout l{};
+        const bool across = edge == Edge::Left || edge == Edge::Right;
+        if (across) {
+            l.width = baseWidth + legendWidth;
+            l.height = std::max(baseHeight, legendHeight);
+            l.baseY = (l.height - baseHeight) / 2;
+            l.legendY = (l.height - legendHeight) / 2;
+            l.baseX = edge == Edge::Left ? legendWidth : 0;
+            l.legendX = edge == Edge::Left ? 0 : baseWidth;
+        }
+        else {
+            l.width = std::max(baseWidth, legendWidth);
+            l.height = baseHeight + legendHeight;
+            l.baseX = (l.width - baseWidth) / 2;
+            l.legendX = (l.width - legendWidth) / 2;
+            l.baseY = edge == Edge::Top ? legendHeight : 0;
+            l.legendY = edge == Edge::Top ? 0 : baseHeight;
+        }
+        return l;
+    }
+
+    // Every output row is built left to right from at most two copied spans
+    // and background fill, so each byte is written exactly once
+    void extend_on_edge(const ImageView& base, const ImageView& legend, const ExtendLayout& layout,
+        const ImageView& out)
+    {
+        // One row of background to copy gaps from
+        std::vector<uint8_t> fill(static_cast<size_t>(layout.width) * 4);
+        for (size_t i = 0; i < fill.size(); i += 4)
+            std::memcpy(fill.data() + i, kExtendBackground, 4);
+
+        struct Span { int x, width; const uint8_t* src; };
+        for (int y = 0; y < layout.height; ++y) {
+            Span spans[2];
+            int n = 0;
+            if (y >= layout.baseY && y < layout.baseY + base.height)
+                spans[n++] = { layout.baseX, base.width, base.row(y - layout.baseY) };
+            if (y >= layout.legendY && y < layout.legendY + legend.height)
+                spans[n++] = { layout.legendX, legend.width, legend.data ? legend.row(y - layout.legendY) : nullptr };
+            if (n == 2 && spans[1].x < spans[0].x)
+                std::swap(spans[0], spans[1]);
+
+            uint8_t* dst = out.row(y);
+            int x = 0;
+            for (int i = 0; i < n; ++i) {
+                if (spans[i].x > x)
+                    std::memcpy(dst + static_cast<size_t>(x) * 4, fill.data(), static_cast<size_t>(spans[i].x - x) * 4);
+                const size_t bytes = static_cast<size_t>(spans[i].width) * 4;
+                std::memcpy(dst + static_cast<size_t>(spans[i].x) * 4, spans[i].src ? spans[i].src : fill.data(), bytes);
+                x = spans[i].x + spans[i].width;
+            }
+            if (x < layout.width)
+                std::memcpy(dst + static_cast<size_t>(x) * 4, fill.data(), static_cast<size_t>(layout.width - x) * 4);
+        }
+    }
+
+    bool process_pixels(const ImageView& base, const ImageView* legend,
+        const Options& options, const AllocateFn& allocate, const std::string& stampText)
+    {
+        const bool haveLegend = legend && legend->width > 0 && legend->height > 0;
+        const bool drawScale = options.legend && (options.legendSource == LegendSource::HueScale
+            || (options.legendSource == LegendSource::FileOrHueScale && !haveLegend));
+
+        // The legend is prepared first; its size decides the canvas
+        Image scaled;
+        if (options.legend && !drawScale && haveLegend) {
+            Image prepared;
+            if (options.cropLegendFirst) {
+                prepared = trim(*legend);
+            }
+            else {
+                prepared = Image(legend->width, legend->height);
+                for (int y = 0; y < legend->height; ++y)
+                    std::memcpy(prepared.pixels.data() + static_cast<size_t>(y) * legend->width * 4,
+                        legend->row(y), static_cast<size_t>(legend->width) * 4);
+            }
+            modulate(prepared.view(), options.mp);
+            scaled = resize(prepared.view(), options.legendPercent);
+        }
+
+        const bool extend = options.placement == LegendPlacement::Extend && (drawScale || scaled.width > 0);
+        if (extend) {
+            int lw = scaled.width, lh = scaled.height;
+            if (drawScale)
+                hue_scale_size(base.width, base.height, options.edge, options.hueScale, lw, lh);
+
+            const ExtendLayout layout = extend_layout(base.width, base.height, lw, lh, options.edge);
+            const ImageView out = allocate(layout.width, layout.height);
+            if (!out.data || out.data == base.data)
+                return false;
+
+            const ImageView legendArea{ drawScale ? nullptr : scaled.pixels.data(), lw, lh, static_cast<size_t>(lw) * 4 };
+            extend_on_edge(base, legendArea, layout, out);
+
+            if (options.modulate) {
+                const ImageView baseArea{ out.row(layout.baseY) + static_cast<size_t>(layout.baseX) * 4,
+                    base.width, base.height, out.stride };
+                modulate(baseArea, options.mp);
+            }
+            if (drawScale) {
+                const ImageView scaleArea{ out.row(layout.legendY) + static_cast<size_t>(layout.legendX) * 4,
+                    lw, lh, out.stride };
+                draw_hue_scale(scaleArea, base.width, base.height, options.edge, options.hueScale, options.mp);
+            }
+            if (options.stamp.enabled && !stampText.empty())
+                stamp_text(out, stampText, options.stamp);
+            return true;
+        }
+
+        const ImageView out = allocate(base.width, base.height);
+        if (!out.data)
+            return false;
+        if (out.data != base.data) {
+            for (int y = 0; y < base.height; ++y)
+                std::memcpy(out.row(y), base.row(y), static_cast<size_t>(base.width) * 4);
+        }
+
+        if (options.modulate)
+            modulate(out, options.mp);
+
+        if (drawScale)
+            stamp_hue_scale(out, options.edge, options.hueScale, options.mp);
+        else if (scaled.width > 0)
+            composite_on_edge(out, scaled.view(), options.edge);
+
+        if (options.stamp.enabled && !stampText.empty())
+            stamp_text(out, stampText, options.stamp);
+        return true;
+    }
+
+    bool process_pixels(const ImageView& base, const ImageView* legend,
+        const Options& options, const ImageView& out, const std::string& stampText)
+    {
+        return process_pixels(base, legend, options, [&](int w, int h) {
+            return w == out.width && h == out.height ? out : ImageView{};
+        }, stampText);
+    }
+}
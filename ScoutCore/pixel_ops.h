@@ -0,0 +1,91 @@
+#pragma once
+#include "scout_pipeline.h"
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+// Native versions of the ImageMagick steps, working on 8-bit RGBA pixels in
+// memory. Used where frames never touch the disk (the shared-memory ring);
+// the file pipeline keeps using magick.exe.
+namespace scout
+{
+    // A view on RGBA8 pixels owned by someone else (a ring slot, a vector...)
+    struct ImageView
+    {
+        uint8_t* data = nullptr;
+        int width = 0;
+        int height = 0;
+        size_t stride = 0;          // bytes per row
+
+        uint8_t* row(int y) const { return data + static_cast<size_t>(y) * stride; }
+    };
+
+    // An owned RGBA8 image
+    struct Image
+    {
+        int width = 0;
+        int height = 0;
+        std::vector<uint8_t> pixels;
+
+        Image() = default;
+        Image(int w, int h) : width(w), height(h), pixels(static_cast<size_t>(w) * h * 4) {}
+        ImageView view() { return { pixels.data(), width, height, static_cast<size_t>(width) * 4 }; }
+        // For kernels that only read (shared, cached images)
+        ImageView view() const { return { const_cast<uint8_t*>(pixels.data()), width, height, static_cast<size_t>(width) * 4 }; }
+    };
+
+    // -modulate brightness,saturation,hue in HSL space, like ImageMagick
+    void modulate(const ImageView& image, const ModulateParams& mp);
+
+    // -trim: crop away the border that has the colour of the top-left pixel
+    Image trim(const ImageView& image);
+
+    // -resize percent% (bilinear)
+    Image resize(const ImageView& image, int percent);
+
+    // Top-left corner of a w x h overlay placed like -gravity <edge>
+    void edge_origin(int baseWidth, int baseHeight, int w, int h, Edge edge, int& x, int& y);
+
+    // -gravity <edge> -composite: alpha-blend overlay onto base, centred
+    // along the chosen edge and clipped to base
+    void composite_on_edge(const ImageView& base, const ImageView& overlay, Edge edge);
+
+    // Fill colour for the part of an extended canvas neither image covers
+    extern const uint8_t kExtendBackground[4];
+
+    // Canvas for LegendPlacement::Extend: base and a w x h legend side by
+    // side on edge, each centred across it, and where each one goes
+    struct ExtendLayout
+    {
+        int width, height;
+        int baseX, baseY;
+        int legendX, legendY;
+    };
+    ExtendLayout extend_layout(int baseWidth, int baseHeight, int legendWidth, int legendHeight, Edge edge);
+
+    // Stitch base and legend rows into out, which has the layout's size;
+    // the rest is filled with kExtendBackground. A legend without pixels
+    // leaves its area filled.
+    void extend_on_edge(const ImageView& base, const ImageView& legend, const ExtendLayout& layout,
+        const ImageView& out);
+
+    // Asked for the output once its size is known; returns a view of that
+    // size, or one without data when it can't be provided
+    using AllocateFn = std::function<ImageView(int width, int height)>;
+
+    // The whole per-image pipeline: base modulated, with the legend prepared
+    // and composited when one is given, or the hue scale drawn on it as
+    // options.legendSource asks, and stampText written on it when
+    // options.stamp is enabled. With LegendPlacement::Extend the output is
+    // larger than base and never aliases it. Returns false when allocate
+    // gives no output.
+    bool process_pixels(const ImageView& base, const ImageView* legend,
+        const Options& options, const AllocateFn& allocate, const std::string& stampText = {});
+
+    // Same, into out, which must have base's size (it may be base itself);
+    // fails when options.placement would make the output larger
+    bool process_pixels(const ImageView& base, const ImageView* legend,
+        const Options& options, const ImageView& out, const std::string& stampText = {});
+}
@@ -0,0 +1,296 @@
+#include "png_chunks.h"
+#include "png_codec.h"
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <set>
+#include <zlib.h>
+
+namespace scout
+{
+    static const uint8_t kSignature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+
+    static uint32_t be32(const uint8_t* p)
+    {
+        return (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) | (uint32_t(p[2]) << 8) | p[3];
+    }
+
+    static void put_be32(std::vector<uint8_t>& out, uint32_t v)
+    {
+        for (int shift = 24; shift >= 0; shift -= 8)
+            out.push_back(static_cast<uint8_t>(v >> shift));
+    }
+
+    static uint32_t chunk_crc(const std::string& type, const std::vector<uint8_t>& data)
+    {
+        uLong crc = crc32(0, reinterpret_cast<const Bytef*>(type.data()), 4);
+        if (!data.empty()) crc = crc32(crc, data.data(), static_cast<uInt>(data.size()));
+        return static_cast<uint32_t>(crc);
+    }
+
+    static bool is_colour_space(const std::string& type)
+    {
+        return type == "iCCP" || type == "sRGB" || type == "gAMA" || type == "cHRM" || type == "cICP";
+    }
+
+    static bool is_text(const std::string& type)
+    {
+        return type == "tEXt" || type == "zTXt" || type == "iTXt";
+    }
+
+    static std::string keyword_of(const PngChunk& chunk)
+    {
+        auto end = std::find(chunk.data.begin(), chunk.data.end(), 0);
+        return std::string(chunk.data.begin(), end);
+    }
+
+    bool split_png(const std::vector<uint8_t>& data, std::vector<PngChunk>& chunks)
+    {
+        chunks.clear();
+        if (data.size() < 8 || std::memcmp(data.data(), kSignature, 8) != 0)
+            return false;
+
+        size_t pos = 8;
+        while (pos + 12 <= data.size()) {
+            const uint32_t size = be32(&data[pos]);
+            if (size > data.size() - pos - 12) return false;
+            PngChunk chunk;
+            chunk.type.assign(reinterpret_cast<const char*>(&data[pos + 4]), 4);
+            chunk.data.assign(data.begin() + pos + 8, data.begin() + pos + 8 + size);
+            if (be32(&data[pos + 8 + size]) != chunk_crc(chunk.type, chunk.data))
+                return false;
+            pos += 12 + size;
+            chunks.push_back(std::move(chunk));
+            if (chunks.back().type == "IEND") break;
+        }
+        return !chunks.empty() && chunks.front().type == "IHDR" && chunks.back().type == "IEND";
+    }
+
+    std::vector<uint8_t> join_png(const std::vector<PngChunk>& chunks)
+    {
+        size_t total = 8;
+        for (const auto& c : chunks) total += 12 + c.data.size();
+
+        std::vector<uint8_t> out(kSignature, kSignature + 8);
+        out.reserve(total);
+        for (const auto& c : chunks) {
+            put_be32(out, static_cast<uint32_t>(c.data.size()));
+            out.insert(out.end(), c.type.begin(), c.type.end());
+            out.insert(out.end(), c.data.begin(), c.data.end());
+            put_be32(out, chunk_crc(c.type, c.data));
+        }
+        return out;
+    }
+
+    std::vector<PngChunk> portable_chunks(const std::vector<PngChunk>& chunks)
+    {
+        // Bit 5 of the first letter marks an ancillary chunk, of the fourth
+        // one that is safe to copy into an edited image
+        std::vector<PngChunk> out;
+        for (const auto& c : chunks) {
+            const bool ancillary = (c.type[0] & 0x20) != 0;
+            const bool safeToCopy = (c.type[3] & 0x20) != 0;
+            if (ancillary && (safeToCopy || is_colour_space(c.type)))
+                out.push_back(c);
+        }
+        return out;
+    }
+
+    void merge_chunks(std::vector<PngChunk>& chunks, const std::vector<PngChunk>& extra)
+    {
+        if (extra.empty()) return;
+
+        bool colourSpace = false;
+        std::set<std::string> types, keywords;
+        for (const auto& c : extra) {
+            if (is_colour_space(c.type)) colourSpace = true;
+            else if (is_text(c.type)) keywords.insert(keyword_of(c));
+            else types.insert(c.type);
+        }
+
+        chunks.erase(std::remove_if(chunks.begin(), chunks.end(), [&](const PngChunk& c) {
+            return (colourSpace && is_colour_space(c.type)) || types.count(c.type) ||
+                (is_text(c.type) && keywords.count(keyword_of(c)));
+        }), chunks.end());
+
+        // Right after IHDR is before PLTE and IDAT, where every one of them
+        // may go
+        auto at = chunks.begin();
+        if (at != chunks.end() && at->type == "IHDR") ++at;
+        chunks.insert(at, extra.begin(), extra.end());
+    }
+
+    PngChunk text_chunk(const std::string& keyword, const std::string& value)
+    {
+        const std::string key = keyword.substr(0, 79);
+        const bool ascii = std::all_of(value.begin(), value.end(),
+            [](char ch) { return ch != 0 && static_cast<unsigned char>(ch) < 0x80; });
+
+        PngChunk chunk;
+        chunk.type = ascii ? "tEXt" : "iTXt";
+        chunk.data.assign(key.begin(), key.end());
+        chunk.data.push_back(0);
+        if (!ascii) {
+            // Uncompressed, no language tag, no translated keyword
+            const uint8_t fields[] = { 0, 0, 0, 0 };
+            chunk.data.insert(chunk.data.end(), fields, fields + sizeof(fields));
+        }
+        chunk.data.insert(chunk.data.end(), value.begin(), value.end());
+        return chunk;
+    }
+
+    // Inflate a zTXt or compressed iTXt value, refusing anything over 16 MB
+    static bool inflate_text(const uint8_t* data, size_t size, std::string& out)
+    {
+        z_stream zs{};
+        if (inflateInit(&zs) != Z_OK) return false;
+        zs.next_in = const_cast<Bytef*>(data);
+        zs.avail_in = static_cast<uInt>(size);
+
+        uint8_t buf[16384];
+        int rc = Z_OK;
+        while (rc == Z_OK && out.size() < (16u << 20)) {
+            zs.next_out = buf;
+            zs.avail_out = sizeof(buf);
+            rc = inflate(&zs, Z_NO_FLUSH);
+            out.append(reinterpret_cast<const char*>(buf), sizeof(buf) - zs.avail_out);
+        }
+        inflateEnd(&zs);
+        return rc == Z_STREAM_END;
+    }
+
+    static std::string latin1_to_utf8(const std::string& s)
+    {
+        std::string out;
+        for (unsigned char ch : s) {
+            if (ch < 0x80) out += static_cast<char>(ch);
+            else {
+                out += static_cast<char>(0xC0 | (ch >> 6));
+                out += static_cast<char>(0x80 | (ch & 0x3F));
+            }
+        }
+        return out;
+    }
+
+    std::map<std::string, std::string> png_text(const std::vector<PngChunk>& chunks)
+    {
+        std::map<std::string, std::string> text;
+        for (const auto& c : chunks) {
+            if (!is_text(c.type)) continue;
+            const std::string key = keyword_of(c);
+            size_t pos = key.size() + 1;
+            if (pos > c.data.size()) continue;
+            const uint8_t* p = c.data.data();
+
+            std::string value;
+            if (c.type == "tEXt") {
+                value = latin1_to_utf8(std::string(p + pos, p + c.data.size()));
+            }
+            else if (c.type == "zTXt") {
+                if (pos + 1 > c.data.size() || !inflate_text(p + pos + 1, c.data.size() - pos - 1, value))
+                    continue;
+                value = latin1_to_utf8(value);
+            }
+            else {
+                // Compression flag and method, then language and translated
+                // keyword, each NUL-terminated
+                if (pos + 2 > c.data.size()) continue;
+                const bool compressed = p[pos] != 0;
+                pos += 2;
+                for (int field = 0; field < 2; ++field) {
+                    while (pos < c.data.size() && p[pos] != 0) ++pos;
+                    ++pos;
+                }
+                if (pos > c.data.size()) continue;
+                if (!compressed) value.assign(p + pos, p + c.data.size());
+                else if (!inflate_text(p + pos, c.data.size() - pos, value)) continue;
+            }
+            text[key] = value;
+        }
+        return text;
+    }
+
+    // Chunks of a PNG file whose type want accepts; the others, image data
+    // included, are skipped over without being read
+    static bool scan_png_file(const fs::path& file, const std::function<bool(const std::string&)>& want,
+        std::vector<PngChunk>& chunks)
+    {
+        std::error_code ec;
+        const uintmax_t fileSize = fs::file_size(file, ec);
+        if (ec) return false;
+
+        std::ifstream in(file, std::ios::binary);
+        uint8_t head[8];
+        if (!in.read(reinterpret_cast<char*>(head), 8) || std::memcmp(head, kSignature, 8) != 0)
+            return false;
+
+        uintmax_t pos = 8;
+        while (in.read(reinterpret_cast<char*>(head), 8)) {
+            pos += 8;
+            const uint32_t size = be32(head);
+            const std::string type(reinterpret_cast<const char*>(head + 4), 4);
+            if (type == "IEND") return true;
+
+            // A corrupt length must not size the buffer below
+            if (pos > fileSize || size > fileSize - pos || fileSize - pos - size < 4)
+                return false;
+            pos += static_cast<uintmax_t>(size) + 4;
+            if (!want(type)) {
+                in.seekg(static_cast<std::streamoff>(size) + 4, std::ios::cur);
+                continue;
+            }
+
+            PngChunk chunk{ type, std::vector<uint8_t>(size) };
+            uint8_t crc[4];
+            if (!in.read(reinterpret_cast<char*>(chunk.data.data()), size) ||
+                !in.read(reinterpret_cast<char*>(crc), 4) || be32(crc) != chunk_crc(type, chunk.data))
+                return false;
+            chunks.push_back(std::move(chunk));
+        }
+        return false;
+    }
+
+    bool read_png_text(const fs::path& file, std::map<std::string, std::string>& text)
+    {
+        std::vector<PngChunk> chunks;
+        if (!scan_png_file(file, is_text, chunks))
+            return false;
+        text = png_text(chunks);
+        return true;
+    }
+
+    bool carry_png_metadata(const fs::path& source, const fs::path& output,
+        const std::map<std::string, std::string>& text)
+    {
+        std::vector<PngChunk> extra;
+        if (scan_png_file(source, [](const std::string& type) { return (type[0] & 0x20) != 0; }, extra))
+            extra = portable_chunks(extra);
+        else
+            extra.clear();
+        for (const auto& kv : text)
+            extra.push_back(text_chunk(kv.first, kv.second));
+
+        std::vector<uint8_t> data;
+        {
+            std::ifstream in(output, std::ios::binary);
+            if (!in) return false;
+            data.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+        }
+        std::vector<PngChunk> chunks;
+        if (!split_png(data, chunks))
+            return false;
+
+        merge_chunks(chunks, extra);
+        return replace_file(output, join_png(chunks));
+    }
+
+    void keep_png_metadata(const std::vector<uint8_t>& original, std::vector<uint8_t>& encoded)
+    {
+        std::vector<PngChunk> from, to;
+        if (!split_png(original, from) || !split_png(encoded, to))
+            return;
+        merge_chunks(to, portable_chunks(from));
+        encoded = join_png(to);
+    }
+}
@@ -0,0 +1,53 @@
+#pragma once
+#include <cstdint>
+#include <filesystem>
+#include <map>
+#include <string>
+#include <vector>
+
+// PNG at the chunk level: files are split into chunks and put back together
+// without inflating or decoding the image data, so metadata can be copied
+// between files, read and written for the cost of a file copy.
+namespace scout
+{
+    namespace fs = std::filesystem;
+
+    struct PngChunk
+    {
+        std::string type;              // four letters
+        std::vector<uint8_t> data;
+    };
+
+    // False when data isn't a PNG or a chunk is truncated or fails its CRC
+    bool split_png(const std::vector<uint8_t>& data, std::vector<PngChunk>& chunks);
+    std::vector<uint8_t> join_png(const std::vector<PngChunk>& chunks);
+
+    // The ancillary chunks of an image that still hold for another image
+    // with the same content: the colour space (iCCP, sRGB, gAMA, cHRM) and
+    // every safe-to-copy chunk (pHYs, tEXt, zTXt, iTXt, eXIf...). Chunks tied
+    // to the pixel encoding (bKGD, sBIT, hIST, tIME...) are left out.
+    std::vector<PngChunk> portable_chunks(const std::vector<PngChunk>& chunks);
+
+    // Insert extra after IHDR, dropping what it replaces in chunks: the
+    // whole colour space when extra has one, text with the same keyword, and
+    // other chunks of the same type
+    void merge_chunks(std::vector<PngChunk>& chunks, const std::vector<PngChunk>& extra);
+
+    // tEXt, or iTXt when value isn't plain ASCII (it is taken as UTF-8)
+    PngChunk text_chunk(const std::string& keyword, const std::string& value);
+
+    // Keyword -> value of every tEXt, zTXt and iTXt chunk, iTXt values as UTF-8
+    std::map<std::string, std::string> png_text(const std::vector<PngChunk>& chunks);
+
+    // The text of a PNG file, read chunk by chunk and seeking past the image
+    // data
+    bool read_png_text(const fs::path& file, std::map<std::string, std::string>& text);
+
+    // Rewrite output with the portable chunks of source and the given text,
+    // replacing the file by rename. The image data is copied as it is.
+    bool carry_png_metadata(const fs::path& source, const fs::path& output,
+        const std::map<std::string, std::string>& text);
+
+    // Move the portable chunks of original into a re-encoded copy of it
+    void keep_png_metadata(const std::vector<uint8_t>& original, std::vector<uint8_t>& encoded);
+}
@@ -0,0 +1,421 @@
+#include "png_codec.h"
+#include "cpu_dispatch.h"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <random>
+#include <string>
+#include <zlib.h>
+
+namespace scout
+{
+    static const uint8_t kSignature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+
+    static uint32_t be32(const uint8_t* p)
+    {
+        return (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) | (uint32_t(p[2]) << 8) | p[3];
+    }
+
+    static void put_be32(std::vector<uint8_t>& out, uint32_t v)
+    {
+        out.push_back(static_cast<uint8_t>(v >> 24));
+        out.push_back(static_cast<uint8_t>(v >> 16));
+        out.push_back(static_cast<uint8_t>(v >> 8));
+        out.push_back(static_cast<uint8_t>(v));
+    }
+
+    static void put_chunk(std::vector<uint8_t>& out, const char type[4], const uint8_t* data, size_t size)
+    {
+        put_be32(out, static_cast<uint32_t>(size));
+        const size_t start = out.size();
+        out.insert(out.end(), type, type + 4);
+        if (size) out.insert(out.end(), data, data + size);
+        put_be32(out, static_cast<uint32_t>(crc32(0, out.data() + start, static_cast<uInt>(size + 4))));
+    }
+
+    static int paeth(int a, int b, int c)
+    {
+        const int p = a + b - c;
+        const int pa = std::abs(p - a), pb = std::abs(p - b), pc = std::abs(p - c);
+        if (pa <= pb && pa <= pc) return a;
+        return pb <= pc ? b : c;
+    }
+
+    // Undo the per-row filters in place; bpp is bytes per pixel, at least 1
+    static bool unfilter(uint8_t* data, size_t rowBytes, int height, size_t bpp)
+    {
+        const uint8_t* prev = nullptr;
+        for (int y = 0; y < height; ++y) {
+            const uint8_t filter = data[0];
+            uint8_t* row = data + 1;
+            switch (filter) {
+            case 0:
+                break;
+            case 1:
+                for (size_t i = bpp; i < rowBytes; ++i) row[i] = static_cast<uint8_t>(row[i] + row[i - bpp]);
+                break;
+            case 2:
+                if (prev) for (size_t i = 0; i < rowBytes; ++i) row[i] = static_cast<uint8_t>(row[i] + prev[i]);
+                break;
+            case 3:
+                for (size_t i = 0; i < rowBytes; ++i) {
+                    const int left = i >= bpp ? row[i - bpp] : 0;
+                    const int up = prev ? prev[i] : 0;
+                    row[i] = static_cast<uint8_t>(row[i] + ((left + up) >> 1));
+                }
+                break;
+            case 4:
+                for (size_t i = 0; i < rowBytes; ++i) {
+                    const int left = i >= bpp ? row[i - bpp] : 0;
+                    const int up = prev ? prev[i] : 0;
+                    const int upLeft = prev && i >= bpp ? prev[i - bpp] : 0;
+                    row[i] = static_cast<uint8_t>(row[i] + paeth(left, up, upLeft));
+                }
+                break;
+            default:
+                return false;
+            }
+            prev = row;
+            data += rowBytes + 1;
+        }
+        return true;
+    }
+
+    bool decode_png(const std::vector<uint8_t>& data, Image& image)
+    {
+        if (data.size() < 8 + 25 || std::memcmp(data.data(), kSignature, 8) != 0)
+            return false;
+
+        int width = 0, height = 0, depth = 0, colourType = -1;
+        uint8_t palette[256 * 4];
+        int paletteSize = 0;
+        bool hasKey = false;
+        uint16_t key[3] = {};
+        std::vector<uint8_t> idat;
+
+        size_t pos = 8;
+        bool ended = false;
+        while (!ended && pos + 12 <= data.size()) {
+            const uint32_t size = be32(&data[pos]);
+            if (size > data.size() - pos - 12) return false;
+            const uint8_t* type = &data[pos + 4];
+            const uint8_t* body = &data[pos + 8];
+            if (be32(body + size) != static_cast<uint32_t>(crc32(0, type, size + 4)))
+                return false;
+
+            if (std::memcmp(type, "IHDR", 4) == 0) {
+                if (size != 13) return false;
+                width = static_cast<int>(be32(body));
+                height = static_cast<int>(be32(body + 4));
+                depth = body[8];
+                colourType = body[9];
+                if (body[10] != 0 || body[11] != 0 || body[12] != 0)
+                    return false;   // unknown method or interlaced
+            }
+            else if (std::memcmp(type, "PLTE", 4) == 0) {
+                if (size % 3 || size > 256 * 3) return false;
+                paletteSize = static_cast<int>(size / 3);
+                for (int i = 0; i < paletteSize; ++i) {
+                    std::memcpy(&palette[i * 4], body + i * 3, 3);
+                    palette[i * 4 + 3] = 255;
+                }
+            }
+            else if (std::memcmp(type, "tRNS", 4) == 0) {
+                if (colourType == 3) {
+                    for (uint32_t i = 0; i < size && i < static_cast<uint32_t>(paletteSize); ++i)
+                        palette[i * 4 + 3] = body[i];
+                }
+                else if ((colourType == 0 && size == 2) || (colourType == 2 && size == 6)) {
+                    hasKey = true;
+                    for (uint32_t i = 0; i < size / 2; ++i)
+                        key[i] = static_cast<uint16_t>((body[i * 2] << 8) | body[i * 2 + 1]);
+                }
+            }
+            else if (std::memcmp(type, "IDAT", 4) == 0) {
+                idat.insert(idat.end(), body, body + size);
+            }
+            else if (std::memcmp(type, "IEND", 4) == 0) {
+                ended = true;
+            }
+            pos += 12 + size;
+        }
+
+        int channels = 0;
+        switch (colourType) {
+        case 0: channels = 1; if (depth != 1 && depth != 2 && depth != 4 && depth != 8) return false; break;
+        case 3: channels = 1; if (depth != 1 && depth != 2 && depth != 4 && depth != 8) return false; break;
+        case 2: channels = 3; if (depth != 8) return false; break;
+        case 4: channels = 2; if (depth != 8) return false; break;
+        case 6: channels = 4; if (depth != 8) return false; break;
+        default: return false;
+        }
+        if (width <= 0 || height <= 0 || static_cast<uint64_t>(width) * height > (1u << 28))
+            return false;
+        if (colourType == 3 && paletteSize == 0)
+            return false;
+
+        const size_t rowBytes = (static_cast<size_t>(width) * channels * depth + 7) / 8;
+        std::vector<uint8_t> raw((rowBytes + 1) * height);
+
+        z_stream zs{};
+        if (inflateInit(&zs) != Z_OK) return false;
+        zs.next_in = idat.data();
+        zs.avail_in = static_cast<uInt>(idat.size());
+        zs.next_out = raw.data();
+        zs.avail_out = static_cast<uInt>(raw.size());
+        const int rc = inflate(&zs, Z_FINISH);
+        inflateEnd(&zs);
+        if (rc != Z_STREAM_END || zs.avail_out != 0)
+            return false;
+
+        const size_t bpp = std::max<size_t>(1, static_cast<size_t>(channels) * depth / 8);
+        if (!unfilter(raw.data(), rowBytes, height, bpp))
+            return false;
+
+        image = Image(width, height);
+        for (int y = 0; y < height; ++y) {
+            const uint8_t* in = raw.data() + y * (rowBytes + 1) + 1;
+            uint8_t* out = image.view().row(y);
+            switch (colourType) {
+            case 0:
+            case 3: {
+                // Samples below 8 bits are packed from the high bit down
+                const int perByte = 8 / depth;
+                const int mask = (1 << depth) - 1;
+                for (int x = 0; x < width; ++x) {
+                    const int shift = (perByte - 1 - x % perByte) * depth;
+                    const int v = (in[x / perByte] >> shift) & mask;
+                    uint8_t* px = out + x * 4;
+                    if (colourType == 3) {
+                        if (v >= paletteSize) return false;
+                        std::memcpy(px, &palette[v * 4], 4);
+                    }
+                    else {
+                        const uint8_t g = static_cast<uint8_t>(v * 255 / mask);
+                        px[0] = px[1] = px[2] = g;
+                        px[3] = hasKey && v == key[0] ? 0 : 255;
+                    }
+                }
+                break;
+            }
+            case 2:
+                for (int x = 0; x < width; ++x) {
+                    const uint8_t* s = in + x * 3;
+                    uint8_t* px = out + x * 4;
+                    px[0] = s[0]; px[1] = s[1]; px[2] = s[2];
+                    px[3] = hasKey && s[0] == key[0] && s[1] == key[1] && s[2] == key[2] ? 0 : 255;
+                }
+                break;
+            case 4:
+                for (int x = 0; x < width; ++x) {
+                    uint8_t* px = out + x * 4;
+                    px[0] = px[1] = px[2] = in[x * 2];
+                    px[3] = in[x * 2 + 1];
+                }
+                break;
+            case 6:
+                std::memcpy(out, in, static_cast<size_t>(width) * 4);
+                break;
+            }
+        }
+        return true;
+    }
+
+    bool read_png(const fs::path& file, Image& image)
+    {
+        std::ifstream in(file, std::ios::binary);
+        if (!in) return false;
+        std::vector<uint8_t> data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+        return !in.bad() && decode_png(data, image);
+    }
+
+    static void put_ihdr(std::vector<uint8_t>& out, int width, int height, int depth, int colourType)
+    {
+        std::vector<uint8_t> ihdr;
+        put_be32(ihdr, static_cast<uint32_t>(width));
+        put_be32(ihdr, static_cast<uint32_t>(height));
+        ihdr.push_back(static_cast<uint8_t>(depth));
+        ihdr.push_back(static_cast<uint8_t>(colourType));
+        ihdr.insert(ihdr.end(), 3, 0);   // deflate, adaptive filtering, no interlace
+        put_chunk(out, "IHDR", ihdr.data(), ihdr.size());
+    }
+
+    static bool deflate_into(std::vector<uint8_t>& out, std::vector<uint8_t>& raw, int level)
+    {
+        // The largest hash memory from level 9 up, as the recompression
+        // pass asks for the smallest file rather than the fastest
+        z_stream zs{};
+        if (deflateInit2(&zs, level, Z_DEFLATED, 15, level >= 9 ? 9 : 8, Z_DEFAULT_STRATEGY) != Z_OK)
+            return false;
+        std::vector<uint8_t> packed(deflateBound(&zs, static_cast<uLong>(raw.size())));
+        zs.next_in = raw.data();
+        zs.avail_in = static_cast<uInt>(raw.size());
+        zs.next_out = packed.data();
+        zs.avail_out = static_cast<uInt>(packed.size());
+        const int rc = deflate(&zs, Z_FINISH);
+        const size_t size = packed.size() - zs.avail_out;
+        deflateEnd(&zs);
+        if (rc != Z_STREAM_END)
+            return false;
+        put_chunk(out, "IDAT", packed.data(), size);
+        return true;
+    }
+
+    std::vector<uint8_t> encode_png(const IndexedImage& image, int level)
+    {
+        const size_t colours = image.palette.size() / 4;
+        const int depth = colours <= 2 ? 1 : colours <= 4 ? 2 : colours <= 16 ? 4 : 8;
+        const size_t rowBytes = (static_cast<size_t>(image.width) * depth + 7) / 8;
+
+        // Palette rows compress best unfiltered
+        std::vector<uint8_t> raw((rowBytes + 1) * image.height, 0);
+        for (int y = 0; y < image.height; ++y) {
+            const uint8_t* in = image.indices.data() + static_cast<size_t>(y) * image.width;
+            uint8_t* out = raw.data() + y * (rowBytes + 1) + 1;
+            if (depth == 8) {
+                std::memcpy(out, in, image.width);
+                continue;
+            }
+            const int perByte = 8 / depth;
+            for (int x = 0; x < image.width; ++x)
+                out[x / perByte] |= static_cast<uint8_t>(in[x] << ((perByte - 1 - x % perByte) * depth));
+        }
+
+        std::vector<uint8_t> out(kSignature, kSignature + 8);
+        put_ihdr(out, image.width, image.height, depth, 3);
+
+        std::vector<uint8_t> plte, trns;
+        for (size_t i = 0; i < colours; ++i) {
+            plte.insert(plte.end(), &image.palette[i * 4], &image.palette[i * 4] + 3);
+            trns.push_back(image.palette[i * 4 + 3]);
+        }
+        while (!trns.empty() && trns.back() == 255) trns.pop_back();
+        put_chunk(out, "PLTE", plte.data(), plte.size());
+        if (!trns.empty()) put_chunk(out, "tRNS", trns.data(), trns.size());
+
+        if (!deflate_into(out, raw, level))
+            return {};
+        put_chunk(out, "IEND", nullptr, 0);
+        return out;
+    }
+
+    // Filter one row of bytes; prev is null for the first row
+    static void filter_row(PngFilter filter, const uint8_t* row, const uint8_t* prev, size_t size,
+        size_t bpp, uint8_t* out, const PixelKernels& kernels)
+    {
+        // Sub and Up are plain byte differences, with nothing to the left
+        // of the first pixel and above the first row
+        if (filter == PngFilter::None || (filter == PngFilter::Up && !prev)) {
+            std::memcpy(out, row, size);
+            return;
+        }
+        if (filter == PngFilter::Up) {
+            kernels.subtract_bytes(row, prev, size, out);
+            return;
+        }
+        if (filter == PngFilter::Sub) {
+            std::memcpy(out, row, std::min(bpp, size));
+            if (size > bpp) kernels.subtract_bytes(row + bpp, row, size - bpp, out + bpp);
+            return;
+        }
+
+        for (size_t i = 0; i < size; ++i) {
+            const int left = i >= bpp ? row[i - bpp] : 0;
+            const int up = prev ? prev[i] : 0;
+            const int upLeft = prev && i >= bpp ? prev[i - bpp] : 0;
+            int predicted = 0;
+            switch (filter) {
+            case PngFilter::Sub:     predicted = left; break;
+            case PngFilter::Up:      predicted = up; break;
+            case PngFilter::Average: predicted = (left + up) >> 1; break;
+            case PngFilter::Paeth:   predicted = paeth(left, up, upLeft); break;
+            default: break;
+            }
+            out[i] = static_cast<uint8_t>(row[i] - predicted);
+        }
+    }
+
+    std::vector<uint8_t> encode_png(const ImageView& image, int level, PngFilter filter)
+    {
+        bool opaque = true, grey = true;
+        for (int y = 0; y < image.height && (opaque || grey); ++y) {
+            const uint8_t* p = image.row(y);
+            for (int x = 0; x < image.width; ++x, p += 4) {
+                opaque = opaque && p[3] == 255;
+                grey = grey && p[0] == p[1] && p[1] == p[2];
+            }
+        }
+        const int colourType = grey ? (opaque ? 0 : 4) : (opaque ? 2 : 6);
+        const size_t channels = grey ? (opaque ? 1 : 2) : (opaque ? 3 : 4);
+        const size_t rowBytes = static_cast<size_t>(image.width) * channels;
+
+        std::vector<uint8_t> raw((rowBytes + 1) * image.height);
+        std::vector<uint8_t> packed(rowBytes), prev(rowBytes), trial(rowBytes), best(rowBytes);
+        const PixelKernels& kernels = pixel_kernels();
+        for (int y = 0; y < image.height; ++y) {
+            const uint8_t* p = image.row(y);
+            for (int x = 0; x < image.width; ++x, p += 4) {
+                uint8_t* d = &packed[x * channels];
+                if (grey) {
+                    d[0] = p[0];
+                    if (!opaque) d[1] = p[3];
+                }
+                else {
+                    d[0] = p[0]; d[1] = p[1]; d[2] = p[2];
+                    if (!opaque) d[3] = p[3];
+                }
+            }
+
+            const uint8_t* up = y > 0 ? prev.data() : nullptr;
+            uint8_t* out = raw.data() + y * (rowBytes + 1);
+            if (filter != PngFilter::Adaptive) {
+                out[0] = static_cast<uint8_t>(filter);
+                filter_row(filter, packed.data(), up, rowBytes, channels, out + 1, kernels);
+            }
+            else {
+                uint64_t bestCost = UINT64_MAX;
+                for (int f = 0; f < 5; ++f) {
+                    filter_row(static_cast<PngFilter>(f), packed.data(), up, rowBytes, channels, trial.data(), kernels);
+                    const uint64_t cost = kernels.filter_cost(trial.data(), rowBytes);
+                    if (cost < bestCost) {
+                        bestCost = cost;
+                        out[0] = static_cast<uint8_t>(f);
+                        best.swap(trial);
+                    }
+                }
+                std::memcpy(out + 1, best.data(), rowBytes);
+            }
+            prev.swap(packed);
+        }
+
+        std::vector<uint8_t> out(kSignature, kSignature + 8);
+        put_ihdr(out, image.width, image.height, 8, colourType);
+        if (!deflate_into(out, raw, level))
+            return {};
+        put_chunk(out, "IEND", nullptr, 0);
+        return out;
+    }
+
+    bool replace_file(const fs::path& file, const std::vector<uint8_t>& data)
+    {
+        std::random_device rd;
+        fs::path tmp = file;
+        tmp += "." + std::to_string(rd()) + ".tmp";
+        {
+            std::ofstream out(tmp, std::ios::binary);
+            out.write(reinterpret_cast<const char*>(data.data()), static_cast<std::streamsize>(data.size()));
+            if (!out) {
+                out.close();
+                std::error_code ec;
+                fs::remove(tmp, ec);
+                return false;
+            }
+        }
+        std::error_code ec;
+        fs::rename(tmp, file, ec);
+        if (!ec) return true;
+        fs::remove(tmp, ec);
+        return false;
+    }
+}
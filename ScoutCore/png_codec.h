@@ -0,0 +1,45 @@
+#pragma once
+#include "pixel_ops.h"
+#include <cstdint>
+#include <filesystem>
+#include <vector>
+
+// Just enough PNG, on top of zlib, for the steps that work on decoded pixels
+// between ImageMagick calls. Reads non-interlaced 8-bit (and 1/2/4-bit grey
+// or palette) images of every colour type into RGBA; writes indexed and
+// 8-bit truecolour images.
+namespace scout
+{
+    namespace fs = std::filesystem;
+
+    // A palette image: indices into palette, one byte per pixel
+    struct IndexedImage
+    {
+        int width = 0, height = 0;
+        std::vector<uint8_t> palette;   // RGBA, 4 bytes per entry, at most 256
+        std::vector<uint8_t> indices;   // width * height
+    };
+
+    // False for anything that isn't a PNG this reader handles (16-bit,
+    // interlaced, corrupt)
+    bool decode_png(const std::vector<uint8_t>& data, Image& image);
+    bool read_png(const fs::path& file, Image& image);
+
+    // Smallest bit depth that holds the palette; PLTE plus a tRNS chunk
+    // covering the leading entries that aren't opaque
+    std::vector<uint8_t> encode_png(const IndexedImage& image, int level = 6);
+
+    // Row filter for truecolour images; Adaptive picks, per row, the one
+    // with the smallest sum of absolute differences
+    enum class PngFilter { None, Sub, Up, Average, Paeth, Adaptive };
+
+    // Written as grey, grey + alpha, RGB or RGBA, whichever is the smallest
+    // that holds every pixel exactly
+    std::vector<uint8_t> encode_png(const ImageView& image, int level = 6,
+        PngFilter filter = PngFilter::Adaptive);
+
+    // Write data beside file and rename it over the original, so readers
+    // never see a half-written file and a hardlink to the old file is left
+    // alone
+    bool replace_file(const fs::path& file, const std::vector<uint8_t>& data);
+}
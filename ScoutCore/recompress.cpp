@@ -0,0 +1,187 @@
+#include "recompress.h"
+#include "decoded_cache.h"
+#include "palette.h"
+#include "png_chunks.h"
+#include "png_codec.h"
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#elif defined(__linux__)
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace scout
+{
+    // Background CPU and I/O priority for the calling thread, so the pass
+    // never competes with the user or with a batch
+    static void lower_thread_priority()
+    {
+#ifdef _WIN32
+        SetThreadPriority(GetCurrentThread(), THREAD_MODE_BACKGROUND_BEGIN);
+#elif defined(__linux__)
+        const auto tid = static_cast<id_t>(syscall(SYS_gettid));
+        setpriority(PRIO_PROCESS, tid, 19);
+#ifdef SYS_ioprio_set
+        // IOPRIO_WHO_PROCESS for this thread, IOPRIO_CLASS_IDLE
+        syscall(SYS_ioprio_set, 1, static_cast<int>(tid), 3 << 13);
+#endif
+#endif
+    }
+
+    RecompressOutcome recompress_png(const fs::path& file, uintmax_t& before, uintmax_t& after)
+    {
+        std::error_code ec;
+        const auto stamp = fs::last_write_time(file, ec);
+        if (ec) return RecompressOutcome::Failed;
+
+        std::vector<uint8_t> data;
+        const auto decoded = decoded_images().get(file, data);
+        before = after = data.size();
+        if (data.empty())
+            return RecompressOutcome::Failed;
+        if (!decoded)
+            return RecompressOutcome::Unchanged;
+        const Image& image = *decoded;
+
+        // Indexed when the colours allow, and both filter extremes for
+        // truecolour; whichever is smallest wins
+        std::vector<uint8_t> best;
+        auto consider = [&](std::vector<uint8_t> candidate) {
+            if (!candidate.empty() && (best.empty() || candidate.size() < best.size()))
+                best.swap(candidate);
+        };
+        IndexedImage indexed;
+        if (index_exact(image.view(), indexed))
+            consider(encode_png(indexed, 9));
+        consider(encode_png(image.view(), 9, PngFilter::Adaptive));
+        consider(encode_png(image.view(), 9, PngFilter::None));
+        keep_png_metadata(data, best);
+        if (best.empty() || best.size() >= data.size())
+            return RecompressOutcome::Unchanged;
+
+        Image check;
+        if (!decode_png(best, check) || check.width != image.width || check.height != image.height ||
+            check.pixels != image.pixels)
+            return RecompressOutcome::Failed;
+
+        // Written again (by a later run or the service) while we worked
+        if (fs::last_write_time(file, ec) != stamp || ec || fs::file_size(file, ec) != data.size())
+            return RecompressOutcome::Unchanged;
+
+        if (!replace_file(file, best))
+            return RecompressOutcome::Failed;
+        decoded_images().put(file, decoded);
+        after = best.size();
+        return RecompressOutcome::Smaller;
+    }
+
+    RecompressQueue::RecompressQueue()
+        : m_thread([this] { worker(); })
+    {}
+
+    RecompressQueue::~RecompressQueue()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stopping = true;
+        }
+        m_changed.notify_all();
+        m_thread.join();
+    }
+
+    void RecompressQueue::add(const std::vector<fs::path>& files)
+    {
+        if (files.empty()) return;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            for (const auto& f : files)
+                if (has_png_ext(f)) {
+                    m_queue.push_back(f);
+                    ++m_queued;
+                }
+        }
+        m_changed.notify_all();
+    }
+
+    void RecompressQueue::pause()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        ++m_paused;
+    }
+
+    void RecompressQueue::resume()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (m_paused) --m_paused;
+        }
+        m_changed.notify_all();
+    }
+
+    void RecompressQueue::wait(const std::function<void(size_t, size_t)>& progress)
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        size_t reported = m_stats.done;
+        while (true) {
+            m_changed.wait(lock, [&] {
+                return m_stats.done != reported || (m_queue.empty() && !m_busy) || m_stopping;
+            });
+            reported = m_stats.done;
+            const size_t done = m_stats.done, queued = m_queued;
+            const bool finished = (m_queue.empty() && !m_busy) || m_stopping;
+            if (progress) {
+                lock.unlock();
+                progress(done, queued);
+                lock.lock();
+            }
+            if (finished) return;
+        }
+    }
+
+    size_t RecompressQueue::pending() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_queue.size() + (m_busy ? 1 : 0);
+    }
+
+    RecompressStats RecompressQueue::stats() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_stats;
+    }
+
+    void RecompressQueue::worker()
+    {
+        lower_thread_priority();
+
+        std::unique_lock<std::mutex> lock(m_mutex);
+        while (true) {
+            m_changed.wait(lock, [&] { return m_stopping || (!m_queue.empty() && m_paused == 0); });
+            if (m_stopping) return;
+
+            const fs::path file = m_queue.front();
+            m_queue.pop_front();
+            m_busy = true;
+            lock.unlock();
+
+            uintmax_t before = 0, after = 0;
+            RecompressOutcome outcome;
+            try { outcome = recompress_png(file, before, after); }
+            catch (const std::exception&) { outcome = RecompressOutcome::Failed; }
+
+            lock.lock();
+            m_busy = false;
+            ++m_stats.done;
+            if (outcome == RecompressOutcome::Smaller) ++m_stats.smaller;
+            if (outcome == RecompressOutcome::Failed) ++m_stats.failed;
+            m_stats.bytesBefore += before;
+            m_stats.bytesAfter += after;
+            m_changed.notify_all();
+        }
+    }
+}
@@ -0,0 +1,71 @@
+#pragma once
+#include "scout_pipeline.h"
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+// Deferred lossless recompression of finished outputs. The main run writes
+// PNGs at ImageMagick's default effort; afterwards, or while the service has
+// nothing to do, a background thread at the lowest CPU and I/O priority
+// re-encodes them at the highest effort and swaps in whatever is smaller.
+namespace scout
+{
+    enum class RecompressOutcome { Smaller, Unchanged, Failed };
+
+    // Re-encode the PNG at file at the highest effort, as indexed when it
+    // has at most 256 colours and otherwise in the smallest colour type, and
+    // keep the smallest result with the original's metadata. It only
+    // replaces the file (by rename) when it is smaller, decodes to exactly
+    // the same pixels, and the file hasn't changed in the meantime. before
+    // and after are the file sizes.
+    RecompressOutcome recompress_png(const fs::path& file, uintmax_t& before, uintmax_t& after);
+
+    struct RecompressStats
+    {
+        size_t done = 0, smaller = 0, failed = 0;
+        uintmax_t bytesBefore = 0, bytesAfter = 0;
+    };
+
+    class RecompressQueue
+    {
+    public:
+        // Starts the worker thread
+        RecompressQueue();
+        // Stops after the file in hand; files still queued are left as they
+        // are, which is always safe
+        ~RecompressQueue();
+
+        RecompressQueue(const RecompressQueue&) = delete;
+        RecompressQueue& operator=(const RecompressQueue&) = delete;
+
+        void add(const std::vector<fs::path>& files);
+
+        // Hold the queue while foreground work runs; calls nest, and the
+        // queue goes on once every pause() has had its resume()
+        void pause();
+        void resume();
+
+        // Block until every queued file is done, calling progress with
+        // (done, queued so far) after each one
+        void wait(const std::function<void(size_t, size_t)>& progress = {});
+
+        size_t pending() const;
+        RecompressStats stats() const;
+
+    private:
+        void worker();
+
+        mutable std::mutex m_mutex;
+        std::condition_variable m_changed;
+        std::deque<fs::path> m_queue;
+        size_t m_paused = 0;
+        size_t m_queued = 0;
+        bool m_busy = false;
+        bool m_stopping = false;
+        RecompressStats m_stats;
+        std::thread m_thread;
+    };
+}
@@ -0,0 +1,297 @@
+#include "scout_core.h"
+#include "scout_pipeline.h"
+#include "docx_report.h"
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <string>
+
+namespace fs = std::filesystem;
+
+static thread_local std::string lastError;
+
+static scout_status fail(scout_status status, const std::string& message)
+{
+    lastError = message;
+    return status;
+}
+
+static fs::path from_utf8(const char* s)
+{
+#ifdef __cpp_char8_t
+    return fs::path(std::u8string(reinterpret_cast<const char8_t*>(s)));
+#else
+    return fs::u8path(s);
+#endif
+}
+
+static std::string to_utf8(const fs::path& p)
+{
+#ifdef __cpp_char8_t
+    std::u8string s = p.u8string();
+    return std::string(s.begin(), s.end());
+#else
+    return p.u8string();
+#endif
+}
+
+// True when the caller's struct is large enough to contain member
+#define SCOUT_HAS_FIELD(options, member) \
+    ((options)->struct_size >= offsetof(scout_options, member) + sizeof((options)->member))
+
+static bool to_options(const scout_options* in, scout::Options& out)
+{
+    if (!in || in->struct_size < offsetof(scout_options, cache_dir))
+        return false;
+
+    out.modulate = in->apply_modulate != 0;
+    out.mp.brightness = in->brightness;
+    out.mp.saturation = in->saturation;
+    out.mp.hue = in->hue;
+    out.legend = in->apply_legend != 0;
+    out.cropLegendFirst = in->crop_legend != 0;
+    out.legendPercent = in->legend_scale_percent;
+    out.edge = static_cast<scout::Edge>(in->legend_edge);
+    if (SCOUT_HAS_FIELD(in, cache_dir) && in->cache_dir)
+        out.cacheDir = from_utf8(in->cache_dir);
+    if (SCOUT_HAS_FIELD(in, legend_source)) {
+        if (in->legend_source < SCOUT_LEGEND_FILE || in->legend_source > SCOUT_LEGEND_FILE_OR_SCALE)
+            return false;
+        out.legendSource = static_cast<scout::LegendSource>(in->legend_source);
+    }
+    if (SCOUT_HAS_FIELD(in, stamp_corner)) {
+        if (in->stamp_corner < SCOUT_CORNER_TOP_LEFT || in->stamp_corner > SCOUT_CORNER_BOTTOM_RIGHT)
+            return false;
+        out.stamp.enabled = in->stamp_metadata != 0;
+        out.stamp.corner = static_cast<scout::Corner>(in->stamp_corner);
+    }
+    if (SCOUT_HAS_FIELD(in, legend_placement)) {
+        if (in->legend_placement < SCOUT_PLACEMENT_OVERLAY || in->legend_placement > SCOUT_PLACEMENT_EXTEND)
+            return false;
+        out.placement = static_cast<scout::LegendPlacement>(in->legend_placement);
+    }
+    if (SCOUT_HAS_FIELD(in, palette)) {
+        if (in->palette < SCOUT_PALETTE_OFF || in->palette > SCOUT_PALETTE_REDUCE)
+            return false;
+        out.palette = static_cast<scout::PaletteMode>(in->palette);
+    }
+    // Callers from before version 6 get the untagged outputs they always had
+    out.metadata = SCOUT_HAS_FIELD(in, keep_metadata) && in->keep_metadata != 0;
+
+    return scout::options_in_range(out) &&
+        in->legend_edge >= SCOUT_EDGE_TOP && in->legend_edge <= SCOUT_EDGE_LEFT;
+}
+
+// Shared by the batch entry points: run the pipeline, forward items to the
+// C callback and turn the outcome into a status
+static scout_status run_batch(const std::vector<fs::path>& sources, const scout::Options& options,
+    scout_item_callback callback, void* user, const fs::path& manifestRoot)
+{
+    bool cancelled = false;
+    bool failed = false;
+
+    auto written = scout::process_batch(sources, options, [&](const scout::ItemResult& r) {
+        if (r.outcome == scout::Outcome::Failed) failed = true;
+        if (!callback) return true;
+
+        const std::string input = to_utf8(r.input);
+        const std::string output = to_utf8(r.output);
+        scout_item item{};
+        item.stage = static_cast<scout_stage>(r.stage);
+        item.outcome = static_cast<scout_outcome>(r.outcome);
+        item.input = input.c_str();
+        item.output = output.c_str();
+        item.index = r.index;
+        item.total = r.total;
+
+        cancelled = callback(user, &item) != 0;
+        return !cancelled;
+    });
+
+    if (!manifestRoot.empty())
+        scout::record_outputs(manifestRoot, written);
+
+    if (cancelled) return fail(SCOUT_ERR_CANCELLED, "cancelled by callback");
+    if (failed) return fail(SCOUT_ERR_PROCESS, "one or more images failed to process");
+    return SCOUT_OK;
+}
+
+extern "C"
+{
+    int scout_api_version(void)
+    {
+        return SCOUT_API_VERSION;
+    }
+
+    const char* scout_last_error(void)
+    {
+        return lastError.c_str();
+    }
+
+    void scout_default_options(scout_options* options)
+    {
+        if (!options) return;
+
+        const scout::Options defaults;
+        std::memset(options, 0, sizeof(*options));
+        options->struct_size = sizeof(*options);
+        options->apply_modulate = defaults.modulate;
+        options->brightness = defaults.mp.brightness;
+        options->saturation = defaults.mp.saturation;
+        options->hue = defaults.mp.hue;
+        options->apply_legend = defaults.legend;
+        options->crop_legend = defaults.cropLegendFirst;
+        options->legend_scale_percent = defaults.legendPercent;
+        options->legend_edge = static_cast<scout_edge>(defaults.edge);
+        options->cache_dir = nullptr;
+        options->legend_source = static_cast<scout_legend_source>(defaults.legendSource);
+        options->stamp_metadata = defaults.stamp.enabled;
+        options->stamp_corner = static_cast<scout_corner>(defaults.stamp.corner);
+        options->legend_placement = static_cast<scout_legend_placement>(defaults.placement);
+        options->palette = static_cast<scout_palette_mode>(defaults.palette);
+        options->keep_metadata = defaults.metadata;
+    }
+
+    scout_status scout_process_file(const char* source, const scout_options* options)
+    {
+        try {
+            scout::Options opts;
+            if (!source || !to_options(options, opts))
+                return fail(SCOUT_ERR_ARGUMENT, "invalid source or options");
+
+            fs::path p = from_utf8(source);
+            if (!fs::is_regular_file(p))
+                return fail(SCOUT_ERR_IO, "source not found: " + std::string(source));
+            return run_batch({ p }, opts, nullptr, nullptr, {});
+        }
+        catch (const std::exception& e) {
+            return fail(SCOUT_ERR_IO, e.what());
+        }
+        catch (...) {
+            return fail(SCOUT_ERR_IO, "unknown error");
+        }
+    }
+
+    scout_status scout_process_buffer(const unsigned char* image, size_t image_size,
+        const unsigned char* legend, size_t legend_size,
+        const scout_options* options, scout_buffer* out)
+    {
+        if (!image || image_size == 0 || !out)
+            return fail(SCOUT_ERR_ARGUMENT, "invalid image, output or options");
+
+        out->data = nullptr;
+        out->size = 0;
+
+        try {
+            scout::Options opts;
+            if (!to_options(options, opts))
+                return fail(SCOUT_ERR_ARGUMENT, "invalid image, output or options");
+
+            std::vector<unsigned char> in(image, image + image_size);
+            std::vector<unsigned char> legendData;
+            if (legend && legend_size)
+                legendData.assign(legend, legend + legend_size);
+
+            std::vector<unsigned char> result;
+            if (!scout::process_buffer(in, legendData.empty() ? nullptr : &legendData, opts, result))
+                return fail(SCOUT_ERR_PROCESS, "image processing failed");
+
+            out->data = static_cast<unsigned char*>(std::malloc(result.size()));
+            if (!out->data)
+                return fail(SCOUT_ERR_IO, "out of memory");
+            std::memcpy(out->data, result.data(), result.size());
+            out->size = result.size();
+            return SCOUT_OK;
+        }
+        catch (const std::exception& e) {
+            return fail(SCOUT_ERR_IO, e.what());
+        }
+        catch (...) {
+            return fail(SCOUT_ERR_IO, "unknown error");
+        }
+    }
+
+    void scout_free_buffer(scout_buffer* buffer)
+    {
+        if (!buffer) return;
+        std::free(buffer->data);
+        buffer->data = nullptr;
+        buffer->size = 0;
+    }
+
+    scout_status scout_process_tree(const char* root, const scout_options* options,
+        scout_item_callback callback, void* user)
+    {
+        try {
+            scout::Options opts;
+            if (!root || !to_options(options, opts))
+                return fail(SCOUT_ERR_ARGUMENT, "invalid root or options");
+
+            fs::path dir = from_utf8(root);
+            std::vector<fs::path> sources, generated;
+            scout::discover_pngs(dir, sources, generated);
+            return run_batch(sources, opts, callback, user, dir);
+        }
+        catch (const std::exception& e) {
+            return fail(SCOUT_ERR_IO, e.what());
+        }
+        catch (...) {
+            return fail(SCOUT_ERR_IO, "unknown error");
+        }
+    }
+
+    scout_status scout_clean_tree(const char* root, size_t* removed)
+    {
+        if (!root)
+            return fail(SCOUT_ERR_ARGUMENT, "invalid root");
+
+        try {
+            fs::path dir = from_utf8(root);
+            size_t failed = 0;
+            size_t count = scout::remove_files_parallel(scout::find_generated_outputs(dir), failed);
+            if (removed) *removed = count;
+
+            // Files that could not be removed stay listed for the next run
+            scout::prune_output_manifest(dir);
+
+            if (failed)
+                return fail(SCOUT_ERR_IO, std::to_string(failed) + " files could not be removed");
+            return SCOUT_OK;
+        }
+        catch (const std::exception& e) {
+            return fail(SCOUT_ERR_IO, e.what());
+        }
+        catch (...) {
+            return fail(SCOUT_ERR_IO, "unknown error");
+        }
+    }
+
+    scout_status scout_generate_report(const char* template_docx, const char* output_docx,
+        const scout_report_entry* entries, size_t count)
+    {
+        if (!template_docx || !output_docx || (count && !entries))
+            return fail(SCOUT_ERR_ARGUMENT, "invalid template, output or entries");
+
+        try {
+            std::vector<reportgen::Entry> list;
+            for (size_t i = 0; i < count; ++i) {
+                reportgen::Entry e;
+                e.header = entries[i].header ? entries[i].header : "";
+                e.description = entries[i].description ? entries[i].description : "";
+                if (entries[i].image_path) e.imagePath = from_utf8(entries[i].image_path);
+                list.push_back(std::move(e));
+            }
+
+            if (!reportgen::generateDocx(from_utf8(template_docx), from_utf8(output_docx), list))
+                return fail(SCOUT_ERR_IO, "report generation failed");
+            return SCOUT_OK;
+        }
+        catch (const std::exception& e) {
+            return fail(SCOUT_ERR_IO, e.what());
+        }
+        catch (...) {
+            return fail(SCOUT_ERR_IO, "unknown error");
+        }
+    }
+}
@@ -0,0 +1,158 @@
+#pragma once
+/*
+ * Stable C interface to the Scout processing core, for services that want to
+ * process captures in-process instead of spawning the interactive tool.
+ *
+ * All paths are UTF-8. Functions return SCOUT_OK or an error status; the
+ * message for the last error on the calling thread is available from
+ * scout_last_error(). Structures are only ever extended at the end and
+ * carry their size, so callers built against an older header keep working.
+ */
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define SCOUT_API_VERSION 6
+
+typedef enum scout_status
+{
+    SCOUT_OK = 0,
+    SCOUT_ERR_ARGUMENT = 1,   /* invalid or missing argument */
+    SCOUT_ERR_IO = 2,         /* a file could not be read or written */
+    SCOUT_ERR_PROCESS = 3,    /* an image step failed */
+    SCOUT_ERR_CANCELLED = 4   /* a callback asked to stop */
+} scout_status;
+
+typedef enum scout_edge
+{
+    SCOUT_EDGE_TOP = 0,
+    SCOUT_EDGE_RIGHT = 1,
+    SCOUT_EDGE_BOTTOM = 2,
+    SCOUT_EDGE_LEFT = 3
+} scout_edge;
+
+typedef enum scout_legend_source
+{
+    SCOUT_LEGEND_FILE = 0,         /* the *_Legend file next to each source */
+    SCOUT_LEGEND_HUE_SCALE = 1,    /* a hue scale drawn by the core */
+    SCOUT_LEGEND_FILE_OR_SCALE = 2 /* the file, or the drawn scale without one */
+} scout_legend_source;
+
+typedef enum scout_corner
+{
+    SCOUT_CORNER_TOP_LEFT = 0,
+    SCOUT_CORNER_TOP_RIGHT = 1,
+    SCOUT_CORNER_BOTTOM_LEFT = 2,
+    SCOUT_CORNER_BOTTOM_RIGHT = 3
+} scout_corner;
+
+typedef enum scout_legend_placement
+{
+    SCOUT_PLACEMENT_OVERLAY = 0,   /* legend painted over the image */
+    SCOUT_PLACEMENT_EXTEND = 1     /* canvas grown, legend beside the image */
+} scout_legend_placement;
+
+typedef enum scout_palette_mode
+{
+    SCOUT_PALETTE_OFF = 0,         /* truecolour outputs */
+    SCOUT_PALETTE_EXACT = 1,       /* indexed when at most 256 colours (lossless) */
+    SCOUT_PALETTE_REDUCE = 2       /* indexed, reduced to 256 colours if needed */
+} scout_palette_mode;
+
+typedef struct scout_options
+{
+    size_t struct_size;            /* sizeof(scout_options), set by scout_default_options */
+    int apply_modulate;            /* non-zero to write *_GreyFilter.png */
+    double brightness;             /* modulate values, default 75,125,100 */
+    double saturation;
+    double hue;
+    int apply_legend;              /* non-zero to write *_WithScale.png */
+    int crop_legend;               /* trim the legend before scaling */
+    int legend_scale_percent;      /* default 500 */
+    scout_edge legend_edge;        /* default SCOUT_EDGE_RIGHT */
+    const char* cache_dir;         /* shared output cache, NULL to disable */
+    scout_legend_source legend_source; /* since API version 2 */
+    int stamp_metadata;            /* write file, folder and time onto outputs made
+                                      from files (since API version 3) */
+    scout_corner stamp_corner;     /* default SCOUT_CORNER_BOTTOM_LEFT */
+    scout_legend_placement legend_placement; /* since API version 4 */
+    scout_palette_mode palette;    /* since API version 5 */
+    int keep_metadata;             /* copy the source's PNG metadata and record the
+                                      parameters in outputs (since API version 6) */
+} scout_options;
+
+typedef enum scout_stage
+{
+    SCOUT_STAGE_MODULATE = 0,
+    SCOUT_STAGE_LEGEND = 1
+} scout_stage;
+
+typedef enum scout_outcome
+{
+    SCOUT_OUTCOME_OK = 0,
+    SCOUT_OUTCOME_FAILED = 1,
+    SCOUT_OUTCOME_CACHE_HIT = 2,
+    SCOUT_OUTCOME_DUPLICATE = 3,
+    SCOUT_OUTCOME_SKIPPED = 4,
+    SCOUT_OUTCOME_NO_LEGEND = 5
+} scout_outcome;
+
+typedef struct scout_item
+{
+    scout_stage stage;
+    scout_outcome outcome;
+    const char* input;             /* valid only during the callback */
+    const char* output;
+    size_t index;                  /* position within the stage */
+    size_t total;
+} scout_item;
+
+/* Called after every item of a batch; return non-zero to cancel */
+typedef int (*scout_item_callback)(void* user, const scout_item* item);
+
+typedef struct scout_buffer
+{
+    unsigned char* data;
+    size_t size;
+} scout_buffer;
+
+typedef struct scout_report_entry
+{
+    const char* header;
+    const char* description;
+    const char* image_path;
+} scout_report_entry;
+
+int scout_api_version(void);
+const char* scout_last_error(void);
+
+void scout_default_options(scout_options* options);
+
+/* Write the outputs for one source next to it */
+scout_status scout_process_file(const char* source, const scout_options* options);
+
+/* Process an encoded image held in memory. legend may be NULL. On success
+   out receives a PNG that must be released with scout_free_buffer. */
+scout_status scout_process_buffer(const unsigned char* image, size_t image_size,
+    const unsigned char* legend, size_t legend_size,
+    const scout_options* options, scout_buffer* out);
+
+void scout_free_buffer(scout_buffer* buffer);
+
+/* Discover every source under root and process it like the interactive
+   tool does; callback may be NULL */
+scout_status scout_process_tree(const char* root, const scout_options* options,
+    scout_item_callback callback, void* user);
+
+/* Remove every output of earlier runs under root */
+scout_status scout_clean_tree(const char* root, size_t* removed);
+
+/* Fill a .docx report from a template */
+scout_status scout_generate_report(const char* template_docx, const char* output_docx,
+    const scout_report_entry* entries, size_t count);
+
+#ifdef __cplusplus
+}
+#endif
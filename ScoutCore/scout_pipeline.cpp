@@ -0,0 +1,1112 @@
+#include "scout_pipeline.h"
+#include "decoded_cache.h"
+#include "hue_scale.h"
+#include "output_cache.h"
+#include "palette.h"
+#include "png_chunks.h"
+#include "text_stamp.h"
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <set>
+#include <sstream>
+#include <thread>
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+namespace scout
+{
+    const char* const kToolVersion = "1.2";
+    const char* const kNativeVersion = "1";
+
+    const std::string kGreySuffix = "_GreyFilter";
+    const std::string kScaledSuffix = "_WithScale";
+    const std::string kTmpLegendName = "_tmp_legend_overlay.png";
+    const std::string kTmpScaleName = "_tmp_legend_overlay.pam";
+    const std::string kOutputManifestName = "_scout_outputs.txt";
+
+    // Run magick.exe with given arguments
+    bool run_magick(const std::string& args)
+    {
+#ifdef _WIN32
+        // Build full command line (convert to wide string)
+        std::wstring fullCmd = L"magick.exe " + std::wstring(args.begin(), args.end());
+
+        STARTUPINFOW si{};
+        PROCESS_INFORMATION pi{};
+        si.cb = sizeof(si);
+
+        if (!CreateProcessW(
+            nullptr,                         // Application name
+            fullCmd.data(),                  // Command line
+            nullptr, nullptr, FALSE, 0,
+            nullptr, nullptr, &si, &pi))
+        {
+            std::wcerr << L"[ERR] Failed to start: " << fullCmd << std::endl;
+            return false;
+        }
+
+        // Wait for process to finish
+        WaitForSingleObject(pi.hProcess, INFINITE);
+        DWORD exitCode = 1;
+        GetExitCodeProcess(pi.hProcess, &exitCode);
+        CloseHandle(pi.hProcess);
+        CloseHandle(pi.hThread);
+        return (exitCode == 0);
+#else
+        // fallback for non-Windows
+        std::string cmd = "\"magick.exe\" " + args;
+        int ret = std::system(cmd.c_str());
+        return (ret == 0);
+#endif
+    }
+
+    static bool ends_with(const std::string& s, const std::string& suffix)
+    {
+        return s.size() >= suffix.size() &&
+            s.compare(s.size() - suffix.size(), suffix.size(), suffix) == 0;
+    }
+
+    bool has_png_ext(const fs::path& p)
+    {
+        auto ext = p.extension().string();
+        std::transform(ext.begin(), ext.end(), ext.begin(), [](unsigned char c) { return (char)std::tolower(c); });
+        return (ext == ".png");
+    }
+
+    // True for files produced by an earlier run (*_GreyFilter.png, *_WithScale.png
+    // or a legend overlay or hue scale left behind by an interrupted run)
+    bool is_generated_output(const fs::path& p)
+    {
+        const std::string name = p.filename().string();
+        if (name == kTmpLegendName || name == kTmpScaleName) return true;
+        if (!has_png_ext(p)) return false;
+
+        std::string stem = p.stem().string();
+        return ends_with(stem, kGreySuffix) || ends_with(stem, kScaledSuffix);
+    }
+
+    fs::path output_grey_name(const fs::path& in)
+    {
+        fs::path out = in;
+        out.replace_filename(in.stem().string() + kGreySuffix + in.extension().string());
+        return out;
+    }
+
+    fs::path output_scaled_name(const fs::path& grey)
+    {
+        fs::path out = grey;
+        out.replace_filename(grey.stem().string() + kScaledSuffix + grey.extension().string());
+        return out;
+    }
+
+    fs::path legend_for_base(const fs::path& basePng)
+    {
+        const auto dir = basePng.parent_path();
+        const auto stem = basePng.stem().string();
+        fs::path bmp = dir / (stem + "_Legend.bmp");
+        fs::path png = dir / (stem + "_Legend.png");
+        if (fs::exists(bmp)) return bmp;
+        if (fs::exists(png)) return png;
+        return {};
+    }
+
+    void discover_pngs(const fs::path& root, std::vector<fs::path>& sources,
+        std::vector<fs::path>& generated)
+    {
+        const auto options = fs::directory_options::skip_permission_denied;
+        for (auto it = fs::recursive_directory_iterator(root, options); it != fs::recursive_directory_iterator(); ++it) {
+            if (!it->is_regular_file()) continue;
+            const fs::path& p = it->path();
+
+            if (is_generated_output(p)) {
+                generated.push_back(p);
+                continue;
+            }
+
+            // only .png files
+            if (!has_png_ext(p)) continue;
+
+            // skip previously processed images (_GreyFilter or _WithScale)
+            std::string stem = p.stem().string();
+            if (stem.find(kGreySuffix) != std::string::npos ||
+                stem.find(kScaledSuffix) != std::string::npos)
+                continue;
+
+            sources.push_back(p);
+        }
+    }
+
+    // Apply the modulate filter to a single image
+    bool apply_modulate(const fs::path& inPath, const fs::path& outPath, const ModulateParams& mp,
+        const fs::path& stampImage, Corner corner)
+    {
+        // Outputs may be hardlinks into the output cache; never write through them
+        std::error_code ec;
+        fs::remove(outPath, ec);
+
+        // Build command for ImageMagick
+        std::ostringstream ss;
+        ss << "\"" << inPath.string() << "\" -modulate "
+            << mp.brightness << "," << mp.saturation << "," << mp.hue;
+        if (!stampImage.empty()) {
+            static const char* const gravity[] = { "northwest", "northeast", "southwest", "southeast" };
+            ss << " \"" << stampImage.string() << "\" -gravity " << gravity[static_cast<int>(corner)] << " -composite";
+        }
+        ss << " \"" << outPath.string() << "\"";
+
+        return run_magick(ss.str());
+    }
+
+    // Trim, modulate and resize a legend into preparedPath
+    bool prepare_legend(const fs::path& legendPath, const fs::path& preparedPath,
+        const ModulateParams& mp, int scalePercent, bool cropLegendFirst)
+    {
+        std::ostringstream prep;
+        prep << "\"" << legendPath.string() << "\"";
+        if (cropLegendFirst)
+            prep << " -trim";
+        prep << " -modulate " << mp.brightness << "," << mp.saturation << "," << mp.hue
+            << " -resize " << scalePercent << "% \"" << preparedPath.string() << "\"";
+
+        if (!run_magick(prep.str())) {
+            std::cerr << "[ERR] Legend prep failed: " << legendPath.filename().string() << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    // Composite an already prepared legend onto the base image, or append it
+    // beside the base on a grown canvas
+    bool composite_legend(const fs::path& baseGrey, const fs::path& preparedLegend,
+        const fs::path& outPath, Edge edge, LegendPlacement placement)
+    {
+        // Replace, not write through, an output that may be hardlinked into
+        // the output cache
+        std::error_code ec;
+        fs::remove(outPath, ec);
+
+        std::ostringstream comp;
+        if (placement == LegendPlacement::Extend) {
+            // One append, legend first on the left and top; the shorter side
+            // is centred on the background colour of the extended canvas
+            const bool legendFirst = edge == Edge::Left || edge == Edge::Top;
+            const fs::path& first = legendFirst ? preparedLegend : baseGrey;
+            const fs::path& second = legendFirst ? baseGrey : preparedLegend;
+            comp << "-background black -gravity center \"" << first.string() << "\" \""
+                << second.string() << "\" "
+                << (edge == Edge::Left || edge == Edge::Right ? "+append" : "-append")
+                << " \"" << outPath.string() << "\"";
+            return run_magick(comp.str());
+        }
+
+        comp << "\"" << baseGrey.string() << "\" \"" << preparedLegend.string()
+            << "\" -gravity ";
+
+        switch (edge) {
+        case Edge::Top:    comp << "north"; break;
+        case Edge::Bottom: comp << "south"; break;
+        case Edge::Left:   comp << "west"; break;
+        case Edge::Right:  comp << "east"; break;
+        }
+
+        comp << " -composite \"" << outPath.string() << "\"";
+
+        return run_magick(comp.str());
+    }
+
+    bool composite_scale_on_edge(
+        const fs::path& baseGrey,
+        const fs::path& legendPath,
+        const fs::path& outPath,
+        const ModulateParams& mp,
+        Edge edge,
+        int scalePercent,
+        bool cropLegendFirst,
+        LegendCache* legends,
+        LegendPlacement placement)
+    {
+        if (legends) {
+            const LegendCache::File prepared = legends->prepared(legendPath, mp, scalePercent, cropLegendFirst);
+            return prepared && composite_legend(baseGrey, *prepared, outPath, edge, placement);
+        }
+
+        // Temporary resized legend path (stored beside output)
+        fs::path tmpLegend = outPath.parent_path() / kTmpLegendName;
+
+        // Step 1: Prepare (trim + modulate + resize) legend into temporary file
+        if (!prepare_legend(legendPath, tmpLegend, mp, scalePercent, cropLegendFirst))
+            return false;
+
+        // Step 2: Composite overlay onto base image
+        bool ok = composite_legend(baseGrey, tmpLegend, outPath, edge, placement);
+
+        // Clean up temp file
+        std::error_code ec;
+        fs::remove(tmpLegend, ec);
+
+        return ok;
+    }
+
+    // Width and height from a PNG's IHDR chunk
+    static bool png_size(const fs::path& png, int& width, int& height)
+    {
+        unsigned char head[24];
+        std::ifstream in(png, std::ios::binary);
+        if (!in.read(reinterpret_cast<char*>(head), sizeof(head)) ||
+            std::memcmp(head, "\x89PNG\r\n\x1a\n", 8) != 0 || std::memcmp(head + 12, "IHDR", 4) != 0)
+            return false;
+
+        auto be32 = [](const unsigned char* p) {
+            return (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) | (uint32_t(p[2]) << 8) | p[3];
+        };
+        width = static_cast<int>(be32(head + 16));
+        height = static_cast<int>(be32(head + 20));
+        return width > 0 && height > 0;
+    }
+
+    // Uncompressed RGBA that ImageMagick reads directly, so a drawn scale
+    // needs no encoder of our own
+    static bool write_pam(const fs::path& file, const Image& image)
+    {
+        std::ofstream out(file, std::ios::binary);
+        out << "P7\nWIDTH " << image.width << "\nHEIGHT " << image.height
+            << "\nDEPTH 4\nMAXVAL 255\nTUPLTYPE RGB_ALPHA\nENDHDR\n";
+        out.write(reinterpret_cast<const char*>(image.pixels.data()), static_cast<std::streamsize>(image.pixels.size()));
+        return static_cast<bool>(out);
+    }
+
+    bool composite_hue_scale_on_edge(const fs::path& baseGrey, const fs::path& outPath,
+        const ModulateParams& mp, Edge edge, const HueScaleStyle& style, LegendCache* legends,
+        LegendPlacement placement)
+    {
+        int width = 0, height = 0;
+        if (!png_size(baseGrey, width, height)) {
+            std::cerr << "[ERR] Not a PNG: " << baseGrey.filename().string() << std::endl;
+            return false;
+        }
+
+        if (legends) {
+            const LegendCache::File scale = legends->hue_scale(width, height, mp, edge, style, placement);
+            return scale && composite_legend(baseGrey, *scale, outPath, edge, placement);
+        }
+
+        fs::path tmpScale = outPath.parent_path() / kTmpScaleName;
+        bool ok = write_pam(tmpScale, render_hue_scale(width, height, edge, style, mp,
+                placement == LegendPlacement::Extend ? kExtendBackground : nullptr)) &&
+            composite_legend(baseGrey, tmpScale, outPath, edge, placement);
+
+        std::error_code ec;
+        fs::remove(tmpScale, ec);
+        return ok;
+    }
+
+    LegendCache::LegendCache(const fs::path& dir, size_t maxEntries)
+        : m_dir(dir), m_maxEntries(std::max<size_t>(1, maxEntries))
+    {
+        std::error_code ec;
+        fs::create_directories(m_dir, ec);
+    }
+
+    LegendCache::~LegendCache()
+    {
+        m_ready.clear();
+
+        // Only when nothing else was put there (or is still held)
+        std::error_code ec;
+        fs::remove(m_dir, ec);
+    }
+
+    LegendCache::File LegendCache::find(const std::string& key)
+    {
+        auto it = m_ready.find(key);
+        if (it == m_ready.end()) return nullptr;
+        m_lru.splice(m_lru.begin(), m_lru, it->second.second);
+        return it->second.first;
+    }
+
+    // Called with the file prepared outside the lock; if two jobs raced on
+    // the same key both wrote identical files under unique names and the
+    // first one wins
+    LegendCache::File LegendCache::add(const std::string& key, const fs::path& file)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (File ready = find(key)) {
+            std::error_code ec;
+            fs::remove(file, ec);
+            return ready;
+        }
+
+        File added(new fs::path(file), [](const fs::path* p) {
+            std::error_code ec;
+            fs::remove(*p, ec);
+            delete p;
+        });
+        while (m_ready.size() >= m_maxEntries) {
+            m_ready.erase(m_lru.back());
+            m_lru.pop_back();
+        }
+        m_lru.push_front(key);
+        m_ready.emplace(key, std::make_pair(added, m_lru.begin()));
+        return added;
+    }
+
+    LegendCache::File LegendCache::prepared(const fs::path& legend, const ModulateParams& mp,
+        int scalePercent, bool cropLegendFirst)
+    {
+        const std::string legendHash = outputcache::hashFile(legend);
+        if (legendHash.empty()) return {};
+
+        std::ostringstream desc;
+        desc << legendHash << "|" << mp.brightness << "," << mp.saturation << "," << mp.hue
+            << "|" << scalePercent << "|" << cropLegendFirst;
+        const std::string key = outputcache::hashString(desc.str());
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (File ready = find(key)) return ready;
+        }
+
+        std::random_device rd;
+        fs::path tmp = m_dir / (key + "." + std::to_string(rd()) + ".png");
+        if (!prepare_legend(legend, tmp, mp, scalePercent, cropLegendFirst))
+            return nullptr;
+        return add(key, tmp);
+    }
+
+    LegendCache::File LegendCache::hue_scale(int width, int height, const ModulateParams& mp,
+        Edge edge, const HueScaleStyle& style, LegendPlacement placement)
+    {
+        const bool extend = placement == LegendPlacement::Extend;
+
+        // Only the scale's own size matters, so images of different sizes
+        // usually share one
+        int w, h;
+        hue_scale_size(width, height, edge, style, w, h);
+
+        std::ostringstream desc;
+        desc << "hue-scale|" << w << "x" << h << "|" << width << "x" << height << "|"
+            << mp.brightness << "," << mp.saturation << "," << mp.hue << "|" << static_cast<int>(edge) << "|"
+            << style.hueFrom << "," << style.hueTo << "," << style.minValue << "," << style.maxValue << ","
+            << style.ticks << "," << style.lengthPercent << (extend ? "|extend" : "");
+        const std::string key = outputcache::hashString(desc.str());
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (File ready = find(key)) return ready;
+        }
+
+        std::random_device rd;
+        fs::path tmp = m_dir / (key + "." + std::to_string(rd()) + ".pam");
+        if (!write_pam(tmp, render_hue_scale(width, height, edge, style, mp, extend ? kExtendBackground : nullptr)))
+            return nullptr;
+        return add(key, tmp);
+    }
+
+    std::string stamp_text_for(const fs::path& source)
+    {
+        auto utf8 = [](const fs::path& p) {
+            const auto s = p.u8string();
+            return std::string(s.begin(), s.end());
+        };
+        std::string text = utf8(source.filename());
+        if (source.has_parent_path() && source.parent_path().has_filename())
+            text += "  |  " + utf8(source.parent_path().filename());
+
+        std::error_code ec;
+        const auto written = fs::last_write_time(source, ec);
+        if (!ec) {
+            // file_time_type has no portable conversion in C++17; shift it
+            // onto the system clock through the two clocks' current times
+            const auto now = std::chrono::system_clock::now() + (written - fs::file_time_type::clock::now());
+            const std::time_t t = std::chrono::system_clock::to_time_t(
+                std::chrono::time_point_cast<std::chrono::system_clock::duration>(now));
+            std::tm tm{};
+#ifdef _WIN32
+            localtime_s(&tm, &t);
+#else
+            localtime_r(&t, &tm);
+#endif
+            char buf[32];
+            if (std::strftime(buf, sizeof(buf), "%Y-%m-%d %H:%M:%S", &tm))
+                text += std::string("  |  ") + buf;
+        }
+        return text;
+    }
+
+    // --- Options as text -----------------------------------------------------
+
+    const std::string kParametersKeyword = "Scout:Parameters";
+    const std::string kSourceHashKeyword = "Scout:SourceHash";
+
+    // Names of the enum values, in enum order
+    static const char* const kEdgeNames[] = { "top", "right", "bottom", "left" };
+    static const char* const kCornerNames[] = { "top-left", "top-right", "bottom-left", "bottom-right" };
+    static const char* const kLegendSourceNames[] = { "file", "scale", "auto" };
+    static const char* const kPlacementNames[] = { "overlay", "extend" };
+    static const char* const kPaletteNames[] = { "off", "exact", "reduce" };
+
+    // Enum value named name (in any case), or false
+    template <typename Enum, size_t N>
+    static bool enum_from_name(const std::string& name, const char* const (&names)[N], Enum& out)
+    {
+        std::string lower = name;
+        std::transform(lower.begin(), lower.end(), lower.begin(),
+            [](unsigned char ch) { return static_cast<char>(std::tolower(ch)); });
+        for (size_t i = 0; i < N; ++i)
+            if (lower == names[i]) {
+                out = static_cast<Enum>(i);
+                return true;
+            }
+        return false;
+    }
+
+    std::string format_options(const Options& options)
+    {
+        std::ostringstream text;
+        text << "brightness=" << options.mp.brightness
+             << "&saturation=" << options.mp.saturation
+             << "&hue=" << options.mp.hue
+             << "&modulate=" << options.modulate
+             << "&legend=" << options.legend
+             << "&legend-source=" << kLegendSourceNames[static_cast<int>(options.legendSource)]
+             << "&edge=" << kEdgeNames[static_cast<int>(options.edge)]
+             << "&placement=" << kPlacementNames[static_cast<int>(options.placement)]
+             << "&scale=" << options.legendPercent
+             << "&crop=" << options.cropLegendFirst
+             << "&stamp=" << options.stamp.enabled
+             << "&stamp-corner=" << kCornerNames[static_cast<int>(options.stamp.corner)]
+             << "&palette=" << kPaletteNames[static_cast<int>(options.palette)]
+             << "&metadata=" << options.metadata;
+        return text.str();
+    }
+
+    bool options_in_range(const Options& options)
+    {
+        const ModulateParams& mp = options.mp;
+        return std::isfinite(mp.brightness) && std::isfinite(mp.saturation) && std::isfinite(mp.hue) &&
+            mp.brightness >= 0 && mp.saturation >= 0 && mp.hue >= 0 &&
+            options.legendPercent > 0 && options.legendPercent <= 2000;
+    }
+
+    bool parse_options(const std::map<std::string, std::string>& values,
+        const Options& defaults, Options& out)
+    {
+        out = defaults;
+        try {
+            for (const auto& kv : values) {
+                const std::string& v = kv.second;
+                if (kv.first == "brightness") out.mp.brightness = std::stod(v);
+                else if (kv.first == "saturation") out.mp.saturation = std::stod(v);
+                else if (kv.first == "hue") out.mp.hue = std::stod(v);
+                else if (kv.first == "modulate") out.modulate = v != "0";
+                else if (kv.first == "legend") out.legend = v != "0";
+                else if (kv.first == "crop") out.cropLegendFirst = v != "0";
+                else if (kv.first == "scale") out.legendPercent = std::stoi(v);
+                else if (kv.first == "stamp") out.stamp.enabled = v != "0";
+                else if (kv.first == "metadata") out.metadata = v != "0";
+                else if (kv.first == "stamp-corner") {
+                    if (!enum_from_name(v, kCornerNames, out.stamp.corner)) return false;
+                }
+                else if (kv.first == "legend-source") {
+                    if (!enum_from_name(v, kLegendSourceNames, out.legendSource)) return false;
+                }
+                else if (kv.first == "placement") {
+                    if (!enum_from_name(v, kPlacementNames, out.placement)) return false;
+                }
+                else if (kv.first == "palette") {
+                    if (!enum_from_name(v, kPaletteNames, out.palette)) return false;
+                }
+                else if (kv.first == "edge") {
+                    if (!enum_from_name(v, kEdgeNames, out.edge)) return false;
+                }
+            }
+        }
+        catch (...) {
+            return false;
+        }
+        return options_in_range(out);
+    }
+
+    bool parse_options(const std::string& text, const Options& defaults, Options& out)
+    {
+        std::map<std::string, std::string> values;
+        std::istringstream pairs(text);
+        std::string kv;
+        while (std::getline(pairs, kv, '&')) {
+            if (kv.empty()) continue;
+            const auto eq = kv.find('=');
+            if (eq == std::string::npos) values[kv] = "";
+            else values[kv.substr(0, eq)] = kv.substr(eq + 1);
+        }
+        return parse_options(values, defaults, out);
+    }
+
+    bool read_output_options(const fs::path& output, Options& out)
+    {
+        std::map<std::string, std::string> text;
+        if (!read_png_text(output, text)) return false;
+        auto it = text.find(kParametersKeyword);
+        return it != text.end() && parse_options(it->second, Options(), out);
+    }
+
+    // --- Duplicates and output cache -----------------------------------------
+
+    // Cache key for a *_GreyFilter output of a source with content hash srcHash
+    static std::string grey_key(const std::string& srcHash, const ModulateParams& mp)
+    {
+        if (srcHash.empty()) return {};
+
+        std::ostringstream key;
+        key << "grey|" << kToolVersion << "|" << srcHash << "|"
+            << mp.brightness << "," << mp.saturation << "," << mp.hue;
+        return outputcache::hashString(key.str());
+    }
+
+    // Cache key for a *_GreyFilter output of src
+    std::string grey_cache_key(const fs::path& src, const ModulateParams& mp)
+    {
+        return grey_key(outputcache::hashFile(src), mp);
+    }
+
+    // Cache key for a *_WithScale output of grey with the given legend and options
+    std::string scaled_cache_key(const fs::path& grey, const fs::path& legend,
+        const ModulateParams& mp, Edge edge, int scalePercent, bool cropLegendFirst,
+        LegendPlacement placement)
+    {
+        std::string greyHash = outputcache::hashFile(grey);
+        std::string legendHash = outputcache::hashFile(legend);
+        if (greyHash.empty() || legendHash.empty()) return {};
+
+        std::ostringstream key;
+        key << "scaled|" << kToolVersion << "|" << greyHash << "|" << legendHash << "|"
+            << mp.brightness << "," << mp.saturation << "," << mp.hue << "|"
+            << static_cast<int>(edge) << "|" << scalePercent << "|" << cropLegendFirst;
+        // Overlay keys predate placement and stay as they were
+        if (placement == LegendPlacement::Extend) key << "|extend";
+        return outputcache::hashString(key.str());
+    }
+
+    std::string hue_scale_cache_key(const fs::path& grey, const ModulateParams& mp,
+        Edge edge, const HueScaleStyle& style, LegendPlacement placement)
+    {
+        std::string greyHash = outputcache::hashFile(grey);
+        if (greyHash.empty()) return {};
+
+        std::ostringstream key;
+        key << "hue-scale|" << kToolVersion << "|native " << kNativeVersion << "|" << greyHash << "|"
+            << mp.brightness << "," << mp.saturation << "," << mp.hue << "|" << static_cast<int>(edge) << "|"
+            << style.hueFrom << "," << style.hueTo << "," << style.minValue << "," << style.maxValue << ","
+            << style.ticks << "," << style.lengthPercent;
+        if (placement == LegendPlacement::Extend) key << "|extend";
+        return outputcache::hashString(key.str());
+    }
+
+    // Exports often contain the same screenshot in several folders. Sources are
+    // grouped by size first and only same-size files are hashed; each group is
+    // processed once and its outputs are linked to the duplicates.
+    std::map<fs::path, fs::path> find_duplicate_sources(const std::vector<fs::path>& pngs,
+        std::map<fs::path, std::string>* hashes)
+    {
+        std::map<uintmax_t, std::vector<const fs::path*>> bySize;
+        for (const auto& p : pngs) {
+            std::error_code ec;
+            uintmax_t size = fs::file_size(p, ec);
+            if (!ec) bySize[size].push_back(&p);
+        }
+
+        // Maps each duplicate to the first source (in discovery order) with the
+        // same contents
+        std::map<fs::path, fs::path> duplicateOf;
+        for (const auto& group : bySize) {
+            if (group.second.size() < 2) continue;
+
+            std::map<std::string, const fs::path*> firstByHash;
+            for (const fs::path* p : group.second) {
+                std::string hash = outputcache::hashFile(*p);
+                if (hash.empty()) continue;
+                if (hashes) (*hashes)[*p] = hash;
+
+                auto it = firstByHash.emplace(hash, p).first;
+                if (it->second != p) duplicateOf[*p] = *it->second;
+            }
+        }
+        return duplicateOf;
+    }
+
+    bool same_file_content(const fs::path& a, const fs::path& b)
+    {
+        std::error_code ec1, ec2;
+        if (fs::file_size(a, ec1) != fs::file_size(b, ec2) || ec1 || ec2) return false;
+        return outputcache::hashFile(a) == outputcache::hashFile(b);
+    }
+
+    // Make dest an identical copy of src: a hardlink when the volume allows it,
+    // a plain copy otherwise
+    bool link_or_copy(const fs::path& src, const fs::path& dest)
+    {
+        std::error_code ec;
+        fs::remove(dest, ec);
+        fs::create_hard_link(src, dest, ec);
+        if (!ec) return true;
+
+        ec.clear();
+        return fs::copy_file(src, dest, fs::copy_options::overwrite_existing, ec) && !ec;
+    }
+
+    // --- Batch processing ----------------------------------------------------
+
+    // Unique scratch folder for process_buffer and drawn hue scales
+    static fs::path make_scratch_dir()
+    {
+        static std::atomic<unsigned> counter{ 0 };
+        std::random_device rd;
+        fs::path dir = fs::temp_directory_path() /
+            ("scout-" + std::to_string(rd()) + "-" + std::to_string(counter++));
+        fs::create_directories(dir);
+        return dir;
+    }
+
+    // The options the output of stage depends on. The rest keep their
+    // defaults, so they neither split its cache entries nor show up in its
+    // Parameters text: a grey output only depends on the modulate values,
+    // the stamp and the palette.
+    static Options stage_options(Stage stage, const Options& options)
+    {
+        if (stage != Stage::Modulate) return options;
+
+        Options grey;
+        grey.modulate = options.modulate;
+        grey.mp = options.mp;
+        grey.legend = false;
+        grey.stamp = options.stamp;
+        grey.palette = options.palette;
+        grey.metadata = options.metadata;
+        return grey;
+    }
+
+    // Content hash of a batch source, computed once and shared by the cache
+    // keys and the tags of both passes
+    static const std::string& source_hash(std::map<fs::path, std::string>& hashes, const fs::path& source)
+    {
+        auto it = hashes.find(source);
+        if (it == hashes.end())
+            it = hashes.emplace(source, outputcache::hashFile(source)).first;
+        return it->second;
+    }
+
+    // Indexed and tagged outputs are different files, so they get their own
+    // cache entries
+    static std::string with_output_format(const std::string& key, const Options& options)
+    {
+        if (key.empty() || (options.palette == PaletteMode::Off && !options.metadata)) return key;
+        std::string format = key;
+        if (options.palette != PaletteMode::Off)
+            format += "|palette|" + std::to_string(static_cast<int>(options.palette));
+        if (options.metadata)
+            format += "|meta|" + format_options(options);
+        return outputcache::hashString(format);
+    }
+
+    // Copy the metadata of source into out and record the options it was
+    // made with and what it was made from
+    static bool tag_output(const fs::path& source, const fs::path& out, const Options& options,
+        std::map<fs::path, std::string>& hashes)
+    {
+        if (!options.metadata) return true;
+
+        // Only chunks change, so decoded pixels stay good for the new file
+        auto pixels = decoded_images().find(out);
+        const bool ok = carry_png_metadata(source, out, {
+            { kParametersKeyword, format_options(options) },
+            { kSourceHashKeyword, source_hash(hashes, source) } });
+        if (ok && pixels) decoded_images().put(out, std::move(pixels));
+        return ok;
+    }
+
+    std::vector<fs::path> process_batch(const std::vector<fs::path>& sources,
+        const Options& options, const ProgressFn& progress)
+    {
+        std::vector<fs::path> written;
+        outputcache::Cache cache;
+        if (!options.cacheDir.empty())
+            cache = outputcache::Cache(options.cacheDir);
+
+        auto report = [&](Stage stage, Outcome outcome, const fs::path& in,
+            const fs::path& out, size_t index, size_t total) {
+            if (outcome == Outcome::Ok || outcome == Outcome::CacheHit || outcome == Outcome::Duplicate)
+                written.push_back(out);
+            return !progress || progress(ItemResult{ stage, outcome, in, out, index, total });
+        };
+
+        // Stamped outputs differ per file name, so duplicates can't share them
+        std::map<fs::path, std::string> hashes;
+        const std::map<fs::path, fs::path> duplicateOf = options.stamp.enabled
+            ? std::map<fs::path, fs::path>() : find_duplicate_sources(sources, &hashes);
+
+        // Rendered stamps and hue scales live in a scratch folder for the
+        // length of the batch
+        struct ScratchDir
+        {
+            fs::path dir;
+            ~ScratchDir() { std::error_code ec; if (!dir.empty()) fs::remove_all(dir, ec); }
+        } scratch;
+
+        // -------------------------- Modulate pass ------------------------
+        if (options.modulate) {
+            const Options greyOptions = stage_options(Stage::Modulate, options);
+            for (size_t i = 0; i < sources.size(); ++i) {
+                const auto& p = sources[i];
+                fs::path out = output_grey_name(p);
+
+                if (!options.overwrite && fs::exists(out)) {
+                    if (!report(Stage::Modulate, Outcome::Skipped, p, out, i, sources.size())) return written;
+                    continue;
+                }
+
+                // Duplicates are linked once their original has been processed
+                auto dup = duplicateOf.find(p);
+                if (dup != duplicateOf.end()) {
+                    fs::path from = output_grey_name(dup->second);
+                    if (fs::exists(from)) {
+                        bool ok = link_or_copy(from, out);
+                        if (!report(Stage::Modulate, ok ? Outcome::Duplicate : Outcome::Failed, p, out, i, sources.size()))
+                            return written;
+                        continue;
+                    }
+                }
+
+                // The stamp is drawn here and composited by the modulate call
+                std::string stampText;
+                fs::path stampImage;
+                int width = 0, height = 0;
+                if (options.stamp.enabled && png_size(p, width, height)) {
+                    stampText = stamp_text_for(p);
+                    try {
+                        if (scratch.dir.empty()) scratch.dir = make_scratch_dir();
+                        stampImage = scratch.dir / ("stamp" + std::to_string(i) + ".pam");
+                        if (!write_pam(stampImage, render_text_stamp(stampText, stamp_text_height(height, options.stamp))))
+                            stampImage.clear();
+                    }
+                    catch (const fs::filesystem_error&) {
+                        stampImage.clear();
+                    }
+                }
+
+                std::string key;
+                if (cache.enabled()) {
+                    key = grey_key(source_hash(hashes, p), options.mp);
+                    if (!key.empty() && !stampImage.empty()) {
+                        std::ostringstream stamped;
+                        stamped << key << "|stamp|" << stampText << "|" << static_cast<int>(options.stamp.corner)
+                            << "|" << stamp_text_height(height, options.stamp);
+                        key = outputcache::hashString(stamped.str());
+                    }
+                    key = with_output_format(key, greyOptions);
+                    if (cache.fetch(key, out)) {
+                        if (!report(Stage::Modulate, Outcome::CacheHit, p, out, i, sources.size())) return written;
+                        continue;
+                    }
+                }
+
+                bool ok = apply_modulate(p, out, options.mp, stampImage, options.stamp.corner);
+                if (!stampImage.empty()) {
+                    std::error_code ec;
+                    fs::remove(stampImage, ec);
+                }
+                ok = ok && write_indexed_png(out, options.palette) && tag_output(p, out, greyOptions, hashes);
+                if (ok) cache.store(key, out);
+                if (!report(Stage::Modulate, ok ? Outcome::Ok : Outcome::Failed, p, out, i, sources.size()))
+                    return written;
+            }
+        }
+
+        // -------------------------- Legend pass --------------------------
+        if (options.legend) {
+            // Work on all *_GreyFilter.png we produced (or that already exist)
+            std::vector<fs::path> greys;
+            std::vector<fs::path> greySources;
+            for (const auto& p : sources) {
+                fs::path g = output_grey_name(p);
+                if (fs::exists(g)) {
+                    greys.push_back(g);
+                    greySources.push_back(p);
+                }
+            }
+
+            // A drawn scale only depends on the image size, and sources
+            // often share identical legend files, so without a shared
+            // LegendCache the batch keeps its own in a scratch folder and
+            // prepares each of them once
+            LegendCache* legends = options.legendCache;
+            std::unique_ptr<LegendCache> batchLegends;
+            if (!legends) {
+                try {
+                    if (scratch.dir.empty()) scratch.dir = make_scratch_dir();
+                    batchLegends = std::make_unique<LegendCache>(scratch.dir / "legends");
+                    legends = batchLegends.get();
+                }
+                catch (const fs::filesystem_error&) {}
+            }
+
+            // Legend and output made for each original source, so duplicates
+            // with an identical legend can link the result
+            std::map<fs::path, std::pair<fs::path, fs::path>> scaledFor;
+
+            const size_t total = greys.size();
+            for (size_t i = 0; i < total; ++i) {
+                const auto& g = greys[i];
+                fs::path legend = options.legendSource == LegendSource::HueScale ? fs::path()
+                    : legend_for_base(greySources[i]);
+                fs::path out = output_scaled_name(g);
+
+                // Without a legend file the drawn scale stands in, if allowed
+                const bool drawScale = legend.empty() && options.legendSource != LegendSource::File;
+                if (legend.empty() && !drawScale) {
+                    if (!report(Stage::Legend, Outcome::NoLegend, g, out, i, total)) return written;
+                    continue;
+                }
+
+                bool linked = false;
+                auto dup = duplicateOf.find(greySources[i]);
+                if (dup != duplicateOf.end()) {
+                    auto made = scaledFor.find(dup->second);
+                    linked = made != scaledFor.end() &&
+                        (drawScale ? made->second.first.empty() : same_file_content(made->second.first, legend)) &&
+                        link_or_copy(made->second.second, out);
+                }
+
+                std::string key;
+                bool hit = false;
+                if (!linked && cache.enabled()) {
+                    key = drawScale ? hue_scale_cache_key(g, options.mp, options.edge, options.hueScale, options.placement)
+                        : scaled_cache_key(g, legend, options.mp, options.edge, options.legendPercent,
+                            options.cropLegendFirst, options.placement);
+                    key = with_output_format(key, options);
+                    hit = cache.fetch(key, out);
+                }
+
+                bool ok = linked || hit || (drawScale
+                    ? composite_hue_scale_on_edge(g, out, options.mp, options.edge, options.hueScale,
+                        legends, options.placement)
+                    : composite_scale_on_edge(g, legend, out, options.mp, options.edge, options.legendPercent,
+                        options.cropLegendFirst, legends, options.placement));
+                if (ok && !linked && !hit)
+                    ok = write_indexed_png(out, options.palette) && tag_output(greySources[i], out, options, hashes);
+                if (ok) {
+                    if (!linked && !hit) cache.store(key, out);
+                    if (dup == duplicateOf.end()) scaledFor[greySources[i]] = { legend, out };
+                }
+
+                Outcome outcome = linked ? Outcome::Duplicate : hit ? Outcome::CacheHit : ok ? Outcome::Ok : Outcome::Failed;
+                if (!report(Stage::Legend, outcome, g, out, i, total)) return written;
+            }
+        }
+
+        return written;
+    }
+
+    static bool write_bytes(const fs::path& file, const std::vector<unsigned char>& data)
+    {
+        std::ofstream out(file, std::ios::binary);
+        out.write(reinterpret_cast<const char*>(data.data()), static_cast<std::streamsize>(data.size()));
+        return static_cast<bool>(out);
+    }
+
+    static bool read_bytes(const fs::path& file, std::vector<unsigned char>& data)
+    {
+        std::ifstream in(file, std::ios::binary);
+        if (!in) return false;
+        data.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+        return !in.bad();
+    }
+
+    // ImageMagick only works on files, so the buffers go through a private
+    // scratch folder that is removed afterwards
+    bool process_buffer(const std::vector<unsigned char>& image,
+        const std::vector<unsigned char>* legend, const Options& options,
+        std::vector<unsigned char>& out)
+    {
+        std::error_code ec;
+        fs::path dir;
+        try { dir = make_scratch_dir(); }
+        catch (const fs::filesystem_error&) { return false; }
+
+        const fs::path src = dir / "image.png";
+        const fs::path legendPath = dir / "image_Legend.png";
+        fs::path result = src;
+        Stage stage = Stage::Modulate;      // of the last step that ran
+
+        bool ok = write_bytes(src, image);
+        if (ok && options.modulate) {
+            result = output_grey_name(src);
+            ok = apply_modulate(src, result, options.mp);
+        }
+        const bool drawScale = options.legendSource == LegendSource::HueScale ||
+            (options.legendSource == LegendSource::FileOrHueScale && !legend);
+        if (ok && options.legend && drawScale) {
+            fs::path scaled = output_scaled_name(result);
+            ok = composite_hue_scale_on_edge(result, scaled, options.mp, options.edge,
+                options.hueScale, options.legendCache, options.placement);
+            result = scaled;
+            stage = Stage::Legend;
+        }
+        else if (ok && options.legend && legend) {
+            fs::path scaled = output_scaled_name(result);
+            ok = write_bytes(legendPath, *legend) &&
+                composite_scale_on_edge(result, legendPath, scaled, options.mp, options.edge,
+                    options.legendPercent, options.cropLegendFirst, options.legendCache, options.placement);
+            result = scaled;
+            stage = Stage::Legend;
+        }
+        std::map<fs::path, std::string> hashes;
+        if (ok && result != src)
+            ok = write_indexed_png(result, options.palette) &&
+                tag_output(src, result, stage_options(stage, options), hashes);
+        if (ok)
+            ok = read_bytes(result, out);
+
+        decoded_images().forget(result);
+        fs::remove_all(dir, ec);
+        return ok;
+    }
+
+    // --- Output manifest and cleanup -----------------------------------------
+
+    static std::set<std::string> read_output_manifest(const fs::path& root)
+    {
+        std::set<std::string> entries;
+        std::ifstream in(root / kOutputManifestName);
+        std::string line;
+        while (std::getline(in, line)) {
+            if (!line.empty() && line.back() == '\r') line.pop_back();
+            if (!line.empty()) entries.insert(line);
+        }
+        return entries;
+    }
+
+    void record_outputs(const fs::path& root, const std::vector<fs::path>& outputs)
+    {
+        if (outputs.empty()) return;
+
+        std::set<std::string> entries = read_output_manifest(root);
+        for (const auto& p : outputs) {
+            std::error_code ec;
+            fs::path rel = fs::relative(p, root, ec);
+            if (!ec && !rel.empty()) entries.insert(rel.generic_string());
+        }
+
+        std::ofstream out(root / kOutputManifestName, std::ios::trunc);
+        for (const auto& e : entries)
+            out << e << "\n";
+    }
+
+    void prune_output_manifest(const fs::path& root)
+    {
+        std::set<std::string> entries = read_output_manifest(root);
+        for (auto it = entries.begin(); it != entries.end();) {
+            std::error_code ec;
+            if (fs::exists(root / fs::path(*it), ec)) ++it;
+            else it = entries.erase(it);
+        }
+
+        std::error_code ec;
+        if (entries.empty()) {
+            fs::remove(root / kOutputManifestName, ec);
+            return;
+        }
+        std::ofstream out(root / kOutputManifestName, std::ios::trunc);
+        for (const auto& e : entries)
+            out << e << "\n";
+    }
+
+    std::vector<fs::path> find_generated_outputs(const fs::path& root, size_t* fromManifest)
+    {
+        std::vector<fs::path> sources, generated;
+        discover_pngs(root, sources, generated);
+
+        // Add manifest entries that no longer match a suffix; only paths inside
+        // the root are accepted
+        size_t manifestCount = 0;
+        for (const auto& e : read_output_manifest(root)) {
+            fs::path rel(e);
+            if (rel.is_absolute() || rel.has_root_name() ||
+                std::find(rel.begin(), rel.end(), fs::path("..")) != rel.end())
+                continue;
+
+            fs::path p = root / rel;
+            std::error_code ec;
+            if (!is_generated_output(p) && fs::is_regular_file(p, ec)) {
+                generated.push_back(p);
+                ++manifestCount;
+            }
+        }
+
+        if (fromManifest) *fromManifest = manifestCount;
+        return generated;
+    }
+
+    // Files are grouped by folder and each worker takes a whole folder at a
+    // time, so threads never contend on the same directory.
+    size_t remove_files_parallel(std::vector<fs::path> files, size_t& failed,
+        const std::function<void(size_t, size_t)>& progress)
+    {
+        std::sort(files.begin(), files.end());
+        files.erase(std::unique(files.begin(), files.end()), files.end());
+
+        // [begin, end) ranges of files sharing a parent folder
+        std::vector<std::pair<size_t, size_t>> batches;
+        for (size_t i = 0; i < files.size();) {
+            size_t j = i + 1;
+            const fs::path parent = files[i].parent_path();
+            while (j < files.size() && files[j].parent_path() == parent) ++j;
+            batches.emplace_back(i, j);
+            i = j;
+        }
+
+        std::atomic<size_t> nextBatch{ 0 };
+        std::atomic<size_t> done{ 0 };
+        std::atomic<size_t> removed{ 0 };
+        std::atomic<size_t> errors{ 0 };
+
+        auto worker = [&]() {
+            for (size_t b = nextBatch++; b < batches.size(); b = nextBatch++) {
+                for (size_t i = batches[b].first; i < batches[b].second; ++i) {
+                    std::error_code ec;
+                    if (fs::remove(files[i], ec)) ++removed;
+                    else if (ec) ++errors;
+                    ++done;
+                }
+            }
+        };
+
+        // Deleting is I/O bound, so use a few more threads than cores
+        size_t threadCount = std::max<size_t>(4, 2 * std::thread::hardware_concurrency());
+        threadCount = std::min(threadCount, batches.size());
+
+        std::vector<std::thread> threads;
+        for (size_t t = 0; t < threadCount; ++t)
+            threads.emplace_back(worker);
+
+        while (done < files.size()) {
+            if (progress) progress(done, files.size());
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        }
+        for (auto& t : threads) t.join();
+        if (progress) progress(files.size(), files.size());
+
+        failed = errors;
+        return removed;
+    }
+}
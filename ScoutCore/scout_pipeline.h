@@ -0,0 +1,251 @@
+#pragma once
+#include <filesystem>
+#include <functional>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// C++ side of the processing core: discovery, the ImageMagick pipeline,
+// output bookkeeping and cleanup. The interactive tool and the C API in
+// scout_core.h are both thin layers over these functions.
+namespace scout
+{
+    namespace fs = std::filesystem;
+
+    // Part of every output cache key; bump whenever the produced pixels change
+    extern const char* const kToolVersion;
+
+    // Also part of the keys of outputs drawn by the native kernels rather
+    // than ImageMagick (only the hue scale so far); bump when those change
+    extern const char* const kNativeVersion;
+
+    // Names of everything the pipeline writes next to the sources
+    extern const std::string kGreySuffix;
+    extern const std::string kScaledSuffix;
+    extern const std::string kTmpLegendName;
+    extern const std::string kTmpScaleName;
+    extern const std::string kOutputManifestName;
+
+    struct ModulateParams { double brightness = 75, saturation = 125, hue = 100; };
+
+    enum class Edge { Top, Right, Bottom, Left };
+
+    // Where the legend comes from: the *_Legend file next to each source, a
+    // hue scale drawn by the tool, or the file with the drawn scale as fallback
+    enum class LegendSource { File, HueScale, FileOrHueScale };
+
+    // Overlay paints the legend over the image; Extend grows the canvas on
+    // that edge and puts the legend beside the image, hiding nothing
+    enum class LegendPlacement { Overlay, Extend };
+
+    // Look of the drawn hue scale. The gradient runs from hueFrom at the
+    // top (or left) to hueTo, labelled with ticks values from minValue to
+    // maxValue.
+    struct HueScaleStyle
+    {
+        double hueFrom = 0, hueTo = 240;     // degrees
+        double minValue = 0, maxValue = 100;
+        int ticks = 5;
+        int lengthPercent = 60;              // of the image side it runs along
+    };
+
+    enum class Corner { TopLeft, TopRight, BottomLeft, BottomRight };
+
+    // Capture details (file name, folder, modification time) written onto
+    // every output; applied in the modulate step so no extra pass is needed
+    struct StampOptions
+    {
+        bool enabled = false;
+        Corner corner = Corner::BottomLeft;
+        int pixelHeight = 0;                 // text height; 0 = from image height
+    };
+
+    // Outputs as indexed PNGs: Off keeps ImageMagick's truecolour files,
+    // Exact indexes only images with at most 256 colours (lossless), Reduce
+    // also cuts larger ones down to 256
+    enum class PaletteMode { Off, Exact, Reduce };
+
+    class LegendCache;
+
+    struct Options
+    {
+        bool modulate = true;
+        ModulateParams mp;               // defaults 75,125,100
+        bool legend = true;
+        bool cropLegendFirst = true;
+        int legendPercent = 500;
+        Edge edge = Edge::Right;
+        LegendSource legendSource = LegendSource::File;
+        LegendPlacement placement = LegendPlacement::Overlay;
+        HueScaleStyle hueScale;
+        StampOptions stamp;
+        PaletteMode palette = PaletteMode::Off;
+        bool metadata = true;            // carry the source's PNG metadata over
+                                         // and record how the output was made
+        bool overwrite = true;           // false skips sources whose output exists
+        fs::path cacheDir;               // empty disables the output cache
+        LegendCache* legendCache = nullptr; // reuse prepared legends between jobs
+    };
+
+    // --- Naming and discovery ------------------------------------------------
+    bool has_png_ext(const fs::path& p);
+    bool is_generated_output(const fs::path& p);
+    fs::path output_grey_name(const fs::path& in);
+    fs::path output_scaled_name(const fs::path& grey);
+    fs::path legend_for_base(const fs::path& basePng);
+
+    // Walk the tree once, splitting PNGs into sources and outputs of earlier runs
+    void discover_pngs(const fs::path& root, std::vector<fs::path>& sources,
+        std::vector<fs::path>& generated);
+
+    // --- ImageMagick steps ---------------------------------------------------
+    bool run_magick(const std::string& args);
+    // With a stamp image, it is composited in the same magick call
+    bool apply_modulate(const fs::path& inPath, const fs::path& outPath, const ModulateParams& mp,
+        const fs::path& stampImage = {}, Corner corner = Corner::BottomLeft);
+    bool prepare_legend(const fs::path& legendPath, const fs::path& preparedPath,
+        const ModulateParams& mp, int scalePercent, bool cropLegendFirst);
+    // Overlay composites the legend over the base; Extend appends it beside
+    // the base on a canvas grown to hold both
+    bool composite_legend(const fs::path& baseGrey, const fs::path& preparedLegend,
+        const fs::path& outPath, Edge edge, LegendPlacement placement = LegendPlacement::Overlay);
+
+    // Prepare the legend and composite it; with a LegendCache the prepared
+    // legend is reused instead of being rebuilt for every image
+    bool composite_scale_on_edge(const fs::path& baseGrey, const fs::path& legendPath,
+        const fs::path& outPath, const ModulateParams& mp, Edge edge,
+        int scalePercent, bool cropLegendFirst, LegendCache* legends = nullptr,
+        LegendPlacement placement = LegendPlacement::Overlay);
+
+    // Draw the hue scale at the size baseGrey needs and composite it; the
+    // scale is rendered once per image size when a LegendCache is given
+    bool composite_hue_scale_on_edge(const fs::path& baseGrey, const fs::path& outPath,
+        const ModulateParams& mp, Edge edge, const HueScaleStyle& style,
+        LegendCache* legends = nullptr, LegendPlacement placement = LegendPlacement::Overlay);
+
+    // Prepared legends keyed by legend content and options. The most recently
+    // used maxEntries are kept; the files go once they are dropped and no
+    // caller holds them, and the folder goes with the cache when it is
+    // empty by then. Safe to share between threads.
+    class LegendCache
+    {
+    public:
+        explicit LegendCache(const fs::path& dir, size_t maxEntries = 256);
+        ~LegendCache();
+
+        LegendCache(const LegendCache&) = delete;
+        LegendCache& operator=(const LegendCache&) = delete;
+
+        // A prepared file, kept on disk while held
+        typedef std::shared_ptr<const fs::path> File;
+
+        // The prepared legend, or null on failure
+        File prepared(const fs::path& legend, const ModulateParams& mp,
+            int scalePercent, bool cropLegendFirst);
+
+        // A hue scale drawn for a width x height image; for Extend it is
+        // drawn on the opaque background of the grown canvas
+        File hue_scale(int width, int height, const ModulateParams& mp,
+            Edge edge, const HueScaleStyle& style,
+            LegendPlacement placement = LegendPlacement::Overlay);
+
+    private:
+        File find(const std::string& key);                  // with m_mutex held
+        File add(const std::string& key, const fs::path& file);
+
+        fs::path m_dir;
+        const size_t m_maxEntries;
+        std::mutex m_mutex;
+        std::list<std::string> m_lru;                       // most recently used first
+        std::map<std::string, std::pair<File, std::list<std::string>::iterator>> m_ready;
+    };
+
+    // Text of the capture stamp for a source: file name, folder and the
+    // file's modification time
+    std::string stamp_text_for(const fs::path& source);
+
+    // --- Options as text -----------------------------------------------------
+    // key=value pairs joined by '&', with the names the service takes in its
+    // query string; written into every output so it can be read back later
+    std::string format_options(const Options& options);
+
+    // Whether the modulate values are finite and not negative and the legend
+    // scale is 1..2000 percent, as for options a user entered
+    bool options_in_range(const Options& options);
+
+    // Apply values on top of defaults; false for an unknown value or one out
+    // of range (see options_in_range). Unknown keys are ignored.
+    bool parse_options(const std::map<std::string, std::string>& values,
+        const Options& defaults, Options& out);
+    bool parse_options(const std::string& text, const Options& defaults, Options& out);
+
+    // PNG text keywords written into outputs
+    extern const std::string kParametersKeyword;
+    extern const std::string kSourceHashKeyword;
+
+    // Options an output was made with, from its kParametersKeyword text
+    bool read_output_options(const fs::path& output, Options& out);
+
+    // --- Duplicates and output cache -----------------------------------------
+    std::string grey_cache_key(const fs::path& src, const ModulateParams& mp);
+    std::string scaled_cache_key(const fs::path& grey, const fs::path& legend,
+        const ModulateParams& mp, Edge edge, int scalePercent, bool cropLegendFirst,
+        LegendPlacement placement = LegendPlacement::Overlay);
+    std::string hue_scale_cache_key(const fs::path& grey, const ModulateParams& mp,
+        Edge edge, const HueScaleStyle& style,
+        LegendPlacement placement = LegendPlacement::Overlay);
+
+    // Maps each byte-identical duplicate to the first source with its contents.
+    // The content hashes it had to compute go into hashes, when given.
+    std::map<fs::path, fs::path> find_duplicate_sources(const std::vector<fs::path>& pngs,
+        std::map<fs::path, std::string>* hashes = nullptr);
+    bool same_file_content(const fs::path& a, const fs::path& b);
+    bool link_or_copy(const fs::path& src, const fs::path& dest);
+
+    // --- Batch processing ----------------------------------------------------
+    enum class Stage { Modulate, Legend };
+    enum class Outcome { Ok, Failed, CacheHit, Duplicate, Skipped, NoLegend };
+
+    struct ItemResult
+    {
+        Stage stage;
+        Outcome outcome;
+        fs::path input;     // source (modulate) or grey image (legend)
+        fs::path output;
+        size_t index;       // position within the stage
+        size_t total;
+    };
+
+    // Called after every item; return false to stop the batch
+    using ProgressFn = std::function<bool(const ItemResult&)>;
+
+    // Run the modulate and legend passes over sources. Returns the outputs
+    // that were written.
+    std::vector<fs::path> process_batch(const std::vector<fs::path>& sources,
+        const Options& options, const ProgressFn& progress);
+
+    // Process a single in-memory image (and optional legend) and return the
+    // final PNG in out
+    bool process_buffer(const std::vector<unsigned char>& image,
+        const std::vector<unsigned char>* legend, const Options& options,
+        std::vector<unsigned char>& out);
+
+    // --- Output manifest and cleanup -----------------------------------------
+    // Outputs are listed, relative to root, in kOutputManifestName
+    void record_outputs(const fs::path& root, const std::vector<fs::path>& outputs);
+
+    // After a cleanup: keep the manifest entries whose files are still there,
+    // and delete the manifest once none are
+    void prune_output_manifest(const fs::path& root);
+
+    // Every output of earlier runs under root, by suffix and manifest
+    std::vector<fs::path> find_generated_outputs(const fs::path& root, size_t* fromManifest = nullptr);
+
+    // Delete files in parallel, one folder per worker at a time. progress is
+    // polled from the calling thread with (done, total).
+    size_t remove_files_parallel(std::vector<fs::path> files, size_t& failed,
+        const std::function<void(size_t, size_t)>& progress = {});
+}
@@ -0,0 +1,765 @@
+#include "scout_service.h"
+#include "cpu_dispatch.h"
+#include "decoded_cache.h"
+#include "docx_report.h"
+#include "recompress.h"
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <condition_variable>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <map>
+#include <mutex>
+#include <random>
+#include <sstream>
+#include <thread>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#pragma comment(lib, "Ws2_32.lib")
+typedef SOCKET socket_t;
+static int close_socket(socket_t s) { return closesocket(s); }
+#define SHUT_BOTH SD_BOTH
+#else
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <unistd.h>
+typedef int socket_t;
+#define INVALID_SOCKET (-1)
+static int close_socket(socket_t s) { return ::close(s); }
+#define SHUT_BOTH SHUT_RDWR
+#endif
+
+namespace scout
+{
+    // Requests larger than this are refused
+    static const size_t kMaxBody = 256u << 20;
+
+    // A client silent for this long is dropped, so it can't hold a worker
+    static const int kReceiveTimeoutMs = 30000;
+
+    // Legends and hue scales kept prepared by the service
+    static const size_t kMaxLegends = 64;
+
+    // A client that disconnects mid-reply must not kill the service
+#ifdef MSG_NOSIGNAL
+    static const int kSendFlags = MSG_NOSIGNAL;
+#else
+    static const int kSendFlags = 0;
+#endif
+
+    // -------------------------------------------------------------------------
+    // Socket and HTTP helpers
+    // -------------------------------------------------------------------------
+
+    // Winsock must be initialised once per process before any socket call
+    static bool init_sockets()
+    {
+#ifdef _WIN32
+        static const bool ok = [] {
+            WSADATA data;
+            return WSAStartup(MAKEWORD(2, 2), &data) == 0;
+        }();
+        return ok;
+#else
+        return true;
+#endif
+    }
+
+    static void set_receive_timeout(socket_t s, int ms)
+    {
+#ifdef _WIN32
+        const DWORD timeout = static_cast<DWORD>(ms);
+#else
+        timeval timeout;
+        timeout.tv_sec = ms / 1000;
+        timeout.tv_usec = (ms % 1000) * 1000;
+#endif
+        ::setsockopt(s, SOL_SOCKET, SO_RCVTIMEO, reinterpret_cast<const char*>(&timeout), sizeof(timeout));
+    }
+
+    static bool send_all(socket_t s, const char* data, size_t size)
+    {
+        while (size > 0) {
+            int sent = ::send(s, data, static_cast<int>(std::min<size_t>(size, 1 << 20)), kSendFlags);
+            if (sent <= 0) return false;
+            data += sent;
+            size -= static_cast<size_t>(sent);
+        }
+        return true;
+    }
+
+    static bool send_all(socket_t s, const std::string& text)
+    {
+        return send_all(s, text.data(), text.size());
+    }
+
+    // -------------------------------------------------------------------------
+    // Access token
+    // -------------------------------------------------------------------------
+
+    fs::path service_token_path(unsigned short port)
+    {
+        // A folder only the user can read: the profile on Windows, the home
+        // folder (made private below) elsewhere. No shared temp fallback.
+#ifdef _WIN32
+        const char* base = std::getenv("LOCALAPPDATA");
+        if (!base || !*base) return {};
+        return fs::path(base) / "ScoutService" / ("service-" + std::to_string(port) + ".token");
+#else
+        const char* base = std::getenv("XDG_RUNTIME_DIR");
+        if (!base || !*base) base = std::getenv("HOME");
+        if (!base || !*base) return {};
+        return fs::path(base) / ".scout-service" / ("service-" + std::to_string(port) + ".token");
+#endif
+    }
+
+    static std::string random_token()
+    {
+        std::random_device random;
+        std::ostringstream text;
+        text << std::hex;
+        for (int i = 0; i < 8; ++i) {
+            const uint32_t word = random();
+            for (int shift = 28; shift >= 0; shift -= 4)
+                text << ((word >> shift) & 0xF);
+        }
+        return text.str();
+    }
+
+    static bool write_token(const fs::path& file, const std::string& token)
+    {
+        std::error_code ec;
+        fs::create_directories(file.parent_path(), ec);
+#ifdef _WIN32
+        std::ofstream out(file, std::ios::binary | std::ios::trunc);
+        out << token;
+        return static_cast<bool>(out);
+#else
+        // Created private, and made private again when it already existed
+        ::chmod(file.parent_path().c_str(), 0700);
+        const int fd = ::open(file.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_NOFOLLOW, 0600);
+        if (fd < 0) return false;
+        bool ok = ::fchmod(fd, 0600) == 0 &&
+            ::write(fd, token.data(), token.size()) == static_cast<ssize_t>(token.size());
+        return (::close(fd) == 0) && ok;
+#endif
+    }
+
+    bool read_service_token(unsigned short port, std::string& token)
+    {
+        const fs::path file = service_token_path(port);
+        if (file.empty()) return false;
+        std::ifstream in(file, std::ios::binary);
+        token.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+        return !token.empty();
+    }
+
+    // Compares every character, so the time taken says nothing about where
+    // a guess went wrong
+    static bool same_token(const std::string& a, const std::string& b)
+    {
+        if (a.size() != b.size()) return false;
+        unsigned char diff = 0;
+        for (size_t i = 0; i < a.size(); ++i)
+            diff |= static_cast<unsigned char>(a[i] ^ b[i]);
+        return diff == 0;
+    }
+
+    struct Request
+    {
+        std::string method;
+        std::string path;
+        std::map<std::string, std::string> query;
+        std::map<std::string, std::string> headers;   // lower-case names
+        std::vector<unsigned char> body;
+    };
+
+    static std::string to_lower(std::string s)
+    {
+        std::transform(s.begin(), s.end(), s.begin(), [](unsigned char c) { return (char)std::tolower(c); });
+        return s;
+    }
+
+    static std::string url_decode(const std::string& s)
+    {
+        std::string out;
+        for (size_t i = 0; i < s.size(); ++i) {
+            if (s[i] == '+') out += ' ';
+            else if (s[i] == '%' && i + 2 < s.size() &&
+                std::isxdigit((unsigned char)s[i + 1]) && std::isxdigit((unsigned char)s[i + 2])) {
+                out += static_cast<char>(std::stoi(s.substr(i + 1, 2), nullptr, 16));
+                i += 2;
+            }
+            else out += s[i];
+        }
+        return out;
+    }
+
+    static bool read_request(socket_t s, Request& req)
+    {
+        std::string head;
+        std::vector<char> buffer(64 * 1024);
+        size_t headerEnd = std::string::npos;
+
+        while (headerEnd == std::string::npos) {
+            int n = ::recv(s, buffer.data(), static_cast<int>(buffer.size()), 0);
+            if (n <= 0) return false;
+            head.append(buffer.data(), static_cast<size_t>(n));
+            headerEnd = head.find("\r\n\r\n");
+            if (headerEnd == std::string::npos && head.size() > 64 * 1024) return false;
+        }
+
+        std::istringstream lines(head.substr(0, headerEnd));
+        std::string line, target, version;
+        std::getline(lines, line);
+        std::istringstream(line) >> req.method >> target >> version;
+        if (req.method.empty() || target.empty()) return false;
+
+        while (std::getline(lines, line)) {
+            if (!line.empty() && line.back() == '\r') line.pop_back();
+            size_t colon = line.find(':');
+            if (colon == std::string::npos) continue;
+            std::string value = line.substr(colon + 1);
+            value.erase(0, value.find_first_not_of(" \t"));
+            req.headers[to_lower(line.substr(0, colon))] = value;
+        }
+
+        size_t q = target.find('?');
+        req.path = target.substr(0, q);
+        if (q != std::string::npos) {
+            std::istringstream params(target.substr(q + 1));
+            std::string kv;
+            while (std::getline(params, kv, '&')) {
+                size_t eq = kv.find('=');
+                if (eq == std::string::npos) req.query[url_decode(kv)] = "";
+                else req.query[url_decode(kv.substr(0, eq))] = url_decode(kv.substr(eq + 1));
+            }
+        }
+
+        size_t length = 0;
+        auto cl = req.headers.find("content-length");
+        if (cl != req.headers.end()) {
+            try { length = static_cast<size_t>(std::stoull(cl->second)); }
+            catch (...) { return false; }
+        }
+        if (length > kMaxBody) return false;
+
+        req.body.assign(head.begin() + static_cast<std::ptrdiff_t>(headerEnd + 4), head.end());
+        req.body.reserve(length);
+        while (req.body.size() < length) {
+            int n = ::recv(s, buffer.data(), static_cast<int>(std::min(buffer.size(), length - req.body.size())), 0);
+            if (n <= 0) return false;
+            req.body.insert(req.body.end(), buffer.data(), buffer.data() + n);
+        }
+        req.body.resize(length);
+        return true;
+    }
+
+    static void send_response(socket_t s, int status, const char* reason,
+        const char* contentType, const char* data, size_t size)
+    {
+        std::ostringstream head;
+        head << "HTTP/1.1 " << status << " " << reason << "\r\n"
+            << "Content-Type: " << contentType << "\r\n"
+            << "Content-Length: " << size << "\r\n"
+            << "Connection: close\r\n\r\n";
+        if (send_all(s, head.str()))
+            send_all(s, data, size);
+    }
+
+    static void send_text(socket_t s, int status, const char* reason, const std::string& text)
+    {
+        send_response(s, status, reason, "text/plain; charset=utf-8", text.data(), text.size());
+    }
+
+    // Chunked replies let long jobs stream their progress
+    static bool send_chunk(socket_t s, const std::string& text)
+    {
+        if (text.empty()) return true;
+        std::ostringstream size;
+        size << std::hex << text.size() << "\r\n";
+        return send_all(s, size.str()) && send_all(s, text) && send_all(s, "\r\n");
+    }
+
+    static fs::path utf8_path(std::string text)
+    {
+        while (!text.empty() && (text.back() == '\n' || text.back() == '\r' || text.back() == ' '))
+            text.pop_back();
+#ifdef __cpp_char8_t
+        return fs::path(std::u8string(text.begin(), text.end()));
+#else
+        return fs::u8path(text);
+#endif
+    }
+
+    static fs::path path_from_body(const std::vector<unsigned char>& body)
+    {
+        return utf8_path(std::string(body.begin(), body.end()));
+    }
+
+    static std::string describe(const ItemResult& r)
+    {
+        static const char* const outcomes[] = { "OK", "FAILED", "HIT", "DUP", "SKIPPED", "NO_LEGEND" };
+        std::ostringstream line;
+        line << outcomes[static_cast<int>(r.outcome)] << "\t"
+            << (r.stage == Stage::Modulate ? "modulate" : "legend") << "\t"
+            << (r.index + 1) << "/" << r.total << "\t"
+            << r.input.string() << "\t" << r.output.string() << "\n";
+        return line.str();
+    }
+
+    // -------------------------------------------------------------------------
+    // Service
+    // -------------------------------------------------------------------------
+
+    struct Service::Impl
+    {
+        explicit Impl(const ServiceOptions& o)
+            : options(o),
+              legends(o.workDir.empty() ? fs::temp_directory_path() / "scout-service" : o.workDir, kMaxLegends)
+        {
+            options.defaults.legendCache = &legends;
+        }
+
+        void worker();
+        void handle(socket_t s);
+        void handle_process(socket_t s, const Request& req);
+        void handle_process_file(socket_t s, const Request& req);
+        void handle_process_tree(socket_t s, const Request& req);
+        void handle_report(socket_t s, const Request& req);
+        std::shared_ptr<const reportgen::Template> template_for(const fs::path& path);
+
+        bool allowed(const Request& req) const;
+
+        ServiceOptions options;
+        LegendCache legends;
+        std::string error;
+
+        // Written to service_token_path() by start(); every request must
+        // carry it
+        std::string token;
+        fs::path tokenFile;
+
+        socket_t listener = INVALID_SOCKET;
+        std::atomic<bool> running{ false };
+        std::vector<std::thread> workers;
+
+        std::mutex queueMutex;
+        std::condition_variable queueReady;
+        std::deque<socket_t> queue;
+
+        // Parsed templates, reloaded when the file changes
+        std::mutex templateMutex;
+        std::map<fs::path, std::pair<fs::file_time_type, std::shared_ptr<const reportgen::Template>>> templates;
+
+        std::atomic<size_t> jobs{ 0 };
+
+        // _scout_outputs.txt is read, merged and rewritten, so requests on
+        // the same root take turns
+        std::mutex manifestMutex;
+        std::map<fs::path, std::mutex> manifestLocks;
+
+        // Outputs of /process-file and /process-tree, recompressed only while
+        // no request is being handled
+        std::unique_ptr<RecompressQueue> recompress;
+    };
+
+    void Service::Impl::worker()
+    {
+        while (true) {
+            socket_t s;
+            {
+                std::unique_lock<std::mutex> lock(queueMutex);
+                queueReady.wait(lock, [&] { return !queue.empty() || !running; });
+                if (queue.empty()) return;
+                s = queue.front();
+                queue.pop_front();
+            }
+            handle(s);
+            close_socket(s);
+        }
+    }
+
+    // Browsers may reach 127.0.0.1 too: a page can post to it cross-origin
+    // or through a rebound DNS name. Such requests carry an Origin or a
+    // foreign Host, and no page can read the token file.
+    bool Service::Impl::allowed(const Request& req) const
+    {
+        if (req.headers.count("origin")) return false;
+
+        auto host = req.headers.find("host");
+        const std::string port = ":" + std::to_string(options.port);
+        if (host == req.headers.end()) return false;
+        const std::string name = to_lower(host->second);
+        if (name != "127.0.0.1" + port && name != "localhost" + port) return false;
+
+        auto sent = req.headers.find("x-scout-token");
+        return sent != req.headers.end() && same_token(sent->second, token);
+    }
+
+    void Service::Impl::handle(socket_t s)
+    {
+        Request req;
+        if (!read_request(s, req)) {
+            send_text(s, 400, "Bad Request", "malformed request\n");
+            return;
+        }
+        if (!allowed(req)) {
+            send_text(s, 403, "Forbidden", "missing or invalid token, host or origin\n");
+            return;
+        }
+
+        ++jobs;
+        if (recompress) recompress->pause();
+        try {
+            if (req.method == "GET" && req.path == "/status") {
+                std::ostringstream text;
+                text << "ok\njobs " << jobs << "\nworkers " << workers.size()
+                    << "\nisa " << isa_name(active_isa()) << "\n";
+                {
+                    std::lock_guard<std::mutex> lock(templateMutex);
+                    text << "templates " << templates.size() << "\n";
+                }
+                const DecodedCache::Stats decoded = decoded_images().stats();
+                text << "decoded-hits " << decoded.hits << "\ndecoded-misses " << decoded.misses
+                    << "\ndecoded-bytes " << decoded.bytes << "\n";
+                if (recompress) {
+                    const RecompressStats st = recompress->stats();
+                    text << "recompress-pending " << recompress->pending() << "\nrecompress-done " << st.done
+                        << "\nrecompress-saved " << (st.bytesBefore - st.bytesAfter) << "\n";
+                }
+                send_text(s, 200, "OK", text.str());
+            }
+            else if (req.method == "POST" && req.path == "/process") handle_process(s, req);
+            else if (req.method == "POST" && req.path == "/process-file") handle_process_file(s, req);
+            else if (req.method == "POST" && req.path == "/process-tree") handle_process_tree(s, req);
+            else if (req.method == "POST" && req.path == "/report") handle_report(s, req);
+            else send_text(s, 404, "Not Found", "unknown endpoint\n");
+        }
+        catch (const std::exception& e) {
+            send_text(s, 500, "Internal Server Error", std::string(e.what()) + "\n");
+        }
+        catch (...) {
+            send_text(s, 500, "Internal Server Error", "unexpected error\n");
+        }
+        if (recompress) recompress->resume();
+    }
+
+    void Service::Impl::handle_process(socket_t s, const Request& req)
+    {
+        Options opts;
+        if (!parse_options(req.query, options.defaults, opts) || req.body.empty()) {
+            send_text(s, 400, "Bad Request", "invalid options or empty body\n");
+            return;
+        }
+
+        // The body is the image followed by X-Legend-Length bytes of legend
+        size_t legendSize = 0;
+        auto lh = req.headers.find("x-legend-length");
+        if (lh != req.headers.end()) legendSize = static_cast<size_t>(std::stoull(lh->second));
+        if (legendSize >= req.body.size()) {
+            send_text(s, 400, "Bad Request", "legend larger than body\n");
+            return;
+        }
+
+        const auto split = req.body.end() - static_cast<std::ptrdiff_t>(legendSize);
+        std::vector<unsigned char> image(req.body.begin(), split);
+        std::vector<unsigned char> legend(split, req.body.end());
+
+        std::vector<unsigned char> out;
+        if (!process_buffer(image, legend.empty() ? nullptr : &legend, opts, out)) {
+            send_text(s, 500, "Internal Server Error", "processing failed\n");
+            return;
+        }
+        send_response(s, 200, "OK", "image/png", reinterpret_cast<const char*>(out.data()), out.size());
+    }
+
+    void Service::Impl::handle_process_file(socket_t s, const Request& req)
+    {
+        Options opts;
+        fs::path source = path_from_body(req.body);
+        if (!parse_options(req.query, options.defaults, opts) || !fs::is_regular_file(source)) {
+            send_text(s, 400, "Bad Request", "invalid options or source\n");
+            return;
+        }
+
+        std::string text;
+        auto written = process_batch({ source }, opts, [&](const ItemResult& r) { text += describe(r); return true; });
+        send_text(s, 200, "OK", text);
+        if (recompress) recompress->add(written);
+    }
+
+    void Service::Impl::handle_process_tree(socket_t s, const Request& req)
+    {
+        Options opts;
+        fs::path root = path_from_body(req.body);
+        if (!parse_options(req.query, options.defaults, opts) || !fs::is_directory(root)) {
+            send_text(s, 400, "Bad Request", "invalid options or root\n");
+            return;
+        }
+
+        send_all(s, "HTTP/1.1 200 OK\r\nContent-Type: text/plain; charset=utf-8\r\n"
+            "Transfer-Encoding: chunked\r\nConnection: close\r\n\r\n");
+
+        std::vector<fs::path> sources, generated;
+        discover_pngs(root, sources, generated);
+
+        // Stop early when the client goes away
+        auto written = process_batch(sources, opts, [&](const ItemResult& r) {
+            return send_chunk(s, describe(r));
+        });
+        {
+            std::error_code ec;
+            fs::path key = fs::weakly_canonical(root, ec);
+            if (ec) key = root;
+
+            std::unique_lock<std::mutex> lock(manifestMutex);
+            std::mutex& rootMutex = manifestLocks[key];
+            lock.unlock();
+            std::lock_guard<std::mutex> rootLock(rootMutex);
+            record_outputs(root, written);
+        }
+
+        send_all(s, "0\r\n\r\n");
+        if (recompress) recompress->add(written);
+    }
+
+    std::shared_ptr<const reportgen::Template> Service::Impl::template_for(const fs::path& path)
+    {
+        std::error_code ec;
+        const auto stamp = fs::last_write_time(path, ec);
+
+        std::lock_guard<std::mutex> lock(templateMutex);
+        auto it = templates.find(path);
+        if (it != templates.end() && it->second.first == stamp)
+            return it->second.second;
+
+        auto parsed = std::make_shared<const reportgen::Template>(path);
+        if (!parsed->valid())
+            return nullptr;
+        templates[path] = { stamp, parsed };
+        return parsed;
+    }
+
+    void Service::Impl::handle_report(socket_t s, const Request& req)
+    {
+        std::istringstream lines(std::string(req.body.begin(), req.body.end()));
+        std::string templateLine, outputLine, line;
+        std::getline(lines, templateLine);
+        std::getline(lines, outputLine);
+
+        auto trim = [](std::string& t) { while (!t.empty() && (t.back() == '\r' || t.back() == '\n')) t.pop_back(); };
+        trim(templateLine);
+        trim(outputLine);
+
+        auto tmpl = template_for(utf8_path(templateLine));
+        if (!tmpl || outputLine.empty()) {
+            send_text(s, 400, "Bad Request", "invalid template or output\n");
+            return;
+        }
+
+        std::vector<reportgen::Entry> entries;
+        while (std::getline(lines, line)) {
+            trim(line);
+            if (line.empty()) continue;
+
+            std::istringstream fields(line);
+            reportgen::Entry e;
+            std::string image;
+            std::getline(fields, e.header, '\t');
+            std::getline(fields, e.description, '\t');
+            std::getline(fields, image);
+            e.imagePath = utf8_path(image);
+            entries.push_back(std::move(e));
+        }
+
+        if (!reportgen::generateDocx(*tmpl, utf8_path(outputLine), entries))
+            send_text(s, 500, "Internal Server Error", "report generation failed\n");
+        else
+            send_text(s, 200, "OK", outputLine + "\n");
+    }
+
+    Service::Service(const ServiceOptions& options)
+        : m_impl(new Impl(options))
+    {}
+
+    Service::~Service()
+    {
+        stop();
+    }
+
+    const std::string& Service::error() const
+    {
+        return m_impl->error;
+    }
+
+    bool Service::start()
+    {
+        if (!init_sockets()) {
+            m_impl->error = "socket library unavailable";
+            return false;
+        }
+
+        socket_t l = ::socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+        if (l == INVALID_SOCKET) {
+            m_impl->error = "cannot create socket";
+            return false;
+        }
+
+        // Local clients only
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(m_impl->options.port);
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+        if (::bind(l, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 || ::listen(l, 64) != 0) {
+            close_socket(l);
+            m_impl->error = "cannot listen on 127.0.0.1:" + std::to_string(m_impl->options.port);
+            return false;
+        }
+
+        // Only once the port is ours, so a second instance can't replace the
+        // token of the one already serving
+        m_impl->token = random_token();
+        m_impl->tokenFile = service_token_path(m_impl->options.port);
+        if (m_impl->tokenFile.empty() || !write_token(m_impl->tokenFile, m_impl->token)) {
+            close_socket(l);
+            m_impl->error = "cannot write the access token " + m_impl->tokenFile.string();
+            return false;
+        }
+
+        m_impl->listener = l;
+        m_impl->running = true;
+        if (m_impl->options.recompress)
+            m_impl->recompress = std::make_unique<RecompressQueue>();
+
+        size_t count = m_impl->options.threads;
+        if (count == 0) count = std::max(1u, std::thread::hardware_concurrency());
+        for (size_t i = 0; i < count; ++i)
+            m_impl->workers.emplace_back([this] { m_impl->worker(); });
+        return true;
+    }
+
+    void Service::run()
+    {
+        while (m_impl->running) {
+            socket_t c = ::accept(m_impl->listener, nullptr, nullptr);
+            if (c == INVALID_SOCKET) {
+                if (!m_impl->running) break;
+                continue;
+            }
+            set_receive_timeout(c, kReceiveTimeoutMs);
+
+            std::lock_guard<std::mutex> lock(m_impl->queueMutex);
+            m_impl->queue.push_back(c);
+            m_impl->queueReady.notify_one();
+        }
+    }
+
+    void Service::stop()
+    {
+        if (!m_impl->running.exchange(false))
+            return;
+
+        // Wakes up accept() in run()
+        ::shutdown(m_impl->listener, SHUT_BOTH);
+        close_socket(m_impl->listener);
+        m_impl->listener = INVALID_SOCKET;
+
+        m_impl->queueReady.notify_all();
+        for (auto& t : m_impl->workers) t.join();
+        m_impl->workers.clear();
+        m_impl->recompress.reset();
+
+        std::error_code ec;
+        fs::remove(m_impl->tokenFile, ec);
+    }
+
+    // -------------------------------------------------------------------------
+    // Client
+    // -------------------------------------------------------------------------
+
+    bool service_request(unsigned short port, const std::string& method,
+        const std::string& target, const std::vector<unsigned char>& body,
+        const std::vector<std::string>& headers, int& status,
+        std::vector<unsigned char>& reply)
+    {
+        if (!init_sockets()) return false;
+
+        socket_t s = ::socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+        if (s == INVALID_SOCKET) return false;
+
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(port);
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        if (::connect(s, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+            close_socket(s);
+            return false;
+        }
+
+        std::string token;
+        read_service_token(port, token);
+
+        std::ostringstream head;
+        head << method << " " << target << " HTTP/1.1\r\nHost: 127.0.0.1:" << port << "\r\n"
+            << "X-Scout-Token: " << token << "\r\n"
+            << "Content-Length: " << body.size() << "\r\nConnection: close\r\n";
+        for (const auto& h : headers) head << h << "\r\n";
+        head << "\r\n";
+
+        bool ok = send_all(s, head.str()) &&
+            send_all(s, reinterpret_cast<const char*>(body.data()), body.size());
+
+        // The server closes the connection after the reply, so read to the end
+        std::string raw;
+        std::vector<char> buffer(64 * 1024);
+        int n;
+        while (ok && (n = ::recv(s, buffer.data(), static_cast<int>(buffer.size()), 0)) > 0)
+            raw.append(buffer.data(), static_cast<size_t>(n));
+        close_socket(s);
+
+        size_t headerEnd = raw.find("\r\n\r\n");
+        if (!ok || headerEnd == std::string::npos) return false;
+
+        std::string version;
+        std::istringstream(raw.substr(0, raw.find("\r\n"))) >> version >> status;
+
+        const std::string headText = to_lower(raw.substr(0, headerEnd));
+        std::string data = raw.substr(headerEnd + 4);
+        reply.clear();
+
+        if (headText.find("transfer-encoding: chunked") == std::string::npos) {
+            reply.assign(data.begin(), data.end());
+            return true;
+        }
+
+        // De-chunk
+        size_t pos = 0;
+        while (pos < data.size()) {
+            size_t eol = data.find("\r\n", pos);
+            if (eol == std::string::npos) return false;
+            size_t size = std::stoul(data.substr(pos, eol - pos), nullptr, 16);
+            if (size == 0) break;
+            if (eol + 2 + size > data.size()) return false;
+            reply.insert(reply.end(), data.begin() + static_cast<std::ptrdiff_t>(eol + 2),
+                data.begin() + static_cast<std::ptrdiff_t>(eol + 2 + size));
+            pos = eol + 2 + size + 2;
+        }
+        return true;
+    }
+}
@@ -0,0 +1,79 @@
+#pragma once
+#include "scout_pipeline.h"
+#include <memory>
+#include <string>
+#include <vector>
+
+// Long-running local processing service. It speaks plain HTTP/1.1 on
+// 127.0.0.1 and keeps its worker threads, prepared legends and parsed report
+// templates between requests, so a single image costs one or two ImageMagick
+// steps instead of a full batch start.
+//
+//   GET  /status                       counters and the CPU path, as text
+//   POST /process?<options>            body: PNG [+ legend, see X-Legend-Length]
+//                                      reply: the processed PNG
+//   POST /process-file?<options>       body: UTF-8 path of one source
+//   POST /process-tree?<options>       body: UTF-8 root folder; one line per
+//                                      item is streamed back as it finishes
+//   POST /report                       body: template path, output path, then
+//                                      one "header<TAB>description<TAB>image"
+//                                      line per page
+//
+// <options> are brightness, saturation, hue, modulate (0/1), legend (0/1),
+// crop (0/1), scale (percent), edge (top/right/bottom/left), legend-source
+// (file/scale/auto, see LegendSource), placement (overlay/extend), palette
+// (off/exact/reduce, see PaletteMode), stamp (0/1), stamp-corner
+// (top-left/top-right/bottom-left/bottom-right) and metadata (0/1); missing
+// ones keep the service defaults. The stamp needs a file name, so /process
+// ignores it. Outputs record these options as PNG text, see
+// read_output_options.
+//
+// Every request needs an X-Scout-Token header with the token start() writes
+// to service_token_path(), a file only the user can read, and a Host of
+// 127.0.0.1:<port> or localhost:<port>. Requests with an Origin header are
+// refused, so web pages can't drive the service.
+namespace scout
+{
+    struct ServiceOptions
+    {
+        unsigned short port = 8765;
+        size_t threads = 0;          // 0 = one per core
+        fs::path workDir;            // prepared legends; default: temp folder
+        bool recompress = false;     // recompress outputs while idle (RecompressQueue)
+        Options defaults;
+    };
+
+    class Service
+    {
+    public:
+        explicit Service(const ServiceOptions& options);
+        ~Service();
+
+        // Bind the port and start the workers. Returns false (with a message
+        // in error()) when the port can't be used.
+        bool start();
+
+        // Accept connections until stop() is called
+        void run();
+        void stop();
+
+        const std::string& error() const;
+
+    private:
+        struct Impl;
+        std::unique_ptr<Impl> m_impl;
+    };
+
+    // Where the service on port keeps its access token (empty when there is
+    // no private folder to put it in), and the token of a running service
+    fs::path service_token_path(unsigned short port);
+    bool read_service_token(unsigned short port, std::string& token);
+
+    // Minimal client used by the tool's --client mode and for testing: send
+    // one request to a local service, with its token, and collect the reply
+    // body
+    bool service_request(unsigned short port, const std::string& method,
+        const std::string& target, const std::vector<unsigned char>& body,
+        const std::vector<std::string>& headers, int& status,
+        std::vector<unsigned char>& reply);
+}
@@ -0,0 +1,263 @@
+#include "text_stamp.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <mutex>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define SCOUT_TEXT_SSE2 1
+#endif
+
+namespace scout
+{
+    // Printable ASCII (0x20..0x7E) as 5 columns of 7 rows, bit 0 at the top
+    static const uint8_t kFont5x7[95][5] = {
+        { 0x00, 0x00, 0x00, 0x00, 0x00 }, { 0x00, 0x00, 0x5F, 0x00, 0x00 }, // space !
+        { 0x00, 0x07, 0x00, 0x07, 0x00 }, { 0x14, 0x7F, 0x14, 0x7F, 0x14 }, // " #
+        { 0x24, 0x2A, 0x7F, 0x2A, 0x12 }, { 0x23, 0x13, 0x08, 0x64, 0x62 }, // $ %
+        { 0x36, 0x49, 0x55, 0x22, 0x50 }, { 0x00, 0x05, 0x03, 0x00, 0x00 }, // & '
+        { 0x00, 0x1C, 0x22, 0x41, 0x00 }, { 0x00, 0x41, 0x22, 0x1C, 0x00 }, // ( )
+        { 0x08, 0x2A, 0x1C, 0x2A, 0x08 }, { 0x08, 0x08, 0x3E, 0x08, 0x08 }, // * +
+        { 0x00, 0x50, 0x30, 0x00, 0x00 }, { 0x08, 0x08, 0x08, 0x08, 0x08 }, // , -
+        { 0x00, 0x60, 0x60, 0x00, 0x00 }, { 0x20, 0x10, 0x08, 0x04, 0x02 }, // . /
+        { 0x3E, 0x51, 0x49, 0x45, 0x3E }, { 0x00, 0x42, 0x7F, 0x40, 0x00 }, // 0 1
+        { 0x42, 0x61, 0x51, 0x49, 0x46 }, { 0x21, 0x41, 0x45, 0x4B, 0x31 }, // 2 3
+        { 0x18, 0x14, 0x12, 0x7F, 0x10 }, { 0x27, 0x45, 0x45, 0x45, 0x39 }, // 4 5
+        { 0x3C, 0x4A, 0x49, 0x49, 0x30 }, { 0x01, 0x71, 0x09, 0x05, 0x03 }, // 6 7
+        { 0x36, 0x49, 0x49, 0x49, 0x36 }, { 0x06, 0x49, 0x49, 0x29, 0x1E }, // 8 9
+        { 0x00, 0x36, 0x36, 0x00, 0x00 }, { 0x00, 0x56, 0x36, 0x00, 0x00 }, // : ;
+        { 0x08, 0x14, 0x22, 0x41, 0x00 }, { 0x14, 0x14, 0x14, 0x14, 0x14 }, // < =
+        { 0x00, 0x41, 0x22, 0x14, 0x08 }, { 0x02, 0x01, 0x51, 0x09, 0x06 }, // > ?
+        { 0x32, 0x49, 0x79, 0x41, 0x3E }, { 0x7E, 0x11, 0x11, 0x11, 0x7E }, // @ A
+        { 0x7F, 0x49, 0x49, 0x49, 0x36 }, { 0x3E, 0x41, 0x41, 0x41, 0x22 }, // B C
+        { 0x7F, 0x41, 0x41, 0x22, 0x1C }, { 0x7F, 0x49, 0x49, 0x49, 0x41 }, // D E
+        { 0x7F, 0x09, 0x09, 0x09, 0x01 }, { 0x3E, 0x41, 0x49, 0x49, 0x7A }, // F G
+        { 0x7F, 0x08, 0x08, 0x08, 0x7F }, { 0x00, 0x41, 0x7F, 0x41, 0x00 }, // H I
+        { 0x20, 0x40, 0x41, 0x3F, 0x01 }, { 0x7F, 0x08, 0x14, 0x22, 0x41 }, // J K
+        { 0x7F, 0x40, 0x40, 0x40, 0x40 }, { 0x7F, 0x02, 0x0C, 0x02, 0x7F }, // L M
+        { 0x7F, 0x04, 0x08, 0x10, 0x7F }, { 0x3E, 0x41, 0x41, 0x41, 0x3E }, // N O
+        { 0x7F, 0x09, 0x09, 0x09, 0x06 }, { 0x3E, 0x41, 0x51, 0x21, 0x5E }, // P Q
+        { 0x7F, 0x09, 0x19, 0x29, 0x46 }, { 0x46, 0x49, 0x49, 0x49, 0x31 }, // R S
+        { 0x01, 0x01, 0x7F, 0x01, 0x01 }, { 0x3F, 0x40, 0x40, 0x40, 0x3F }, // T U
+        { 0x1F, 0x20, 0x40, 0x20, 0x1F }, { 0x3F, 0x40, 0x38, 0x40, 0x3F }, // V W
+        { 0x63, 0x14, 0x08, 0x14, 0x63 }, { 0x07, 0x08, 0x70, 0x08, 0x07 }, // X Y
+        { 0x61, 0x51, 0x49, 0x45, 0x43 }, { 0x00, 0x7F, 0x41, 0x41, 0x00 }, // Z [
+        { 0x02, 0x04, 0x08, 0x10, 0x20 }, { 0x00, 0x41, 0x41, 0x7F, 0x00 }, // \ ]
+        { 0x04, 0x02, 0x01, 0x02, 0x04 }, { 0x40, 0x40, 0x40, 0x40, 0x40 }, // ^ _
+        { 0x00, 0x01, 0x02, 0x04, 0x00 }, { 0x20, 0x54, 0x54, 0x54, 0x78 }, // ` a
+        { 0x7F, 0x48, 0x44, 0x44, 0x38 }, { 0x38, 0x44, 0x44, 0x44, 0x20 }, // b c
+        { 0x38, 0x44, 0x44, 0x48, 0x7F }, { 0x38, 0x54, 0x54, 0x54, 0x18 }, // d e
+        { 0x08, 0x7E, 0x09, 0x01, 0x02 }, { 0x0C, 0x52, 0x52, 0x52, 0x3E }, // f g
+        { 0x7F, 0x08, 0x04, 0x04, 0x78 }, { 0x00, 0x44, 0x7D, 0x40, 0x00 }, // h i
+        { 0x20, 0x40, 0x44, 0x3D, 0x00 }, { 0x7F, 0x10, 0x28, 0x44, 0x00 }, // j k
+        { 0x00, 0x41, 0x7F, 0x40, 0x00 }, { 0x7C, 0x04, 0x18, 0x04, 0x78 }, // l m
+        { 0x7C, 0x08, 0x04, 0x04, 0x78 }, { 0x38, 0x44, 0x44, 0x44, 0x38 }, // n o
+        { 0x7C, 0x14, 0x14, 0x14, 0x08 }, { 0x08, 0x14, 0x14, 0x18, 0x7C }, // p q
+        { 0x7C, 0x08, 0x04, 0x04, 0x08 }, { 0x48, 0x54, 0x54, 0x54, 0x20 }, // r s
+        { 0x04, 0x3F, 0x44, 0x40, 0x20 }, { 0x3C, 0x40, 0x40, 0x20, 0x7C }, // t u
+        { 0x1C, 0x20, 0x40, 0x20, 0x1C }, { 0x3C, 0x40, 0x30, 0x40, 0x3C }, // v w
+        { 0x44, 0x28, 0x10, 0x28, 0x44 }, { 0x0C, 0x50, 0x50, 0x50, 0x3C }, // x y
+        { 0x44, 0x64, 0x54, 0x4C, 0x44 }, { 0x00, 0x08, 0x36, 0x41, 0x00 }, // z {
+        { 0x00, 0x00, 0x7F, 0x00, 0x00 }, { 0x00, 0x41, 0x36, 0x08, 0x00 }, // | }
+        { 0x08, 0x04, 0x08, 0x10, 0x08 },                                   // ~
+    };
+
+    constexpr int kFontW = 5, kFontH = 7;
+    constexpr int kSupersample = 4;
+
+    // The font scaled to pixelHeight with kSupersample^2 samples per pixel,
+    // so sizes that aren't a multiple of 7 come out smooth instead of uneven
+    GlyphAtlas::GlyphAtlas(int pixelHeight)
+        : m_height(std::max(kFontH, pixelHeight))
+    {
+        const double scale = static_cast<double>(m_height) / kFontH;
+        m_cellWidth = static_cast<int>(std::ceil(kFontW * scale));
+        m_advance = static_cast<int>(std::lround((kFontW + 1) * scale));
+
+        const int atlasWidth = 95 * m_cellWidth;
+        m_coverage.assign(static_cast<size_t>(atlasWidth) * m_height, 0);
+
+        for (int g = 0; g < 95; ++g) {
+            for (int y = 0; y < m_height; ++y) {
+                uint8_t* row = m_coverage.data() + static_cast<size_t>(y) * atlasWidth + g * m_cellWidth;
+                for (int x = 0; x < m_cellWidth; ++x) {
+                    int hits = 0;
+                    for (int sy = 0; sy < kSupersample; ++sy) {
+                        const int fy = static_cast<int>((y + (sy + 0.5) / kSupersample) / scale);
+                        for (int sx = 0; sx < kSupersample; ++sx) {
+                            const int fx = static_cast<int>((x + (sx + 0.5) / kSupersample) / scale);
+                            if (fx < kFontW && fy < kFontH && (kFont5x7[g][fx] >> fy) & 1)
+                                ++hits;
+                        }
+                    }
+                    row[x] = static_cast<uint8_t>(hits * 255 / (kSupersample * kSupersample));
+                }
+            }
+        }
+    }
+
+    const GlyphAtlas& GlyphAtlas::get(int pixelHeight)
+    {
+        static std::mutex mutex;
+        static std::map<int, std::unique_ptr<GlyphAtlas>> atlases;
+
+        std::lock_guard<std::mutex> lock(mutex);
+        auto& atlas = atlases[pixelHeight];
+        if (!atlas)
+            atlas.reset(new GlyphAtlas(pixelHeight));
+        return *atlas;
+    }
+
+    // Column 0 of the glyph's cell in the first atlas row
+    const uint8_t* GlyphAtlas::glyph(unsigned char c) const
+    {
+        if (c < 0x20 || c > 0x7E) c = '?';
+        return m_coverage.data() + static_cast<size_t>(c - 0x20) * m_cellWidth;
+    }
+
+    // One character per byte, except that a UTF-8 sequence counts once
+    template <class Fn>
+    static void for_each_char(std::string_view text, Fn fn)
+    {
+        for (size_t i = 0; i < text.size(); ++i) {
+            const unsigned char c = static_cast<unsigned char>(text[i]);
+            if ((c & 0xC0) == 0x80) continue;
+            fn(c < 0x80 ? c : static_cast<unsigned char>('?'));
+        }
+    }
+
+    int GlyphAtlas::text_width(std::string_view text) const
+    {
+        int n = 0;
+        for_each_char(text, [&](unsigned char) { ++n; });
+        return n == 0 ? 0 : (n - 1) * m_advance + m_cellWidth;
+    }
+
+    // d = (d * (255 - a) + c * a) / 255, rounded, for one RGBA pixel
+    static inline void blend_pixel(uint8_t* d, const uint8_t* c, unsigned a)
+    {
+        for (int k = 0; k < 4; ++k) {
+            const unsigned v = d[k] * (255u - a) + c[k] * a + 128u;
+            d[k] = static_cast<uint8_t>((v + (v >> 8)) >> 8);
+        }
+    }
+
+    // Blend colour into n pixels with per-pixel coverage
+    static void blend_span(uint8_t* d, const uint8_t* coverage, int n, const uint8_t* colour)
+    {
+        int x = 0;
+#ifdef SCOUT_TEXT_SSE2
+        // Four pixels per step, in 16-bit lanes. Exact: the same rounding as
+        // blend_pixel, and every intermediate fits in 16 bits.
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i c16 = _mm_set_epi16(colour[3], colour[2], colour[1], colour[0],
+            colour[3], colour[2], colour[1], colour[0]);
+        const __m128i full = _mm_set1_epi16(255);
+        const __m128i half = _mm_set1_epi16(128);
+        for (; x + 4 <= n; x += 4) {
+            uint32_t cov4;
+            std::memcpy(&cov4, coverage + x, 4);
+            if (cov4 == 0) continue;
+
+            // a0 a0 a0 a0 a1 a1 a1 a1 | a2 ... a3 as 16-bit lanes
+            __m128i a = _mm_unpacklo_epi8(_mm_cvtsi32_si128(static_cast<int>(cov4)), zero);
+            a = _mm_unpacklo_epi16(a, a);
+            const __m128i aLo = _mm_unpacklo_epi32(a, a);
+            const __m128i aHi = _mm_unpackhi_epi32(a, a);
+
+            const __m128i px = _mm_loadu_si128(reinterpret_cast<const __m128i*>(d + x * 4));
+            __m128i lo = _mm_unpacklo_epi8(px, zero);
+            __m128i hi = _mm_unpackhi_epi8(px, zero);
+
+            lo = _mm_add_epi16(_mm_add_epi16(_mm_mullo_epi16(lo, _mm_sub_epi16(full, aLo)),
+                _mm_mullo_epi16(c16, aLo)), half);
+            hi = _mm_add_epi16(_mm_add_epi16(_mm_mullo_epi16(hi, _mm_sub_epi16(full, aHi)),
+                _mm_mullo_epi16(c16, aHi)), half);
+            lo = _mm_srli_epi16(_mm_add_epi16(lo, _mm_srli_epi16(lo, 8)), 8);
+            hi = _mm_srli_epi16(_mm_add_epi16(hi, _mm_srli_epi16(hi, 8)), 8);
+
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(d + x * 4), _mm_packus_epi16(lo, hi));
+        }
+#endif
+        for (; x < n; ++x)
+            if (coverage[x])
+                blend_pixel(d + x * 4, colour, coverage[x]);
+    }
+
+    void GlyphAtlas::draw(const ImageView& image, int x, int y, std::string_view text, const uint8_t rgba[4]) const
+    {
+        const size_t atlasWidth = static_cast<size_t>(95) * m_cellWidth;
+        const int y0 = std::max(0, y), y1 = std::min(image.height, y + m_height);
+
+        int penX = x;
+        for_each_char(text, [&](unsigned char c) {
+            const int x0 = std::max(0, penX), x1 = std::min(image.width, penX + m_cellWidth);
+            if (c != ' ' && x0 < x1) {
+                const uint8_t* cell = glyph(c);
+                for (int row = y0; row < y1; ++row)
+                    blend_span(image.row(row) + static_cast<size_t>(x0) * 4,
+                        cell + static_cast<size_t>(row - y) * atlasWidth + (x0 - penX), x1 - x0, rgba);
+            }
+            penX += m_advance;
+        });
+    }
+
+    void fill_blend(const ImageView& image, int x, int y, int w, int h, const uint8_t rgb[3], uint8_t alpha)
+    {
+        const int x0 = std::max(0, x), x1 = std::min(image.width, x + w);
+        const int y0 = std::max(0, y), y1 = std::min(image.height, y + h);
+        if (x0 >= x1) return;
+
+        const uint8_t colour[4] = { rgb[0], rgb[1], rgb[2], 255 };
+        const std::vector<uint8_t> coverage(static_cast<size_t>(x1 - x0), alpha);
+        for (int row = y0; row < y1; ++row)
+            blend_span(image.row(row) + static_cast<size_t>(x0) * 4, coverage.data(), x1 - x0, colour);
+    }
+
+    int stamp_text_height(int imageHeight, const StampOptions& stamp)
+    {
+        return stamp.pixelHeight > 0 ? stamp.pixelHeight : std::max(10, imageHeight / 45);
+    }
+
+    static const uint8_t kStampText[4] = { 255, 255, 255, 255 };
+    static const uint8_t kStampPanel[3] = { 0, 0, 0 };
+    constexpr uint8_t kStampPanelAlpha = 160;
+
+    // Panel around the text: padding of a third of the text height
+    static void stamp_panel_size(const GlyphAtlas& atlas, const std::string& text, int& w, int& h, int& pad)
+    {
+        pad = std::max(2, atlas.height() / 3);
+        w = atlas.text_width(text) + 2 * pad;
+        h = atlas.height() + 2 * pad;
+    }
+
+    Image render_text_stamp(const std::string& text, int pixelHeight)
+    {
+        const GlyphAtlas& atlas = GlyphAtlas::get(pixelHeight);
+        int w, h, pad;
+        stamp_panel_size(atlas, text, w, h, pad);
+
+        Image out(w, h);
+        fill_blend(out.view(), 0, 0, w, h, kStampPanel, kStampPanelAlpha);
+        atlas.draw(out.view(), pad, pad, text, kStampText);
+        return out;
+    }
+
+    void stamp_text(const ImageView& image, const std::string& text, const StampOptions& stamp)
+    {
+        const GlyphAtlas& atlas = GlyphAtlas::get(stamp_text_height(image.height, stamp));
+        int w, h, pad;
+        stamp_panel_size(atlas, text, w, h, pad);
+
+        const bool right = stamp.corner == Corner::TopRight || stamp.corner == Corner::BottomRight;
+        const bool bottom = stamp.corner == Corner::BottomLeft || stamp.corner == Corner::BottomRight;
+        const int x = right ? image.width - w : 0;
+        const int y = bottom ? image.height - h : 0;
+
+        fill_blend(image, x, y, w, h, kStampPanel, kStampPanelAlpha);
+        atlas.draw(image, x + pad, y + pad, text, kStampText);
+    }
+}
@@ -0,0 +1,50 @@
+#pragma once
+#include "pixel_ops.h"
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Text drawn straight into decoded pixels: a 5x7 bitmap font rasterised
+// once per pixel size into an anti-aliased coverage atlas, then blended
+// glyph by glyph. Used for the capture stamp (file, folder, time) and the
+// hue scale labels.
+namespace scout
+{
+    class GlyphAtlas
+    {
+    public:
+        // The atlas for text pixelHeight pixels tall, built on first use and
+        // kept for the life of the process. Safe to call from any thread.
+        static const GlyphAtlas& get(int pixelHeight);
+
+        int height() const { return m_height; }
+        int advance() const { return m_advance; }
+        int text_width(std::string_view text) const;
+
+        // Blend text in colour rgba onto image, top-left corner at (x, y),
+        // clipped to the image. Characters outside printable ASCII are drawn
+        // as '?', one per UTF-8 sequence.
+        void draw(const ImageView& image, int x, int y, std::string_view text, const uint8_t rgba[4]) const;
+
+    private:
+        explicit GlyphAtlas(int pixelHeight);
+        const uint8_t* glyph(unsigned char c) const;
+
+        int m_height;
+        int m_cellWidth;
+        int m_advance;
+        std::vector<uint8_t> m_coverage;  // glyphs side by side, one row of cells
+    };
+
+    // Blend a solid colour over a rectangle with the given opacity
+    void fill_blend(const ImageView& image, int x, int y, int w, int h, const uint8_t rgb[3], uint8_t alpha);
+
+    // Height of the stamp text for an image of the given height
+    int stamp_text_height(int imageHeight, const StampOptions& stamp);
+
+    // The stamp (text on a translucent panel) on its own transparent canvas
+    Image render_text_stamp(const std::string& text, int pixelHeight);
+
+    // Draw the stamp straight onto image, in the corner stamp asks for
+    void stamp_text(const ImageView& image, const std::string& text, const StampOptions& stamp);
+}
@@ -19,6 +19,7 @@
 #include <algorithm>
 #include <sys/types.h>
 #include <fstream>
+#include <random>
 
 using namespace zipper;
 
@@ -82,18 +83,19 @@ bool CDirEntry::isWritable(const std::string& path)
 }
 
 // -----------------------------------------------------------------------------
-std::string CDirEntry::baseName(const std::string& path)
+// Position following the last separator of 'path', or 0 if there is none.
+static std::string_view::size_type fileNameStart(std::string_view path)
 {
-    std::string::size_type start = path.find_last_of(Separator);
+    std::string_view::size_type start = path.rfind(DIRECTORY_SEPARATOR[0]);
 
 #if defined(USE_WINDOWS) // WIN32 also understands '/' as the separator.
-    if (start == std::string::npos)
+    if (start == std::string_view::npos)
     {
-        start = path.find_last_of("/");
+        start = path.rfind('/');
     }
 #endif
 
-    if (start == std::string::npos)
+    if (start == std::string_view::npos)
     {
         start = 0;
     }
@@ -102,9 +104,22 @@ std::string CDirEntry::baseName(const std::string& path)
         start++; // We do not want the separator.
     }
 
-    std::string::size_type end = path.find_last_of(".");
+    return start;
+}
+
+// -----------------------------------------------------------------------------
+std::string CDirEntry::baseName(const std::string& path)
+{
+    return std::string(baseNameView(path));
+}
+
+// -----------------------------------------------------------------------------
+std::string_view CDirEntry::baseNameView(std::string_view path)
+{
+    std::string_view::size_type start = fileNameStart(path);
+    std::string_view::size_type end = path.rfind('.');
 
-    if (end == std::string::npos || end < start)
+    if (end == std::string_view::npos || end < start)
     {
         end = path.length();
     }
@@ -115,49 +130,43 @@ std::string CDirEntry::baseName(const std::string& path)
 // -----------------------------------------------------------------------------
 std::string CDirEntry::fileName(const std::string& path)
 {
-    std::string::size_type start = path.find_last_of(Separator);
-
-#if defined(USE_WINDOWS) // WIN32 also understands '/' as the separator.
-    if (start == std::string::npos)
-    {
-        start = path.find_last_of("/");
-    }
-#endif
-
-    if (start == std::string::npos)
-    {
-        start = 0;
-    }
-    else
-    {
-        start++; // We do not want the separator.
-    }
+    return std::string(fileNameView(path));
+}
 
-    return path.substr(start);
+// -----------------------------------------------------------------------------
+std::string_view CDirEntry::fileNameView(std::string_view path)
+{
+    return path.substr(fileNameStart(path));
 }
 
 // -----------------------------------------------------------------------------
 std::string CDirEntry::dirName(const std::string& path)
 {
-    if (path == "")
+    return std::string(dirNameView(path));
+}
+
+// -----------------------------------------------------------------------------
+std::string_view CDirEntry::dirNameView(std::string_view path)
+{
+    if (path.empty())
         return path;
 
 #if defined(USE_WINDOWS) // WIN32 also understands '/' as the separator.
-    std::string::size_type end = path.find_last_of(Separator + "/");
+    std::string_view::size_type end = path.find_last_of(DIRECTORY_SEPARATOR "/");
 #else
-    std::string::size_type end = path.find_last_of(Separator);
+    std::string_view::size_type end = path.rfind(DIRECTORY_SEPARATOR[0]);
 #endif
 
     if (end == path.length() - 1)
     {
 #if defined(USE_WINDOWS) // WIN32 also understands '/' as the separator.
-        end = path.find_last_of(Separator + "/", end - 1);
+        end = path.find_last_of(DIRECTORY_SEPARATOR "/", end - 1);
 #else
-        end = path.find_last_of(Separator, end - 1);
+        end = path.rfind(DIRECTORY_SEPARATOR[0], end - 1);
 #endif
     }
 
-    if (end == std::string::npos)
+    if (end == std::string_view::npos)
         return {};
 
     return path.substr(0, end);
@@ -166,27 +175,16 @@ std::string CDirEntry::dirName(const std::string& path)
 // -----------------------------------------------------------------------------
 std::string CDirEntry::suffix(const std::string& path)
 {
-    std::string::size_type start = path.find_last_of(Separator);
-
-#if defined(USE_WINDOWS) // WIN32 also understands '/' as the separator.
-    if (start == std::string::npos)
-    {
-        start = path.find_last_of("/");
-    }
-#endif
-
-    if (start == std::string::npos)
-    {
-        start = 0;
-    }
-    else
-    {
-        start++; // We do not want the separator.
-    }
+    return std::string(suffixView(path));
+}
 
-    std::string::size_type end = path.find_last_of(".");
+// -----------------------------------------------------------------------------
+std::string_view CDirEntry::suffixView(std::string_view path)
+{
+    std::string_view::size_type start = fileNameStart(path);
+    std::string_view::size_type end = path.rfind('.');
 
-    if (end == std::string::npos || end < start)
+    if (end == std::string_view::npos || end < start)
         return {};
 
     return path.substr(end);
@@ -232,6 +230,9 @@ bool CDirEntry::createDir(const std::string& dir, const std::string& parent)
 // -----------------------------------------------------------------------------
 std::string CDirEntry::createTmpName(const std::string& dir, const std::string& suffix)
 {
+    // One generator per thread: rand() shares its state between threads.
+    thread_local std::mt19937 Generator{std::random_device{}()};
+    std::uniform_int_distribution<int> Distribution(0, 35);
     std::string RandomName;
 
     do
@@ -241,7 +242,7 @@ std::string CDirEntry::createTmpName(const std::string& dir, const std::string&
 
         for (size_t i = 0; i < 8u; i++)
         {
-            Char = static_cast<int>((rand() / double(RAND_MAX)) * 35.0);
+            Char = Distribution(Generator);
 
             if (Char < 10)
             {
@@ -502,14 +503,14 @@ bool CDirEntry::makePathRelative(std::string& absolutePath, const std::string& r
 
 #endif
 
-    RelativeTo = RelativeTo.substr(i);
+    std::string_view Remaining = std::string_view(RelativeTo).substr(i);
 
     std::string relativePath;
 
-    while (RelativeTo != "")
+    while (!Remaining.empty())
     {
         relativePath += "../";
-        RelativeTo = dirName(RelativeTo);
+        Remaining = dirNameView(Remaining);
     }
 
     if (relativePath != "")
@@ -604,56 +605,79 @@ bool CDirEntry::matchInternal(const std::string& name,
 std::string CDirEntry::normalize(const std::string& path)
 {
     std::string Normalized = path;
+    normalizeInPlace(Normalized);
+    return Normalized;
+}
 
+// -----------------------------------------------------------------------------
+void CDirEntry::normalizeInPlace(std::string& Normalized)
+{
 #if defined(USE_WINDOWS)
     // converts all '\' to '/' (only on WIN32)
-    size_t i, imax;
-
-    for (i = 0, imax = Normalized.length(); i < imax; i++)
-    {
-        if (Normalized[i] == '\\')
-            Normalized[i] = '/';
-    }
-
+    std::replace(Normalized.begin(), Normalized.end(), '\\', '/');
 #endif
 
     // Remove leading './'
-    while (!Normalized.compare(0, 2, "./"))
+    std::string::size_type pos = 0;
+
+    while (!Normalized.compare(pos, 2, "./"))
     {
-        Normalized = Normalized.substr(2);
+        pos += 2;
     }
 
-    // Collapse '//' to '/'
-    std::string::size_type pos = 1;
+    Normalized.erase(0, pos);
 
-    while (true)
+    // Collapse '//' to '/' (a leading '//' is kept) and '/./' to '/', in a
+    // single compacting pass.
+    std::string::size_type out = 0;
+    std::string::size_type in = 0;
+    const std::string::size_type length = Normalized.length();
+
+    while (in < length)
     {
-        pos = Normalized.find("//", pos);
-        if (pos == std::string::npos)
-            break;
+        char c = Normalized[in];
 
-        Normalized.erase(pos, 1);
+        if (c == '/' && out >= 2 && Normalized[out - 1] == '/')
+        {
+            ++in;
+            continue;
+        }
+
+        Normalized[out++] = c;
+        ++in;
     }
 
-    // Collapse '/./' to '/'
-    pos = 0;
+    Normalized.resize(out);
 
-    while (true)
+    out = 0;
+    in = 0;
+
+    const std::string::size_type compacted = Normalized.length();
+
+    while (in < compacted)
     {
-        pos = Normalized.find("/./", pos);
-        if (pos == std::string::npos)
-            break;
+        if (Normalized[in] == '/' && in + 2 < compacted &&
+            Normalized[in + 1] == '.' && Normalized[in + 2] == '/')
+        {
+            in += 2;
+            continue;
+        }
 
-        Normalized.erase(pos, 2);
+        Normalized[out++] = Normalized[in++];
     }
 
+    Normalized.resize(out);
+
     // Collapse '[^/]+/../' to '/'
+    if (Normalized.find("/../") == std::string::npos)
+        return;
+
     std::string::size_type start = Normalized.length();
 
     while (true)
     {
         pos = Normalized.rfind("/../", start);
-        if (pos == std::string::npos)
+        if (pos == std::string::npos || pos == 0)
             break;
 
         start = Normalized.rfind('/', pos - 1);
@@ -666,6 +690,4 @@ std::string CDirEntry::normalize(const std::string& path)
         Normalized.erase(start, pos - start + 3);
         start = Normalized.length();
     }
-
-    return Normalized;
 }
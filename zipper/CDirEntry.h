@@ -11,6 +11,7 @@
 #define ZIPPER_CDirEntry
 
 #include <string>
+#include <string_view>
 #include <vector>
 
 namespace zipper {
@@ -96,6 +97,35 @@ public:
      */
     static std::string suffix(const std::string& path);
 
+    /**
+     * Same as baseName() without allocating: the result is a view into
+     * 'path' and is only valid as long as 'path' is.
+     * @param[in] path: file path.
+     * @return std::string_view baseName
+     */
+    static std::string_view baseNameView(std::string_view path);
+
+    /**
+     * Same as fileName() without allocating (see baseNameView()).
+     * @param[in] path: file path.
+     * @return std::string_view fileName
+     */
+    static std::string_view fileNameView(std::string_view path);
+
+    /**
+     * Same as dirName() without allocating (see baseNameView()).
+     * @param[in] path: file path.
+     * @return std::string_view dirName
+     */
+    static std::string_view dirNameView(std::string_view path);
+
+    /**
+     * Same as suffix() without allocating (see baseNameView()).
+     * @param[in] path: file path.
+     * @return std::string_view suffix
+     */
+    static std::string_view suffixView(std::string_view path);
+
     /**
      * Create the directory 'dir' in the parent directory 'parent'.
      * @param[in] dir: folder path.
@@ -194,6 +224,12 @@ public:
      */
     static std::string normalize(const std::string& path);
 
+    /**
+     * Same as normalize() but modifies 'path' instead of returning a copy.
+     * @param[in,out] path
+     */
+    static void normalizeInPlace(std::string& path);
+
 private:
     /**
      * This private methods checks whether the active section matches the
@@ -15,25 +15,40 @@
  * @warning It uses std::time to get current time, which is not standardized to be 1970-01-01....
  * However, it works on Windows and Unix https://stackoverflow.com/questions/6012663/get-unix-timestamp-with-c 
  * With C++20 this will be standardized
+ *
+ * Thread-safe: std::localtime returns a pointer to shared static storage, so
+ * the reentrant localtime_s/localtime_r are used instead.
  */
 struct Timestamp
 {
     tm timestamp;
     Timestamp();
     Timestamp(const std::string& filepath);
+
+private:
+    static void toLocalTime(std::time_t time, tm& result);
 };
 
-Timestamp::Timestamp()
+inline void Timestamp::toLocalTime(std::time_t time, tm& result)
+{
+#if defined(USE_WINDOWS)
+    localtime_s(&result, &time);
+#else
+    localtime_r(&time, &result);
+#endif
+}
+
+inline Timestamp::Timestamp()
 {
     std::time_t now = std::time(nullptr);
-    timestamp = *std::localtime(&now);
+    toLocalTime(now, timestamp);
 }
 
-Timestamp::Timestamp(const std::string& filepath)
+inline Timestamp::Timestamp(const std::string& filepath)
 {
     //Set default
     std::time_t now = std::time(nullptr);
-    timestamp = *std::localtime(&now);
+    toLocalTime(now, timestamp);
 #if defined(USE_WINDOWS)
     //Implementation based on Ian Boyd's https://stackoverflow.com/questions/20370920/convert-current-time-from-windows-to-unix-timestamp-in-c-or-c
     HANDLE hFile1;
@@ -62,7 +77,7 @@ Timestamp::Timestamp(const std::string& filepath)
     //Convert ticks since 1/1/1970 into seconds
     time_t time_s = (li.QuadPart - UNIX_TIME_START) / TICKS_PER_SECOND;
 
-    timestamp = *std::localtime(&time_s);
+    toLocalTime(time_s, timestamp);
     CloseHandle(hFile1);
 #elif __linux__
     struct stat buf;
@@ -71,6 +86,6 @@ Timestamp::Timestamp(const std::string& filepath)
         return;
     }
     auto timet = static_cast<time_t>(buf.st_mtim.tv_sec);
-    timestamp = *std::localtime(&timet);
+    toLocalTime(timet, timestamp);
 #endif
 }
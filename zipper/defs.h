@@ -38,6 +38,7 @@ typedef struct stat STAT;
 
 #define CASESENSITIVITY (0)
 #define WRITEBUFFERSIZE (8192)
+#define EXTRACTBUFFERSIZE (1048576)
 #define MAXFILENAME (256)
 
 #if defined(USE_WINDOWS)
@@ -53,6 +54,11 @@ typedef struct stat STAT;
 
 #define EXCEPTION_CLASS std::runtime_error
 
+//! \brief Archive entry listing the files stored only once (see
+//! Zipper::Deduplicate): one "name<TAB>source" line per duplicate.
+#define DUPLICATES_MANIFEST ".zipper-duplicates"
+#define SHARED_CONTENT_PREFIX "shared/"
+
 #if defined(_WIN64) && (!defined(__APPLE__))
 #    ifndef __USE_FILE_OFFSET64
 #        define __USE_FILE_OFFSET64
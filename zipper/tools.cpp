@@ -5,9 +5,12 @@
 #include <iterator>
 
 #include <CDirEntry.h>
+#include "zipper.h"
 
 #include <cstdio>
 #include <iostream>
+#include <fstream>
+#include <sstream>
 
 #if defined(USE_WINDOWS)
 #    include "tps/dirent.h"
@@ -47,14 +50,21 @@ void getFileCrc(std::istream& input_stream, std::vector<char>& buff, unsigned lo
 }
 
 // -----------------------------------------------------------------------------
-bool isLargeFile(std::istream& input_stream)
+// Size of a file from its metadata, or Zipper::UnknownSize if it cannot be
+// read. 64-bit on every platform, unlike _stat on Windows.
+unsigned long long fileSize(const std::string& path)
 {
-    std::streampos pos = 0;
-    input_stream.seekg(0, std::ios::end);
-    pos = input_stream.tellg();
-    input_stream.seekg(0);
+#if defined(USE_WINDOWS)
+    struct __stat64 st;
+    if (_stat64(path.c_str(), &st) != 0)
+        return Zipper::UnknownSize;
+#else
+    STAT st;
+    if (stat(path.c_str(), &st) != 0)
+        return Zipper::UnknownSize;
+#endif
 
-    return pos >= 0xffffffff;
+    return static_cast<unsigned long long>(st.st_size);
 }
 
 // -----------------------------------------------------------------------------
@@ -100,10 +110,22 @@ std::string parentDirectory(const std::string& filepath)
 }
 
 // -----------------------------------------------------------------------------
+// The working directory is process-wide: the result is only meaningful if no
+// other thread changes it. The buffer is allocated to the path length instead
+// of truncating long paths.
 std::string currentPath()
 {
-    char buffer[1024u];
-    return (getcwd(buffer, sizeof(buffer)) ? std::string(buffer) : std::string(""));
+#if defined(USE_WINDOWS)
+    char* buffer = _getcwd(NULL, 0);
+#else
+    char* buffer = getcwd(NULL, 0);
+#endif
+    if (buffer == NULL)
+        return std::string("");
+
+    std::string path(buffer);
+    free(buffer);
+    return path;
 }
 
 // -----------------------------------------------------------------------------
@@ -118,21 +140,28 @@ std::vector<std::string> filesFromDirectory(const std::string& path)
     if (dir == NULL)
         return files;
 
+    // Reuse one buffer for the full paths instead of concatenating per use.
+    std::string fullPath = path + CDirEntry::Separator;
+    const std::string::size_type prefixSize = fullPath.size();
+
     for (entry = readdir(dir); entry != NULL; entry = readdir(dir))
     {
-        std::string filename(entry->d_name);
+        const char* filename = entry->d_name;
 
-        if (filename == "." || filename == "..") continue;
+        if (!strcmp(filename, ".") || !strcmp(filename, "..")) continue;
 
-        if (CDirEntry::isDir(path + CDirEntry::Separator + filename))
+        fullPath.resize(prefixSize);
+        fullPath += filename;
+
+        if (CDirEntry::isDir(fullPath))
         {
-            std::vector<std::string> moreFiles = filesFromDirectory(path + CDirEntry::Separator + filename);
-            std::copy(moreFiles.begin(), moreFiles.end(), std::back_inserter(files));
+            std::vector<std::string> moreFiles = filesFromDirectory(fullPath);
+            std::move(moreFiles.begin(), moreFiles.end(), std::back_inserter(files));
             continue;
         }
 
 
-        files.push_back(path + CDirEntry::Separator + filename);
+        files.push_back(fullPath);
     }
 
     closedir(dir);
@@ -147,4 +176,195 @@ std::string fileNameFromPath(const std::string& fullPath)
     return CDirEntry::fileName(fullPath);
 }
 
+// -----------------------------------------------------------------------------
+// Cheap identity of a file content: its size and CRC32. Two files with the
+// same key are only candidates: confirm with sameFileContent().
+bool fileContentKey(const std::string& path, std::string& key)
+{
+    std::ifstream input(path.c_str(), std::ios::binary);
+    if (!input.good())
+        return false;
+
+    std::vector<char> buff(EXTRACTBUFFERSIZE);
+    unsigned long long size = 0u;
+    uLong crc = crc32(0L, Z_NULL, 0);
+
+    do
+    {
+        input.read(buff.data(), std::streamsize(buff.size()));
+        uInt size_read = static_cast<uInt>(input.gcount());
+        crc = crc32(crc, reinterpret_cast<const unsigned char*>(buff.data()), size_read);
+        size += size_read;
+    } while (input.good());
+
+    std::ostringstream str;
+    str << std::hex << size << '-' << crc;
+    key = str.str();
+    return true;
+}
+
+// -----------------------------------------------------------------------------
+bool sameFileContent(const std::string& path1, const std::string& path2)
+{
+    std::ifstream input1(path1.c_str(), std::ios::binary);
+    std::ifstream input2(path2.c_str(), std::ios::binary);
+    if (!input1.good() || !input2.good())
+        return false;
+
+    std::vector<char> buff1(WRITEBUFFERSIZE);
+    std::vector<char> buff2(WRITEBUFFERSIZE);
+
+    do
+    {
+        input1.read(buff1.data(), std::streamsize(buff1.size()));
+        input2.read(buff2.data(), std::streamsize(buff2.size()));
+        if (input1.gcount() != input2.gcount() ||
+            memcmp(buff1.data(), buff2.data(), static_cast<size_t>(input1.gcount())) != 0)
+            return false;
+    } while (input1.good() && input2.good());
+
+    return input1.eof() && input2.eof();
+}
+
+// -----------------------------------------------------------------------------
+// Whole-name wildcard match: '*' matches any run of characters (including '/'),
+// '?' exactly one. Backtracks only to the last '*'.
+bool globMatch(const std::string& pattern, const std::string& name)
+{
+    size_t p = 0u, n = 0u;
+    size_t star = std::string::npos, resume = 0u;
+
+    while (n < name.size())
+    {
+        if (p < pattern.size() && (pattern[p] == '?' || pattern[p] == name[n]))
+        {
+            ++p;
+            ++n;
+        }
+        else if (p < pattern.size() && pattern[p] == '*')
+        {
+            star = p++;
+            resume = n;
+        }
+        else if (star != std::string::npos)
+        {
+            p = star + 1u;
+            n = ++resume;
+        }
+        else
+        {
+            return false;
+        }
+    }
+
+    while (p < pattern.size() && pattern[p] == '*')
+        ++p;
+
+    return p == pattern.size();
+}
+
+// -----------------------------------------------------------------------------
+OutputFile::~OutputFile()
+{
+    close();
+}
+
+// -----------------------------------------------------------------------------
+bool OutputFile::open(const std::string& filename, unsigned long long sizeHint)
+{
+    close();
+
+#if defined(USE_WINDOWS)
+    HANDLE hFile = CreateFileA(filename.c_str(), GENERIC_WRITE, 0, NULL, CREATE_ALWAYS,
+                               FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (hFile == INVALID_HANDLE_VALUE)
+        return false;
+
+    // Only reserves clusters: the end of file still follows what is written.
+    if (sizeHint > 0u)
+    {
+        FILE_ALLOCATION_INFO alloc;
+        alloc.AllocationSize.QuadPart = static_cast<LONGLONG>(sizeHint);
+        SetFileInformationByHandle(hFile, FileAllocationInfo, &alloc, sizeof(alloc));
+    }
+
+    m_handle = hFile;
+    return true;
+#else
+    m_fd = ::open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0664);
+    if (m_fd < 0)
+        return false;
+
+    m_written = 0u;
+#    if defined(__linux__) && defined(FALLOC_FL_KEEP_SIZE)
+    // Only reserves blocks: the file size still follows what is written.
+    // Not posix_fallocate(), which writes zeros where the filesystem (NFS,
+    // CIFS) can't reserve; here those just go without.
+    m_preallocated = (sizeHint > 0u) &&
+                     (fallocate(m_fd, FALLOC_FL_KEEP_SIZE, 0, static_cast<off_t>(sizeHint)) == 0);
+#    endif
+    return true;
+#endif
+}
+
+// -----------------------------------------------------------------------------
+bool OutputFile::write(const void* data, size_t size)
+{
+    const char* ptr = static_cast<const char*>(data);
+
+#if defined(USE_WINDOWS)
+    if (m_handle == nullptr)
+        return false;
+
+    while (size > 0u)
+    {
+        DWORD chunk = static_cast<DWORD>((std::min)(size, size_t(0x40000000)));
+        DWORD written = 0;
+        if (!WriteFile(static_cast<HANDLE>(m_handle), ptr, chunk, &written, NULL) || written == 0)
+            return false;
+        ptr += written;
+        size -= written;
+    }
+#else
+    if (m_fd < 0)
+        return false;
+
+    while (size > 0u)
+    {
+        ssize_t written = ::write(m_fd, ptr, size);
+        if (written < 0 && errno == EINTR)
+            continue;
+        if (written <= 0)
+            return false;
+        ptr += written;
+        size -= static_cast<size_t>(written);
+        m_written += static_cast<unsigned long long>(written);
+    }
+#endif
+
+    return true;
+}
+
+// -----------------------------------------------------------------------------
+void OutputFile::close()
+{
+#if defined(USE_WINDOWS)
+    if (m_handle != nullptr)
+    {
+        CloseHandle(static_cast<HANDLE>(m_handle));
+        m_handle = nullptr;
+    }
+#else
+    if (m_fd >= 0)
+    {
+        // Release the blocks reserved past the end of file.
+        if (m_preallocated)
+            static_cast<void>(ftruncate(m_fd, static_cast<off_t>(m_written)));
+        ::close(m_fd);
+        m_fd = -1;
+        m_preallocated = false;
+    }
+#endif
+}
+
 } // namespace zipper
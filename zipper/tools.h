@@ -1,5 +1,7 @@
 #pragma once
 
+#include "defs.h"
+
 #include <string>
 #include <vector>
 #include <istream>
@@ -7,7 +9,7 @@
 namespace zipper {
 
 void getFileCrc(std::istream& input_stream, std::vector<char>& buff, unsigned long& result_crc);
-bool isLargeFile(std::istream& input_stream);
+unsigned long long fileSize(const std::string& path);
 bool checkFileExists(const std::string& filename);
 bool makedir(const std::string& newdir);
 void removeFolder(const std::string& foldername);
@@ -16,5 +18,37 @@ std::string currentPath();
 bool isDirectory(const std::string& path);
 std::vector<std::string> filesFromDirectory(const std::string& path);
 std::string fileNameFromPath(const std::string& path);
+bool fileContentKey(const std::string& path, std::string& key);
+bool sameFileContent(const std::string& path1, const std::string& path2);
+bool globMatch(const std::string& pattern, const std::string& name);
+
+// -----------------------------------------------------------------------------
+//! \brief Write-only file bypassing iostream buffering. The file is reserved
+//! on disk to its expected size when opened so that large extractions are
+//! written in few extents.
+// -----------------------------------------------------------------------------
+class OutputFile
+{
+public:
+
+    OutputFile() = default;
+    OutputFile(const OutputFile&) = delete;
+    OutputFile& operator=(const OutputFile&) = delete;
+    ~OutputFile();
+
+    bool open(const std::string& filename, unsigned long long sizeHint);
+    bool write(const void* data, size_t size);
+    void close();
+
+private:
+
+#if defined(USE_WINDOWS)
+    void* m_handle = nullptr;
+#else
+    int m_fd = -1;
+    bool m_preallocated = false;
+    unsigned long long m_written = 0u;
+#endif
+};
 
 } // namespace zipper
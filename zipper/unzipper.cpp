@@ -10,6 +10,7 @@
 #include <exception>
 #include <fstream>
 #include <stdexcept>
+#include <set>
 
 namespace zipper {
 
@@ -19,6 +20,37 @@ struct Unzipper::Impl
     zipFile m_zf;
     ourmemory_t m_zipmem;
     zlib_filefunc_def m_filefunc;
+    //! \brief Folders already created on disk by the current extraction.
+    std::set<std::string> m_createdDirs;
+    std::vector<char> m_extractBuffer;
+
+    //! \brief Inflate state saved at a deflate block boundary, allowing to
+    //! resume decompression there (see zlib's examples/zran.c).
+    struct InflateCheckpoint
+    {
+        ZPOS64_T in;   //!< offset of the next compressed byte
+        ZPOS64_T out;  //!< uncompressed offset
+        int bits;      //!< unused bits of the byte before 'in'
+        std::vector<unsigned char> window;
+    };
+
+    //! \brief Where an entry's data lives inside the archive, and the
+    //! checkpoints recorded so far while reading ranges of it.
+    struct EntryIndex
+    {
+        ZPOS64_T dataOffset;
+        ZPOS64_T compressedSize;
+        ZPOS64_T uncompressedSize;
+        int method;
+        bool encrypted;
+        std::vector<InflateCheckpoint> checkpoints;
+    };
+
+    std::map<std::string, EntryIndex> m_indexes;
+    //! \brief Sidecar archive holding content shared between archives.
+    std::string m_sharedContent;
+    //! \brief Raw access to the archive for ranged reads (file constructor).
+    std::ifstream m_rawFile;
 
 private:
     bool initMemory(zlib_filefunc_def& filefunc)
@@ -129,7 +161,7 @@ public:
 
         if (!entryinfo.uncompressedSize)
         {
-            if (!makedir(fileName))
+            if (!makeCachedDir(fileName))
                 err = UNZ_ERRNO;
         }
         else
@@ -245,19 +277,35 @@ public:
     }
 #endif
 
+    // Create the folder and remember it, together with its parents, so that
+    // sibling entries do not stat the same path again.
+    bool makeCachedDir(const std::string& dir)
+    {
+        if (dir.empty() || m_createdDirs.count(dir) != 0u)
+            return true;
+
+        if (!makedir(dir))
+            return false;
+
+        for (std::string d = dir; !d.empty() && m_createdDirs.insert(d).second; d = parentDirectory(d))
+            ;
+
+        return true;
+    }
+
     int extractToFile(const std::string& filename, ZipEntry& info)
     {
         int err = UNZ_ERRNO;
 
         /* If zip entry is a directory then create it on disk */
-        makedir(parentDirectory(filename));
+        makeCachedDir(parentDirectory(filename));
 
-        /* Create the file on disk so we can unzip to it */
-        std::ofstream output_file(filename.c_str(), std::ofstream::binary);
+        /* Create the file on disk, reserving its final size, so we can unzip to it */
+        OutputFile output_file;
 
-        if (output_file.good())
+        if (output_file.open(filename, info.uncompressedSize))
         {
-            if (UNZ_OK == extractToStream(output_file, info))
+            if (UNZ_OK == extractToOutputFile(output_file, info))
                 err = UNZ_OK;
 
             output_file.close();
@@ -268,8 +316,38 @@ public:
 
             changeFileDate(filename, info.dosdate, timeaux);
         }
-        else
-            output_file.close();
+
+        return err;
+    }
+
+    int extractToOutputFile(OutputFile& file, ZipEntry& info)
+    {
+        int err = unzOpenCurrentFilePassword(m_zf, m_outer.m_password.c_str());
+        if (UNZ_OK != err)
+        {
+            std::stringstream str;
+            str << "Error " << err << " opening internal file '"
+                << info.name << "' in zip";
+
+            throw EXCEPTION_CLASS(str.str().c_str());
+        }
+
+        // Large reads straight into the file: no iostream copy in between.
+        m_extractBuffer.resize(EXTRACTBUFFERSIZE);
+
+        do
+        {
+            err = unzReadCurrentFile(m_zf, m_extractBuffer.data(), static_cast<unsigned int>(m_extractBuffer.size()));
+            if (err < 0 || err == 0)
+                break;
+
+            if (!file.write(m_extractBuffer.data(), static_cast<size_t>(err)))
+            {
+                err = UNZ_ERRNO;
+                break;
+            }
+
+        } while (err > 0);
 
         return err;
     }
@@ -309,6 +387,37 @@ public:
         return err;
     }
 
+    int extractToSink(const Sink& sink, const ZipEntry& info)
+    {
+        int err = unzOpenCurrentFilePassword(m_zf, m_outer.m_password.c_str());
+        if (UNZ_OK != err)
+        {
+            std::stringstream str;
+            str << "Error " << err << " opening internal file '"
+                << info.name << "' in zip";
+
+            throw EXCEPTION_CLASS(str.str().c_str());
+        }
+
+        m_extractBuffer.resize(EXTRACTBUFFERSIZE);
+
+        do
+        {
+            err = unzReadCurrentFile(m_zf, m_extractBuffer.data(), static_cast<unsigned int>(m_extractBuffer.size()));
+            if (err < 0 || err == 0)
+                break;
+
+            if (!sink(info, reinterpret_cast<const unsigned char*>(m_extractBuffer.data()), static_cast<size_t>(err)))
+            {
+                err = UNZ_ERRNO;
+                break;
+            }
+
+        } while (err > 0);
+
+        return err;
+    }
+
     int extractToMemory(std::vector<unsigned char>& outvec, ZipEntry& info)
     {
         int err = UNZ_ERRNO;
@@ -341,6 +450,203 @@ public:
         return err;
     }
 
+    // Read compressed bytes of the archive, whatever its storage.
+    size_t readRaw(ZPOS64_T offset, unsigned char* buf, size_t len)
+    {
+        if (m_zipmem.base != NULL)
+        {
+            if (offset >= m_zipmem.size)
+                return 0u;
+            len = static_cast<size_t>((std::min)(ZPOS64_T(len), ZPOS64_T(m_zipmem.size) - offset));
+            memcpy(buf, m_zipmem.base + offset, len);
+            return len;
+        }
+
+        if (!m_rawFile.is_open())
+        {
+            m_rawFile.open(m_outer.m_zipname.c_str(), std::ios::binary);
+            if (!m_rawFile.is_open())
+                return 0u;
+        }
+
+        m_rawFile.clear();
+        m_rawFile.seekg(std::streamoff(offset));
+        m_rawFile.read(reinterpret_cast<char*>(buf), std::streamsize(len));
+        return static_cast<size_t>(m_rawFile.gcount());
+    }
+
+    EntryIndex* entryIndex(const std::string& name)
+    {
+        std::map<std::string, EntryIndex>::iterator it = m_indexes.find(name);
+        if (it != m_indexes.end())
+            return &it->second;
+
+        if (!locateEntry(name))
+            return NULL;
+
+        unz_file_info64 file_info;
+        if (UNZ_OK != unzGetCurrentFileInfo64(m_zf, &file_info, NULL, 0, NULL, 0, NULL, 0))
+            throw EXCEPTION_CLASS("Error, couln't get the current entry info");
+
+        // Open the entry raw only to learn where its data starts.
+        int method = 0, level = 0;
+        if (UNZ_OK != unzOpenCurrentFile2(m_zf, &method, &level, 1))
+        {
+            std::stringstream str;
+            str << "Error opening internal file '" << name << "' in zip";
+            throw EXCEPTION_CLASS(str.str().c_str());
+        }
+
+        EntryIndex index;
+        index.dataOffset = unzGetCurrentFileZStreamPos64(m_zf);
+        index.compressedSize = file_info.compressed_size;
+        index.uncompressedSize = file_info.uncompressed_size;
+        index.method = method;
+        index.encrypted = (file_info.flag & 1u) != 0u;
+        unzCloseCurrentFile(m_zf);
+
+        return &m_indexes.insert(std::make_pair(name, index)).first->second;
+    }
+
+    // Fallback for entries we cannot address directly (encrypted, unknown
+    // method): decompress from the start and drop what precedes the range.
+    bool readRangeSequential(const std::string& name, ZPOS64_T offset, size_t size,
+                             std::vector<unsigned char>& vec)
+    {
+        int err = unzOpenCurrentFilePassword(m_zf, m_outer.m_password.c_str());
+        if (UNZ_OK != err)
+        {
+            std::stringstream str;
+            str << "Error " << err << " opening internal file '" << name << "' in zip";
+            throw EXCEPTION_CLASS(str.str().c_str());
+        }
+
+        std::vector<unsigned char> buffer(WRITEBUFFERSIZE);
+        ZPOS64_T pos = 0u;
+
+        while (vec.size() < size)
+        {
+            err = unzReadCurrentFile(m_zf, buffer.data(), static_cast<unsigned int>(buffer.size()));
+            if (err <= 0)
+                break;
+
+            ZPOS64_T end = pos + ZPOS64_T(err);
+            if (end > offset)
+            {
+                size_t from = static_cast<size_t>(offset > pos ? offset - pos : 0u);
+                size_t count = (std::min)(size_t(err) - from, size - vec.size());
+                vec.insert(vec.end(), buffer.data() + from, buffer.data() + from + count);
+            }
+            pos = end;
+        }
+
+        unzCloseCurrentFile(m_zf);
+        return err >= 0;
+    }
+
+    bool readRangeDeflated(EntryIndex& index, ZPOS64_T offset, size_t size,
+                           std::vector<unsigned char>& vec)
+    {
+        const size_t WINSIZE = 32768u;               // deflate window
+        const ZPOS64_T SPAN = 1048576u;             // distance between checkpoints
+        const ZPOS64_T end = offset + ZPOS64_T(size);
+
+        // Resume from the last checkpoint before the requested offset.
+        const InflateCheckpoint* from = NULL;
+        for (size_t i = 0u; i < index.checkpoints.size() && index.checkpoints[i].out <= offset; ++i)
+            from = &index.checkpoints[i];
+
+        z_stream strm;
+        memset(&strm, 0, sizeof(strm));
+        if (inflateInit2(&strm, -MAX_WBITS) != Z_OK)
+            return false;
+
+        ZPOS64_T totin = 0u, totout = 0u;
+        if (from != NULL)
+        {
+            totin = from->in;
+            totout = from->out;
+            if (from->bits)
+            {
+                unsigned char ch = 0;
+                if (readRaw(index.dataOffset + from->in - 1u, &ch, 1u) != 1u)
+                {
+                    inflateEnd(&strm);
+                    return false;
+                }
+                inflatePrime(&strm, from->bits, ch >> (8 - from->bits));
+            }
+            inflateSetDictionary(&strm, from->window.data(), static_cast<uInt>(from->window.size()));
+        }
+
+        std::vector<unsigned char> input(WRITEBUFFERSIZE);
+        std::vector<unsigned char> window(WINSIZE, 0u);
+        int ret = Z_OK;
+
+        while (totout < end)
+        {
+            if (strm.avail_in == 0u)
+            {
+                ZPOS64_T left = index.compressedSize - totin;
+                size_t want = static_cast<size_t>((std::min)(ZPOS64_T(input.size()), left));
+                size_t got = (want > 0u) ? readRaw(index.dataOffset + totin, input.data(), want) : 0u;
+                if (got == 0u)
+                {
+                    ret = Z_DATA_ERROR;
+                    break;
+                }
+                strm.avail_in = static_cast<uInt>(got);
+                strm.next_in = input.data();
+            }
+
+            if (strm.avail_out == 0u)
+            {
+                strm.avail_out = static_cast<uInt>(WINSIZE);
+                strm.next_out = window.data();
+            }
+
+            unsigned char* produced = strm.next_out;
+            uInt availIn = strm.avail_in;
+            ret = inflate(&strm, Z_BLOCK);
+            if (ret == Z_NEED_DICT || ret == Z_MEM_ERROR || ret == Z_DATA_ERROR || ret == Z_BUF_ERROR)
+                break;
+
+            size_t count = static_cast<size_t>(strm.next_out - produced);
+            totin += ZPOS64_T(availIn - strm.avail_in);
+
+            // Keep the part of the new output overlapping the range.
+            if (totout + count > offset)
+            {
+                size_t skip = static_cast<size_t>(offset > totout ? offset - totout : 0u);
+                size_t keep = static_cast<size_t>((std::min)(ZPOS64_T(count - skip), end - (totout + skip)));
+                vec.insert(vec.end(), produced + skip, produced + skip + keep);
+            }
+            totout += ZPOS64_T(count);
+
+            if (ret == Z_STREAM_END)
+                break;
+
+            // At a block boundary (not the last one), save a checkpoint once
+            // we are far enough past the last recorded one.
+            ZPOS64_T last = index.checkpoints.empty() ? 0u : index.checkpoints.back().out;
+            if ((strm.data_type & 128) && !(strm.data_type & 64) && totout >= last + SPAN)
+            {
+                InflateCheckpoint point;
+                point.in = totin;
+                point.out = totout;
+                point.bits = strm.data_type & 7;
+                size_t wrap = WINSIZE - strm.avail_out;
+                point.window.reserve(WINSIZE);
+                point.window.insert(point.window.end(), window.begin() + ptrdiff_t(wrap), window.end());
+                point.window.insert(point.window.end(), window.begin(), window.begin() + ptrdiff_t(wrap));
+                index.checkpoints.push_back(point);
+            }
+        }
+
+        inflateEnd(&strm);
+        return ret == Z_OK || ret == Z_STREAM_END;
+    }
+
 public:
     Impl(Unzipper& outer)
         : m_outer(outer), m_zipmem(), m_filefunc()
@@ -356,6 +662,10 @@ public:
 
     void close()
     {
+        m_indexes.clear();
+        if (m_rawFile.is_open())
+            m_rawFile.close();
+
         if (m_zf != NULL)
         {
             unzClose(m_zf);
@@ -428,12 +738,14 @@ public:
 
     bool extractAll(const std::string& destination, const std::map<std::string, std::string>& alternativeNames)
     {
+        m_createdDirs.clear();
+
         std::vector<ZipEntry> entries;
         getEntries(entries);
         std::vector<ZipEntry>::iterator it = entries.begin();
         for (; it != entries.end(); ++it)
         {
-            if (!locateEntry(it->name))
+            if (it->name == DUPLICATES_MANIFEST || !locateEntry(it->name))
                 continue;
 
             std::string alternativeName = destination.empty() ? "" : destination + CDirEntry::Separator;
@@ -447,13 +759,190 @@ public:
                 return false;
         };
 
+        return restoreDuplicates(destination, alternativeNames);
+    }
+
+    //! \brief Restores one duplicate: \c duplicate is the entry of its content
+    //! renamed to the duplicate, \c source that entry's name in \c holder.
+    typedef std::function<bool(const ZipEntry& duplicate, Impl& holder, const std::string& source)> Restore;
+
+    // Recreate the files that Zipper stored only once (see Zipper::Deduplicate)
+    // and that \c filter accepts.
+    bool restoreDuplicates(const Filter& filter, const Restore& restore)
+    {
+        if (!locateEntry(DUPLICATES_MANIFEST))
+            return true;
+
+        std::vector<unsigned char> manifest;
+        ZipEntry entry = currentEntryInfo();
+        if (!extractCurrentEntryToMemory(entry, manifest))
+            return false;
+
+        const std::string sharedPrefix(SHARED_CONTENT_PREFIX);
+        std::unique_ptr<Unzipper> shared;
+        std::istringstream lines(std::string(manifest.begin(), manifest.end()));
+        std::string line;
+        bool ok = true;
+
+        while (std::getline(lines, line))
+        {
+            std::string::size_type tab = line.find('\t');
+            if (tab == std::string::npos)
+                continue;
+
+            std::string name = line.substr(0, tab);
+            std::string source = line.substr(tab + 1);
+            bool isShared = (source.compare(0, sharedPrefix.size(), sharedPrefix) == 0);
+
+            // Only the name is known while the content can't be found
+            const ZipEntry unknown(name, 0u, 0u, 0u, 0u, 0u, 0u, 0u, 0u, 0u);
+            if (isShared && m_sharedContent.empty())
+            {
+                ok = !filter(unknown) && ok;
+                continue;
+            }
+
+            if (isShared)
+            {
+                if (!shared)
+                    shared.reset(new Unzipper(m_sharedContent));
+                source = source.substr(sharedPrefix.size());
+            }
+            Impl& holder = isShared ? *shared->m_impl : *this;
+
+            if (!holder.locateEntry(source))
+            {
+                ok = !filter(unknown) && ok;
+                continue;
+            }
+
+            ZipEntry duplicate = holder.currentEntryInfo();
+            duplicate.name = name;
+            if (filter(duplicate))
+                ok = restore(duplicate, holder, source) && ok;
+        }
+
+        return ok;
+    }
+
+    bool restoreDuplicates(const std::string& destination, const std::map<std::string, std::string>& alternativeNames)
+    {
+        Filter all = [](const ZipEntry&) { return true; };
+        return restoreDuplicates(all,
+            [&](const ZipEntry& duplicate, Impl& holder, const std::string& source)
+            {
+                std::string target = destination.empty() ? "" : destination + CDirEntry::Separator;
+                if (alternativeNames.find(duplicate.name) != alternativeNames.end())
+                    target += alternativeNames.at(duplicate.name);
+                else
+                    target += duplicate.name;
+                return restoreToFile(duplicate, holder, source, target);
+            });
+    }
+
+    // Write the content of \c source in \c holder to \c target.
+    bool restoreToFile(const ZipEntry& duplicate, Impl& holder, const std::string& source, const std::string& target)
+    {
+        makeCachedDir(parentDirectory(target));
+
+        // An empty file, not the folder extractCurrentEntryToFile makes
+        if (!duplicate.uncompressedSize)
+        {
+            OutputFile output;
+            if (!output.open(target, 0u))
+                return false;
+            output.close();
+            return true;
+        }
+
+        ZipEntry entry = duplicate;
+        return holder.locateEntry(source) && holder.extractCurrentEntryToFile(entry, target);
+    }
+
+    // Hand the content of \c source in \c holder to \c sink as \c duplicate.
+    static bool restoreToSink(const Sink& sink, const ZipEntry& duplicate, Impl& holder, const std::string& source)
+    {
+        if (!holder.locateEntry(source))
+            return false;
+
+        int err = holder.extractToSink(sink, duplicate);
+        if (UNZ_OK != err)
+            return false;
+
+        err = unzCloseCurrentFile(holder.m_zf);
+        if (UNZ_OK != err)
+        {
+            std::stringstream str;
+            str << "Error " << err << " closing internal file '"
+                << source << "' in zip";
+
+            throw EXCEPTION_CLASS(str.str().c_str());
+        }
         return true;
     }
 
+    bool extractMatchingToSink(const Filter& filter, const Sink& sink)
+    {
+        std::vector<ZipEntry> entries;
+        getEntries(entries);
+        std::vector<ZipEntry>::iterator it = entries.begin();
+        for (; it != entries.end(); ++it)
+        {
+            if (it->name == DUPLICATES_MANIFEST || !filter(*it) || !locateEntry(it->name))
+                continue;
+
+            if (UNZ_OK != extractToSink(sink, *it))
+                return false;
+
+            int err = unzCloseCurrentFile(m_zf);
+            if (UNZ_OK != err)
+            {
+                std::stringstream str;
+                str << "Error " << err << " closing internal file '"
+                    << it->name << "' in zip";
+
+                throw EXCEPTION_CLASS(str.str().c_str());
+            }
+        }
+
+        return restoreDuplicates(filter,
+            [&sink](const ZipEntry& duplicate, Impl& holder, const std::string& source)
+            {
+                return restoreToSink(sink, duplicate, holder, source);
+            });
+    }
+
+    bool extractMatching(const Filter& filter, const std::string& destination)
+    {
+        m_createdDirs.clear();
+
+        std::vector<ZipEntry> entries;
+        getEntries(entries);
+        std::vector<ZipEntry>::iterator it = entries.begin();
+        for (; it != entries.end(); ++it)
+        {
+            if (it->name == DUPLICATES_MANIFEST || !filter(*it) || !locateEntry(it->name))
+                continue;
+
+            std::string outputFile = destination.empty() ? it->name : destination + CDirEntry::Separator + it->name;
+            if (!extractCurrentEntryToFile(*it, outputFile))
+                return false;
+        }
+
+        return restoreDuplicates(filter,
+            [&](const ZipEntry& duplicate, Impl& holder, const std::string& source)
+            {
+                std::string outputFile = destination.empty() ? duplicate.name
+                    : destination + CDirEntry::Separator + duplicate.name;
+                return restoreToFile(duplicate, holder, source, outputFile);
+            });
+    }
+
     bool extractEntry(const std::string& name, const std::string& destination)
     {
         std::string outputFile = destination.empty() ? name : destination + CDirEntry::Separator + name;
 
+        m_createdDirs.clear();
         if (locateEntry(name))
         {
             ZipEntry entry = currentEntryInfo();
@@ -478,6 +967,33 @@ public:
         }
     }
 
+    bool extractEntryRange(const std::string& name, unsigned long long offset, size_t size,
+                           std::vector<unsigned char>& vec)
+    {
+        EntryIndex* index = entryIndex(name);
+        if (index == NULL)
+            return false;
+
+        vec.clear();
+        if (offset >= index->uncompressedSize)
+            return true;
+        size = static_cast<size_t>((std::min)(ZPOS64_T(size), index->uncompressedSize - offset));
+        vec.reserve(size);
+
+        if (!index->encrypted && index->method == 0)
+        {
+            vec.resize(size);
+            size_t got = readRaw(index->dataOffset + offset, vec.data(), size);
+            vec.resize(got);
+            return got == size;
+        }
+
+        if (!index->encrypted && index->method == Z_DEFLATED)
+            return readRangeDeflated(*index, offset, size, vec);
+
+        return locateEntry(name) && readRangeSequential(name, offset, size, vec);
+    }
+
     bool extractEntryToMemory(const std::string& name, std::vector<unsigned char>& vec)
     {
         if (locateEntry(name))
@@ -568,6 +1084,12 @@ bool Unzipper::extractEntryToMemory(const std::string& name, std::vector<unsigne
     return m_impl->extractEntryToMemory(name, vec);
 }
 
+bool Unzipper::extractEntryRange(const std::string& name, unsigned long long offset, size_t size,
+                                 std::vector<unsigned char>& vec)
+{
+    return m_impl->extractEntryRange(name, offset, size, vec);
+}
+
 
 bool Unzipper::extract(const std::string& destination, const std::map<std::string, std::string>& alternativeNames)
 {
@@ -579,6 +1101,49 @@ bool Unzipper::extract(const std::string& destination)
     return m_impl->extractAll(destination, std::map<std::string, std::string>());
 }
 
+bool Unzipper::extractMatching(const Filter& filter, const std::string& destination)
+{
+    return m_impl->extractMatching(filter, destination);
+}
+
+bool Unzipper::extractMatchingToMemory(const Filter& filter,
+                                       std::map<std::string, std::vector<unsigned char> >& contents)
+{
+    // Every accepted entry gets its element, even an empty one that never
+    // reaches the sink
+    return m_impl->extractMatchingToSink(
+        [&filter, &contents](const ZipEntry& entry)
+        {
+            if (!filter(entry))
+                return false;
+            contents[entry.name];
+            return true;
+        },
+        [&contents](const ZipEntry& entry, const unsigned char* data, size_t size)
+        {
+            std::vector<unsigned char>& content = contents[entry.name];
+            if (content.empty())
+                content.reserve(static_cast<size_t>(entry.uncompressedSize));
+            content.insert(content.end(), data, data + size);
+            return true;
+        });
+}
+
+bool Unzipper::extractMatchingToSink(const Filter& filter, const Sink& sink)
+{
+    return m_impl->extractMatchingToSink(filter, sink);
+}
+
+Unzipper::Filter Unzipper::glob(const std::string& pattern)
+{
+    return [pattern](const ZipEntry& entry) { return globMatch(pattern, entry.name); };
+}
+
+void Unzipper::useSharedContent(const std::string& zipname)
+{
+    m_impl->m_sharedContent = zipname;
+}
+
 void Unzipper::release()
 {
     if (!m_usingMemoryVector)
@@ -601,4 +1166,303 @@ void Unzipper::close()
     }
 }
 
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+
+struct StreamUnzipper::Impl
+{
+    typedef std::function<bool(const ZipEntry&)> EntryHook;
+
+    std::istream& m_input;
+    std::vector<unsigned char> m_in;
+    size_t m_pos;
+    size_t m_end;
+    std::vector<unsigned char> m_out;
+
+    //! \brief What the local file header tells about the coming entry.
+    struct LocalHeader
+    {
+        std::string name;
+        unsigned int flags;
+        unsigned int method;
+        unsigned long crc;
+        unsigned long long compressedSize;
+        unsigned long long uncompressedSize;
+        unsigned long dosdate;
+        bool zip64;
+    };
+
+    Impl(std::istream& input)
+        : m_input(input), m_in(WRITEBUFFERSIZE * 8), m_pos(0u), m_end(0u), m_out(WRITEBUFFERSIZE * 8)
+    {}
+
+    static unsigned int le16(const unsigned char* p)
+    {
+        return unsigned(p[0]) | (unsigned(p[1]) << 8);
+    }
+
+    static unsigned long le32(const unsigned char* p)
+    {
+        return static_cast<unsigned long>(le16(p)) | (static_cast<unsigned long>(le16(p + 2)) << 16);
+    }
+
+    static unsigned long long le64(const unsigned char* p)
+    {
+        return static_cast<unsigned long long>(le32(p)) | (static_cast<unsigned long long>(le32(p + 4)) << 32);
+    }
+
+    // Make at least 'count' bytes available at m_pos. Return false if the
+    // input ends before.
+    bool fill(size_t count)
+    {
+        if (m_end - m_pos >= count)
+            return true;
+
+        memmove(m_in.data(), m_in.data() + m_pos, m_end - m_pos);
+        m_end -= m_pos;
+        m_pos = 0u;
+        if (m_in.size() < count)
+            m_in.resize(count);
+
+        while (m_end < count)
+        {
+            m_input.read(reinterpret_cast<char*>(m_in.data() + m_end), std::streamsize(m_in.size() - m_end));
+            size_t got = static_cast<size_t>(m_input.gcount());
+            if (got == 0u)
+                return false;
+            m_end += got;
+        }
+
+        return true;
+    }
+
+    void need(size_t count, const LocalHeader& header)
+    {
+        if (!fill(count))
+            throw EXCEPTION_CLASS(("Truncated zip stream in entry '" + header.name + "'").c_str());
+    }
+
+    // Parse the next local file header. Return false once the central
+    // directory or the end of the input is reached.
+    bool readHeader(LocalHeader& header)
+    {
+        header.name.clear();
+        if (!fill(4u) || le32(&m_in[m_pos]) != 0x04034b50ul)
+            return false;
+
+        need(30u, header);
+        const unsigned char* h = &m_in[m_pos];
+        header.flags = le16(h + 6);
+        header.method = le16(h + 8);
+        header.dosdate = (static_cast<unsigned long>(le16(h + 12)) << 16) | le16(h + 10);
+        header.crc = le32(h + 14);
+        header.compressedSize = le32(h + 18);
+        header.uncompressedSize = le32(h + 22);
+        size_t nameSize = le16(h + 26);
+        size_t extraSize = le16(h + 28);
+        m_pos += 30u;
+
+        need(nameSize + extraSize, header);
+        header.name.assign(reinterpret_cast<const char*>(&m_in[m_pos]), nameSize);
+        header.zip64 = false;
+
+        // Zip64 extended information: 64-bit sizes replace the saturated ones.
+        const unsigned char* extra = &m_in[m_pos + nameSize];
+        for (size_t i = 0u; i + 4u <= extraSize;)
+        {
+            unsigned int id = le16(extra + i);
+            size_t size = le16(extra + i + 2u);
+            size_t field = i + 4u;
+            if (id == 0x0001u)
+            {
+                header.zip64 = true;
+                if (header.uncompressedSize == 0xfffffffful && field + 8u <= extraSize)
+                {
+                    header.uncompressedSize = le64(extra + field);
+                    field += 8u;
+                }
+                if (header.compressedSize == 0xfffffffful && field + 8u <= extraSize)
+                    header.compressedSize = le64(extra + field);
+            }
+            i += 4u + size;
+        }
+
+        m_pos += nameSize + extraSize;
+        return true;
+    }
+
+    // Pass 'size' raw bytes to the sink, or drop them when sink is null.
+    bool copyStored(const ZipEntry& entry, unsigned long long size, const Unzipper::Sink* sink,
+                    unsigned long& crc, const LocalHeader& header)
+    {
+        while (size > 0u)
+        {
+            need(1u, header);
+            size_t count = static_cast<size_t>((std::min)(size, static_cast<unsigned long long>(m_end - m_pos)));
+            if (sink != NULL)
+            {
+                crc = crc32(crc, &m_in[m_pos], static_cast<uInt>(count));
+                if (!(*sink)(entry, &m_in[m_pos], count))
+                    return false;
+            }
+            m_pos += count;
+            size -= count;
+        }
+
+        return true;
+    }
+
+    // Inflate up to the end of the deflate stream, which also tells where the
+    // entry ends when its sizes are in a trailing data descriptor.
+    bool inflateEntry(const ZipEntry& entry, const Unzipper::Sink* sink, unsigned long& crc,
+                      const LocalHeader& header)
+    {
+        z_stream strm;
+        memset(&strm, 0, sizeof(strm));
+        if (inflateInit2(&strm, -MAX_WBITS) != Z_OK)
+            throw EXCEPTION_CLASS("Error initializing inflate");
+
+        int ret = Z_OK;
+        bool ok = true;
+
+        while (ret != Z_STREAM_END)
+        {
+            need(1u, header);
+            strm.next_in = &m_in[m_pos];
+            strm.avail_in = static_cast<uInt>(m_end - m_pos);
+            strm.next_out = m_out.data();
+            strm.avail_out = static_cast<uInt>(m_out.size());
+
+            ret = inflate(&strm, Z_NO_FLUSH);
+            m_pos = m_end - strm.avail_in;
+            if (ret != Z_OK && ret != Z_STREAM_END)
+            {
+                inflateEnd(&strm);
+                throw EXCEPTION_CLASS(("Corrupted data in entry '" + header.name + "'").c_str());
+            }
+
+            size_t count = m_out.size() - strm.avail_out;
+            if (sink != NULL && count > 0u)
+            {
+                crc = crc32(crc, m_out.data(), static_cast<uInt>(count));
+                if (!(*sink)(entry, m_out.data(), count))
+                {
+                    ok = false;
+                    break;
+                }
+            }
+        }
+
+        inflateEnd(&strm);
+        return ok;
+    }
+
+    bool extract(const Unzipper::Filter& filter, const EntryHook& begin,
+                 const Unzipper::Sink& sink, const EntryHook& end)
+    {
+        LocalHeader header;
+        while (readHeader(header))
+        {
+            const bool descriptor = (header.flags & 0x08u) != 0u;
+            unsigned int date = static_cast<unsigned int>(header.dosdate >> 16);
+            unsigned int time = static_cast<unsigned int>(header.dosdate & 0xffffu);
+            unsigned int month = (date >> 5) & 0x0fu; // tm_unz months start at 0
+            ZipEntry entry(header.name, header.compressedSize, header.uncompressedSize,
+                           (date >> 9) + 1980u, month > 0u ? month - 1u : 0u, date & 0x1fu,
+                           time >> 11, (time >> 5) & 0x3fu, (time & 0x1fu) * 2u, header.dosdate);
+
+            if (header.flags & 0x01u)
+                throw EXCEPTION_CLASS(("Encrypted entry '" + header.name + "' cannot be streamed").c_str());
+            if (header.method != 0u && header.method != Z_DEFLATED)
+                throw EXCEPTION_CLASS(("Unsupported compression for entry '" + header.name + "'").c_str());
+            if (header.method == 0u && descriptor && header.compressedSize == 0u)
+                throw EXCEPTION_CLASS(("Stored entry '" + header.name + "' has no size").c_str());
+
+            const bool wanted = filter(entry);
+            if (wanted && !begin(entry))
+                return false;
+
+            unsigned long crc = crc32(0L, Z_NULL, 0);
+            const Unzipper::Sink* target = wanted ? &sink : NULL;
+            bool ok = true;
+
+            if (header.method == 0u)
+                ok = copyStored(entry, header.compressedSize, target, crc, header);
+            else if (wanted || descriptor)
+                ok = inflateEntry(entry, target, crc, header);
+            else
+                ok = copyStored(entry, header.compressedSize, NULL, crc, header);
+
+            if (!ok)
+                return false;
+
+            if (descriptor)
+            {
+                need(4u, header);
+                if (le32(&m_in[m_pos]) == 0x08074b50ul)
+                    m_pos += 4u;
+                need(header.zip64 ? 20u : 12u, header);
+                header.crc = le32(&m_in[m_pos]);
+                m_pos += header.zip64 ? 20u : 12u;
+            }
+
+            if (wanted)
+            {
+                if (crc != header.crc)
+                    throw EXCEPTION_CLASS(("CRC error in entry '" + header.name + "'").c_str());
+                if (!end(entry))
+                    return false;
+            }
+        }
+
+        return true;
+    }
+};
+
+StreamUnzipper::StreamUnzipper(std::istream& input)
+    : m_impl(new Impl(input))
+{}
+
+StreamUnzipper::~StreamUnzipper()
+{
+    delete m_impl;
+}
+
+bool StreamUnzipper::extract(const Unzipper::Filter& filter, const Unzipper::Sink& sink)
+{
+    Impl::EntryHook none = [](const ZipEntry&) { return true; };
+    return m_impl->extract(filter, none, sink, none);
+}
+
+bool StreamUnzipper::extract(const std::string& destination)
+{
+    OutputFile output;
+    Unzipper::Filter all = [](const ZipEntry&) { return true; };
+
+    Impl::EntryHook begin = [&](const ZipEntry& entry)
+    {
+        std::string path = destination.empty() ? entry.name : destination + CDirEntry::Separator + entry.name;
+        if (!entry.name.empty() && entry.name.back() == '/')
+            return makedir(path);
+
+        makedir(parentDirectory(path));
+        return output.open(path, entry.uncompressedSize);
+    };
+
+    Unzipper::Sink sink = [&](const ZipEntry&, const unsigned char* data, size_t size)
+    {
+        return output.write(data, size);
+    };
+
+    Impl::EntryHook end = [&](const ZipEntry&)
+    {
+        output.close();
+        return true;
+    };
+
+    bool ok = m_impl->extract(all, begin, sink, end);
+    output.close();
+    return ok;
+}
+
 } // namespace zipper
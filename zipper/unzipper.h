@@ -7,6 +7,7 @@
 #include <string>
 #include <memory>
 #include <map>
+#include <functional>
 
 namespace zipper {
 
@@ -14,17 +15,38 @@ class ZipEntry;
 
 // *****************************************************************************
 //! \brief Zip archive extractor/decompressor.
+//!
+//! Distinct instances can be used at the same time from different threads.
+//! A single instance must not be shared between threads without locking.
 // *****************************************************************************
 class Unzipper
 {
 public:
 
+    // -------------------------------------------------------------------------
+    //! \brief Select the entries to extract: return true to extract one.
+    // -------------------------------------------------------------------------
+    typedef std::function<bool(const ZipEntry&)> Filter;
+
+    // -------------------------------------------------------------------------
+    //! \brief Receive the uncompressed data of an entry, chunk after chunk.
+    //! Return false to abort the extraction.
+    // -------------------------------------------------------------------------
+    typedef std::function<bool(const ZipEntry&, const unsigned char* data, size_t size)> Sink;
+
+    // -------------------------------------------------------------------------
+    //! \brief Filter keeping the entries whose whole name matches \c pattern
+    //! where '*' matches any number of characters and '?' exactly one.
+    // -------------------------------------------------------------------------
+    static Filter glob(const std::string& pattern);
+
     // -------------------------------------------------------------------------
     //! \brief Regular zip decompressor (from zip archive file).
     //!
     //! \param[in] zipname: the path of the zip file.
     //! \param[in] password: the password used by the Zipper class (set empty
-    //!   if no password is needed).
+    //!   if no password is needed). Both ZipCrypto and, when minizip is built
+    //!   with HAVE_AES, WinZip AES entries are accepted.
     //! \throw std::runtime_error if something odd happened.
     // -------------------------------------------------------------------------
     Unzipper(const std::string& zipname,
@@ -73,6 +95,7 @@ public:
     //!   existing files on disk (dictionary key: zip entry name, dictionary
     //!   data: newly desired path name on the disk).
     //!
+    //! \note files stored once by Zipper::Deduplicate are restored too.
     //! \return true on success, else return false.
     //! \throw std::runtime_error if something odd happened.
     // -------------------------------------------------------------------------
@@ -91,6 +114,42 @@ public:
     // -------------------------------------------------------------------------
     bool extract(const std::string& destination = std::string());
 
+    // -------------------------------------------------------------------------
+    //! \brief Extract to the disk only the entries accepted by \c filter.
+    //!
+    //! \param[in] filter: the entries to extract (see glob()).
+    //! \param[in] destination: the folder in which to extract. If no
+    //!   destination is given extract in the same folder than the zip file.
+    //! \return true on success, else return false.
+    //! \throw std::runtime_error if something odd happened.
+    // -------------------------------------------------------------------------
+    bool extractMatching(const Filter& filter,
+                         const std::string& destination = std::string());
+
+    // -------------------------------------------------------------------------
+    //! \brief Extract to memory only the entries accepted by \c filter.
+    //!
+    //! \param[in] filter: the entries to extract (see glob()).
+    //! \param[out] contents: dictionary filled with the extracted entries
+    //!   (dictionary key: zip entry name, dictionary data: its content).
+    //!   Empty entries are listed with empty data.
+    //! \return true on success, else return false.
+    //! \throw std::runtime_error if something odd happened.
+    // -------------------------------------------------------------------------
+    bool extractMatchingToMemory(const Filter& filter,
+                                 std::map<std::string, std::vector<unsigned char> >& contents);
+
+    // -------------------------------------------------------------------------
+    //! \brief Stream the entries accepted by \c filter to \c sink, without
+    //! storing them anywhere.
+    //!
+    //! \param[in] filter: the entries to extract (see glob()).
+    //! \param[in] sink: receives the uncompressed data of each entry.
+    //! \return true on success, else return false.
+    //! \throw std::runtime_error if something odd happened.
+    // -------------------------------------------------------------------------
+    bool extractMatchingToSink(const Filter& filter, const Sink& sink);
+
     // -------------------------------------------------------------------------
     //! \brief Extract a single entry from the archive.
     //!
@@ -125,6 +184,32 @@ public:
     bool extractEntryToMemory(const std::string& name,
                               std::vector<unsigned char>& vec);
 
+    // -------------------------------------------------------------------------
+    //! \brief Read a byte range of a single entry without extracting the
+    //! whole entry. Stored entries are read in place. Deflated entries are
+    //! inflated from the nearest checkpoint; checkpoints are recorded every
+    //! megabyte while reading so later ranges of the same entry start close
+    //! to their offset. Encrypted entries are decompressed from the start.
+    //!
+    //! \param[in] name: the entry path inside the zip archive.
+    //! \param[in] offset: the first uncompressed byte to read.
+    //! \param[in] size: the number of bytes to read.
+    //! \param[out] vec: the vector that will hold the bytes read (shorter than
+    //!   size when the range goes past the end of the entry).
+    //! \return true on success, else return false.
+    //! \throw std::runtime_error if something odd happened.
+    // -------------------------------------------------------------------------
+    bool extractEntryRange(const std::string& name, unsigned long long offset,
+                           size_t size, std::vector<unsigned char>& vec);
+
+    // -------------------------------------------------------------------------
+    //! \brief Give the sidecar archive written by SharedContent::write() so
+    //! that extract() can restore the files referencing shared content.
+    //!
+    //! \param[in] zipname: the path of the sidecar zip file.
+    // -------------------------------------------------------------------------
+    void useSharedContent(const std::string& zipname);
+
     // -------------------------------------------------------------------------
     //! \brief Relese memory. Called by the destructor.
     // -------------------------------------------------------------------------
@@ -202,4 +287,53 @@ public:
     tm_s unixdate;
 };
 
+// *****************************************************************************
+//! \brief Forward-only zip extractor for inputs that cannot seek (pipes,
+//! sockets). Unlike Unzipper, which needs the central directory stored at
+//! the end of the archive, it walks the local file headers and hands out
+//! each entry as soon as its data arrives, using bounded memory. Entries
+//! whose sizes are only known from a trailing data descriptor are supported
+//! when deflated. Encrypted entries are not supported.
+// *****************************************************************************
+class StreamUnzipper
+{
+public:
+
+    // -------------------------------------------------------------------------
+    //! \param[in,out] input: the stream delivering the zip archive. It is
+    //!   read forward only.
+    // -------------------------------------------------------------------------
+    StreamUnzipper(std::istream& input);
+
+    ~StreamUnzipper();
+
+    // -------------------------------------------------------------------------
+    //! \brief Stream the entries accepted by \c filter to \c sink, in archive
+    //! order. The other entries are skipped.
+    //!
+    //! \return true on success, else return false.
+    //! \throw std::runtime_error if the archive is truncated, corrupted or
+    //!   uses an unsupported feature.
+    // -------------------------------------------------------------------------
+    bool extract(const Unzipper::Filter& filter, const Unzipper::Sink& sink);
+
+    // -------------------------------------------------------------------------
+    //! \brief Extract every entry to the disk as soon as it arrives.
+    //!
+    //! \param[in] destination: the folder in which to extract. If empty,
+    //!   extract in the current folder.
+    //! \return true on success, else return false.
+    //! \throw std::runtime_error if something odd happened.
+    // -------------------------------------------------------------------------
+    bool extract(const std::string& destination = std::string());
+
+private:
+
+    StreamUnzipper(const StreamUnzipper&) = delete;
+    StreamUnzipper& operator=(const StreamUnzipper&) = delete;
+
+    struct Impl;
+    Impl* m_impl;
+};
+
 } // namespace zipper
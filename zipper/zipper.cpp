@@ -17,9 +17,22 @@ struct Zipper::Impl
     zipFile m_zf;
     ourmemory_t m_zipmem;
     zlib_filefunc_def m_filefunc;
+    const SharedContent* m_shared;
+    //! \brief A file stored so far. Its content key is only computed once
+    //! another file of the same size turns up.
+    struct Stored
+    {
+        std::string path;
+        std::string nameInZip;
+        std::string key;
+    };
+    //! \brief Files stored so far, by size.
+    std::map<unsigned long long, std::vector<Stored> > m_stored;
+    //! \brief Files not stored: (name in zip, source of their content).
+    std::vector<std::pair<std::string, std::string> > m_duplicates;
 
     Impl(Zipper& outer)
-        : m_outer(outer), m_zipmem(), m_filefunc()
+        : m_outer(outer), m_zipmem(), m_filefunc(), m_shared(NULL)
     {
         m_zf = NULL;
         m_zipmem.base = NULL;
@@ -28,7 +41,13 @@ struct Zipper::Impl
 
     ~Impl()
     {
-        close();
+        try
+        {
+            close();
+        }
+        catch (...)
+        {
+        }
     }
 
     bool initFile(const std::string& filename, Zipper::openFlags flags)
@@ -114,7 +133,8 @@ struct Zipper::Impl
     }
 
     bool add(std::istream& input_stream, const std::tm& timestamp,
-             const std::string& nameInZip, const std::string& password, int flags)
+             const std::string& nameInZip, const std::string& password, int flags,
+             unsigned long long size)
     {
         if (!m_zf)
             return false;
@@ -144,7 +164,7 @@ struct Zipper::Impl
         if (nameInZip.empty())
             return false;
 
-        flags = flags & ~int(Zipper::zipFlags::SaveHierarchy);
+        flags = flags & ~int(Zipper::zipFlags::SaveHierarchy | Zipper::zipFlags::Deduplicate);
         if (flags == Zipper::zipFlags::Store)
             compressLevel = 0;
         else if (flags == Zipper::zipFlags::Faster)
@@ -152,7 +172,7 @@ struct Zipper::Impl
         else if (flags == Zipper::zipFlags::Better)
             compressLevel = 9;
 
-        zip64 = isLargeFile(input_stream);
+        zip64 = (size == Zipper::UnknownSize) || (size >= 0xffffffffull);
         if (password.empty())
         {
             err = zipOpenNewFileInZip64(m_zf,
@@ -169,7 +189,13 @@ struct Zipper::Impl
         }
         else
         {
+#ifndef HAVE_AES
+            // ZipCrypto needs the CRC up front to build its encryption header,
+            // which costs a full extra read of the input. WinZip AES (AE-2)
+            // authenticates with an HMAC computed while writing, so the
+            // pre-pass is skipped when minizip is built with AES support.
             getFileCrc(input_stream, buff, crcFile);
+#endif
             err = zipOpenNewFileInZip3_64(m_zf,
                                           nameInZip.c_str(),
                                           &zi,
@@ -219,7 +245,86 @@ struct Zipper::Impl
         return ZIP_OK == err;
     }
 
+    // Return true when the file needs not be stored because its content is
+    // already in the archive or in the shared sidecar. The duplicate is then
+    // recorded for the manifest.
+    bool deduplicate(const std::string& path, const std::string& nameInZip)
+    {
+        if (m_shared != NULL)
+        {
+            std::string shared = m_shared->find(path);
+            if (!shared.empty())
+            {
+                m_duplicates.push_back(std::make_pair(nameInZip, SHARED_CONTENT_PREFIX + shared));
+                return true;
+            }
+        }
+
+        const unsigned long long size = fileSize(path);
+        if (size == Zipper::UnknownSize)
+            return false;
+
+        // Only files of the same size can match, so a file of a new size is
+        // stored without reading it for a key.
+        std::vector<Stored>& candidates = m_stored[size];
+        std::string key;
+        if (!candidates.empty())
+        {
+            if (!fileContentKey(path, key))
+                return false;
+
+            std::vector<Stored>::iterator it = candidates.begin();
+            for (; it != candidates.end(); ++it)
+            {
+                if (it->key.empty() && !fileContentKey(it->path, it->key))
+                    continue;
+                if (it->key == key && sameFileContent(it->path, path))
+                {
+                    m_duplicates.push_back(std::make_pair(nameInZip, it->nameInZip));
+                    return true;
+                }
+            }
+        }
+
+        Stored stored = { path, nameInZip, key };
+        candidates.push_back(stored);
+        return false;
+    }
+
+    void writeDuplicatesManifest()
+    {
+        if (m_duplicates.empty())
+            return;
+
+        std::stringstream manifest;
+        std::vector<std::pair<std::string, std::string> >::const_iterator it = m_duplicates.begin();
+        for (; it != m_duplicates.end(); ++it)
+            manifest << it->first << '\t' << it->second << '\n';
+
+        Timestamp time;
+        add(manifest, time.timestamp, DUPLICATES_MANIFEST, m_outer.m_password, Zipper::zipFlags::Better,
+            manifest.str().size());
+    }
+
+    //! \brief Write the duplicates manifest and finish the archive. The
+    //! archive is finished even when the manifest cannot be added, and the
+    //! error is then passed on.
     void close()
+    {
+        try
+        {
+            if (m_zf != NULL)
+                writeDuplicatesManifest();
+        }
+        catch (...)
+        {
+            finish();
+            throw;
+        }
+        finish();
+    }
+
+    void finish()
     {
         if (m_zf != NULL)
         {
@@ -245,6 +350,9 @@ struct Zipper::Impl
             free(m_zipmem.base);
             m_zipmem.base = NULL;
         }
+
+        m_stored.clear();
+        m_duplicates.clear();
     }
 };
 
@@ -302,7 +410,18 @@ Zipper::Zipper(std::vector<unsigned char>& buffer, const std::string& password)
 
 Zipper::~Zipper()
 {
-    close();
+    // Writes the duplicates manifest too; errors can't leave a destructor
+    if (m_open)
+    {
+        try
+        {
+            m_impl->close();
+        }
+        catch (...)
+        {
+        }
+        m_open = false;
+    }
     release();
 }
 
@@ -319,30 +438,34 @@ void Zipper::release()
     delete m_impl;
 }
 
-bool Zipper::add(std::istream& source, const std::tm& timestamp, const std::string& nameInZip, zipFlags flags)
+bool Zipper::add(std::istream& source, const std::tm& timestamp, const std::string& nameInZip, zipFlags flags,
+                 unsigned long long size)
 {
-    return m_impl->add(source, timestamp, nameInZip, m_password, flags);
+    return m_impl->add(source, timestamp, nameInZip, m_password, flags, size);
 }
 
-bool Zipper::add(std::istream& source, const std::string& nameInZip, zipFlags flags)
+bool Zipper::add(std::istream& source, const std::string& nameInZip, zipFlags flags, unsigned long long size)
 {
     Timestamp time;
-    return m_impl->add(source, time.timestamp, nameInZip, m_password, flags);
+    return m_impl->add(source, time.timestamp, nameInZip, m_password, flags, size);
 }
 
 bool Zipper::add(const std::string& fileOrFolderPath, Zipper::zipFlags flags)
 {
     if (isDirectory(fileOrFolderPath))
     {
-        std::string folderName = fileNameFromPath(fileOrFolderPath);
+        const std::string folderPrefix = std::string(CDirEntry::fileNameView(fileOrFolderPath)) + CDirEntry::Separator;
         std::vector<std::string> files = filesFromDirectory(fileOrFolderPath);
         std::vector<std::string>::iterator it = files.begin();
         for (; it != files.end(); ++it)
         {
+            std::string nameInZip = it->substr(it->rfind(folderPrefix));
+            if ((flags & Zipper::Deduplicate) && m_impl->deduplicate(*it, nameInZip))
+                continue;
+
             Timestamp time(*it);
             std::ifstream input(it->c_str(), std::ios::binary);
-            std::string nameInZip = it->substr(it->rfind(folderName + CDirEntry::Separator), it->size());
-            add(input, time.timestamp, nameInZip, flags);
+            add(input, time.timestamp, nameInZip, flags, fileSize(*it));
             input.close();
         }
     }
@@ -361,7 +484,7 @@ bool Zipper::add(const std::string& fileOrFolderPath, Zipper::zipFlags flags)
             fullFileName = fileNameFromPath(fileOrFolderPath);
         }
 
-        add(input, time.timestamp, fullFileName, flags);
+        add(input, time.timestamp, fullFileName, flags, fileSize(fileOrFolderPath));
 
         input.close();
     }
@@ -398,9 +521,105 @@ void Zipper::close()
 {
     if (m_open)
     {
-        m_impl->close();
         m_open = false;
+        m_impl->close();
     }
 }
 
+void Zipper::useSharedContent(const SharedContent& shared)
+{
+    m_impl->m_shared = &shared;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+
+bool SharedContent::scan(const std::string& folderPath)
+{
+    if (!isDirectory(folderPath))
+        return false;
+
+    // Only content found in several folders is shared, so files are grouped
+    // by size first and only read for a key once their size turns up in
+    // another folder. Keys are only candidates here: find() confirms byte
+    // equality.
+    std::vector<std::string> files = filesFromDirectory(folderPath);
+    std::vector<std::string>::iterator it = files.begin();
+    for (; it != files.end(); ++it)
+    {
+        const unsigned long long size = fileSize(*it);
+        if (size == Zipper::UnknownSize)
+            continue;
+
+        std::vector<Sized>& group = m_sizes[size];
+        Sized sized = { *it, folderPath, false };
+        group.push_back(sized);
+
+        bool severalFolders = false;
+        std::vector<Sized>::const_iterator other = group.begin();
+        for (; other != group.end() && !severalFolders; ++other)
+            severalFolders = other->folder != folderPath;
+        if (!severalFolders)
+            continue;
+
+        std::vector<Sized>::iterator entry = group.begin();
+        for (; entry != group.end(); ++entry)
+        {
+            if (entry->keyed)
+                continue;
+            entry->keyed = true;
+
+            std::string key;
+            if (!fileContentKey(entry->path, key))
+                continue;
+
+            Blob& blob = m_blobs[key];
+            if (blob.path.empty())
+                blob.path = entry->path;
+            blob.folders.insert(entry->folder);
+        }
+    }
+
+    return true;
+}
+
+std::string SharedContent::find(const std::string& filePath) const
+{
+    if (m_blobs.empty() || m_sizes.find(fileSize(filePath)) == m_sizes.end())
+        return std::string();
+
+    std::string key;
+    if (!fileContentKey(filePath, key))
+        return std::string();
+
+    std::map<std::string, Blob>::const_iterator it = m_blobs.find(key);
+    if (it == m_blobs.end() || it->second.folders.size() < 2u)
+        return std::string();
+
+    if (it->second.path != filePath && !sameFileContent(it->second.path, filePath))
+        return std::string();
+
+    return key;
+}
+
+bool SharedContent::write(const std::string& zipname, Zipper::zipFlags flags) const
+{
+    Zipper zip(zipname);
+    bool ok = true;
+
+    std::map<std::string, Blob>::const_iterator it = m_blobs.begin();
+    for (; it != m_blobs.end(); ++it)
+    {
+        if (it->second.folders.size() < 2u)
+            continue;
+
+        Timestamp time(it->second.path);
+        std::ifstream input(it->second.path.c_str(), std::ios::binary);
+        ok = zip.add(input, time.timestamp, it->first, flags, fileSize(it->second.path)) && ok;
+    }
+
+    zip.close();
+    return ok;
+}
+
 } // namespace zipper
@@ -6,11 +6,18 @@
 #include <vector>
 #include <memory>
 #include <ctime>
+#include <map>
+#include <set>
 
 namespace zipper {
 
+class SharedContent;
+
 // *************************************************************************
 //! \brief Zip archive compressor.
+//!
+//! Distinct instances can be used at the same time from different threads.
+//! A single instance must not be shared between threads without locking.
 // *************************************************************************
 class Zipper
 {
@@ -29,6 +36,11 @@ public:
         //TODO NoPaths = 0x20,
     };
 
+    // -------------------------------------------------------------------------
+    //! \brief Size hint of a stream whose length is not known in advance.
+    //! Such entries are always written with zip64 headers.
+    static constexpr unsigned long long UnknownSize = ~0ull;
+
     // -------------------------------------------------------------------------
     //! \brief Compression options for files.
     // -------------------------------------------------------------------------
@@ -43,7 +55,11 @@ public:
         //! \brief Minizip options/params: -9  Compress better
         Better = 0x09,
         //! \brief ???
-        SaveHierarchy = 0x40
+        SaveHierarchy = 0x40,
+        //! \brief When adding a folder, store identical files only once. The
+        //! other copies are listed in a manifest entry and restored by
+        //! Unzipper::extract().
+        Deduplicate = 0x80
     };
 
     // -------------------------------------------------------------------------
@@ -54,6 +70,8 @@ public:
     //! \param[in] password: optional password (set empty for not using password).
     //! \param[in] flags: Overwrite (default) or append existing zip file (zipname).
     //! \throw std::runtime_error if something odd happened.
+    //! \note when minizip is built with HAVE_AES, entries are encrypted with
+    //! WinZip AES-256 instead of the legacy ZipCrypto scheme.
     // -------------------------------------------------------------------------
     Zipper(const std::string& zipname, const std::string& password,
            Zipper::openFlags flags = Zipper::openFlags::Overwrite);
@@ -90,7 +108,7 @@ public:
            const std::string& password = std::string());
 
     // -------------------------------------------------------------------------
-    //! \brief Call close().
+    //! \brief Call close(), ignoring errors.
     // -------------------------------------------------------------------------
     ~Zipper();
 
@@ -102,11 +120,14 @@ public:
     //! \param[in] timestamp: the desired timestamp.
     //! \param[in] nameInZip: the desired name for \c source inside the archive.
     //! \param[in] flags: compression options (faster, better ...).
+    //! \param[in] size: number of bytes in \c source if known. It decides
+    //!   whether zip64 headers are needed without seeking in \c source.
     //! \return true on success, else return false.
     //! \throw std::runtime_error if something odd happened.
     // -------------------------------------------------------------------------
     bool add(std::istream& source, const std::tm& timestamp, const std::string& nameInZip,
-             Zipper::zipFlags flags = Zipper::zipFlags::Better);
+             Zipper::zipFlags flags = Zipper::zipFlags::Better,
+             unsigned long long size = UnknownSize);
 
     // -------------------------------------------------------------------------
     //! \brief Compress data \c source in the archive with the given name \c
@@ -115,11 +136,13 @@ public:
     //! \param[in,out] source: data to compress.
     //! \param[in] nameInZip: the desired name for \c source inside the archive.
     //! \param[in] flags: compression options (faster, better ...).
+    //! \param[in] size: number of bytes in \c source if known (see above).
     //! \return true on success, else return false.
     //! \throw std::runtime_error if something odd happened.
     // -------------------------------------------------------------------------
     bool add(std::istream& source, const std::string& nameInZip,
-             Zipper::zipFlags flags = Zipper::zipFlags::Better);
+             Zipper::zipFlags flags = Zipper::zipFlags::Better,
+             unsigned long long size = UnknownSize);
 
     // -------------------------------------------------------------------------
     //! \brief Compress a folder or a file in the archive.
@@ -135,8 +158,9 @@ public:
     // -------------------------------------------------------------------------
     //! \brief Depending on your selection of constructor, this method will do
     //! some actions such as closing the access to the zip file, flushing in the
-    //! stream, releasing memory ...
-    //! \note this method is called by the destructor.
+    //! stream, releasing memory ... Files left out by Zipper::Deduplicate are
+    //! listed in a manifest entry written here.
+    //! \throw std::runtime_error if the manifest cannot be written.
     // -------------------------------------------------------------------------
     void close();
 
@@ -149,6 +173,15 @@ public:
     // -------------------------------------------------------------------------
     void open(Zipper::openFlags flags = Zipper::openFlags::Append);
 
+    // -------------------------------------------------------------------------
+    //! \brief Files found in several folders by \c shared are no longer
+    //! stored by add(folder, Deduplicate): they are referenced in the manifest
+    //! and expected in the sidecar archive written by SharedContent::write().
+    //!
+    //! \param[in] shared: scanned content, must outlive this instance.
+    // -------------------------------------------------------------------------
+    void useSharedContent(const SharedContent& shared);
+
 private:
 
     void release();
@@ -167,4 +200,55 @@ private:
     Impl* m_impl;
 };
 
+// *************************************************************************
+//! \brief Content common to several folders packaged into separate archives
+//! (legends, logos ...). Scan every folder first, package each of them with
+//! Zipper::useSharedContent() and Zipper::Deduplicate, then write the shared
+//! blobs once into a sidecar archive.
+// *************************************************************************
+class SharedContent
+{
+public:
+
+    // -------------------------------------------------------------------------
+    //! \brief Hash the files of a folder (recursively).
+    //! \return false if the folder cannot be read.
+    // -------------------------------------------------------------------------
+    bool scan(const std::string& folderPath);
+
+    // -------------------------------------------------------------------------
+    //! \brief Return the key of the file if its content is shared by several
+    //! scanned folders, else return an empty string.
+    // -------------------------------------------------------------------------
+    std::string find(const std::string& filePath) const;
+
+    // -------------------------------------------------------------------------
+    //! \brief Write each shared blob once, named by its key.
+    //! \return true on success, else return false.
+    //! \throw std::runtime_error if something odd happened.
+    // -------------------------------------------------------------------------
+    bool write(const std::string& zipname,
+               Zipper::zipFlags flags = Zipper::zipFlags::Better) const;
+
+private:
+
+    struct Blob
+    {
+        std::string path;
+        std::set<std::string> folders;
+    };
+
+    //! \brief A scanned file, read for its key once a file of the same size
+    //! is found in another folder.
+    struct Sized
+    {
+        std::string path;
+        std::string folder;
+        bool keyed;
+    };
+
+    std::map<std::string, Blob> m_blobs;
+    std::map<unsigned long long, std::vector<Sized> > m_sizes;
+};
+
 } // namespace zipper